@@ -0,0 +1,68 @@
+$input v_texcoord0
+
+#include "fs_pbr_lighting.sh"
+
+// Must match light_clusters::max_lights_per_cluster and row_width.
+#define MAX_CLUSTER_LIGHTS 128
+#define ROW_WIDTH 1024.0
+#define LIGHTS_PER_ROW 256.0
+
+SAMPLER2D(s_light_data, 7); // 4 texels per light: position and type, direction, color and intensity, light data
+SAMPLER2D(s_light_grid, 8); // offset and count of each cluster
+SAMPLER2D(s_light_indices, 9);
+
+uniform vec4 u_cluster_grid; // tiles x, tiles y, slices
+uniform vec4 u_cluster_depth; // slice = floor(log(view depth) * x + y)
+uniform vec4 u_cluster_texel; // texel size of s_light_data and of s_light_indices
+
+void main()
+{
+	vec2 texcoord0 = v_texcoord0;
+	GBufferData data = decodeGBuffer(texcoord0, s_tex0, s_tex1, s_tex2, s_tex3, s_tex4);
+	vec3 indirect_specular = texture2D(s_tex5, texcoord0).xyz;
+	vec3 world_position = pbr_world_position(texcoord0, data.depth);
+
+	vec3 clip = clipTransform(vec3(texcoord0 * 2.0 - 1.0, data.depth));
+	vec2 tile = min(floor((clip.xy * 0.5 + 0.5) * u_cluster_grid.xy), u_cluster_grid.xy - 1.0);
+	float view_depth = mul(u_view, vec4(world_position, 1.0)).z;
+	float slice = clamp(floor(log(max(view_depth, 0.0001)) * u_cluster_depth.x + u_cluster_depth.y), 0.0, u_cluster_grid.z - 1.0);
+	vec2 grid_uv = (vec2(tile.y * u_cluster_grid.x + tile.x, slice) + 0.5) / vec2(u_cluster_grid.x * u_cluster_grid.y, u_cluster_grid.z);
+	vec2 cluster = texture2DLod(s_light_grid, grid_uv, 0.0).xy;
+
+	vec3 lighting = vec3(0.0, 0.0, 0.0);
+	for (int i = 0; i < MAX_CLUSTER_LIGHTS; ++i)
+	{
+		if (float(i) >= cluster.y)
+		{
+			break;
+		}
+
+		float index = cluster.x + float(i);
+		vec2 index_uv = (vec2(mod(index, ROW_WIDTH), floor(index / ROW_WIDTH)) + 0.5) * u_cluster_texel.zw;
+		float light = texture2DLod(s_light_indices, index_uv, 0.0).x;
+
+		vec2 light_uv = (vec2(mod(light, LIGHTS_PER_ROW) * 4.0, floor(light / LIGHTS_PER_ROW)) + 0.5) * u_cluster_texel.xy;
+		vec4 position_type = texture2DLod(s_light_data, light_uv, 0.0);
+		vec4 direction = texture2DLod(s_light_data, light_uv + vec2(u_cluster_texel.x, 0.0), 0.0);
+		vec4 color_intensity = texture2DLod(s_light_data, light_uv + vec2(u_cluster_texel.x * 2.0, 0.0), 0.0);
+		vec4 light_data = texture2DLod(s_light_data, light_uv + vec2(u_cluster_texel.x * 3.0, 0.0), 0.0);
+
+		vec3 vector_to_light = position_type.xyz - world_position;
+		vec3 vector_to_light_over_radius = vector_to_light / light_data.x;
+		float light_radius_mask = 1.0f;
+		float spot_falloff = 1.0f;
+		if (position_type.w > 0.5)
+		{
+			light_radius_mask = RadialAttenuation(vector_to_light_over_radius, 1.0f);
+			spot_falloff = SpotAttenuation( vector_to_light_over_radius, normalize(direction.xyz), vec2(light_data.z, 1.0f / (light_data.y - light_data.z )));
+		}
+		else
+		{
+			light_radius_mask = RadialAttenuation(vector_to_light_over_radius, light_data.y);
+		}
+
+		lighting += pbr_light_contribution(data, world_position, indirect_specular, color_intensity.xyz, color_intensity.w, vector_to_light, 0.0f, light_radius_mask, spot_falloff, 1.0f);
+	}
+
+	gl_FragColor = vec4(lighting, 1.0);
+}
\ No newline at end of file
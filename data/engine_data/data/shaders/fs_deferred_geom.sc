@@ -13,13 +13,16 @@ SAMPLER2D(s_tex_ao, 4);
 uniform vec4 u_camera_wpos;
 uniform vec4 u_camera_clip_planes; //.x = near, .y = far
 
+// per material, set with a single call
+uniform vec4 u_material[6];
+#define u_base_color       u_material[0]
+#define u_subsurface_color u_material[1]
+#define u_emissive_color   u_material[2]
+#define u_surface_data     u_material[3]
+#define u_tiling           u_material[4]
+#define u_dither_threshold u_material[5] //.x = alpha threshold .y = distance threshold
+
 // per instance
-uniform vec4 u_base_color;
-uniform vec4 u_subsurface_color;
-uniform vec4 u_emissive_color;
-uniform vec4 u_surface_data;
-uniform vec4 u_tiling;
-uniform vec4 u_dither_threshold; //.x = alpha threshold .y = distance threshold
 uniform vec4 u_lod_params;
 
 void main()
@@ -18,25 +18,74 @@ uniform vec4 u_light_color_intensity;
 uniform vec4 u_light_data;
 uniform vec4 u_camera_position;
 
-vec4 pbr_light(vec2 texcoord0)
+#if SHADOW
+SAMPLER2DSHADOW(s_shadow_map, 7);
+
+uniform mat4 u_shadow_matrix[6]; // world to face uv and depth, a face per cascade or cube side
+uniform vec4 u_shadow_rect[6]; // offset and scale of each face in the atlas
+uniform vec4 u_shadow_params; // depth bias, face size in texels, pcf, face count
+uniform vec4 u_shadow_splits; // far view depth of each cascade
+
+float pbr_shadow(vec3 world_position)
 {
-	GBufferData data = decodeGBuffer(texcoord0, s_tex0, s_tex1, s_tex2, s_tex3, s_tex4);
-	vec3 indirect_specular = texture2D(s_tex5, texcoord0).xyz;
-	vec3 clip = vec3(texcoord0 * 2.0 - 1.0, data.depth);
+#if DIRECTIONAL_LIGHT
+	float view_depth = mul(u_view, vec4(world_position, 1.0)).z;
+	float face = dot(step(u_shadow_splits, vec4_splat(view_depth)), vec4_splat(1.0));
+	if (face >= u_shadow_params.w)
+	{
+		return 1.0;
+	}
+#elif POINT_LIGHT
+	vec3 d = world_position - u_light_position.xyz;
+	vec3 a = abs(d);
+	float face = a.x >= a.y && a.x >= a.z ? (d.x >= 0.0 ? 0.0 : 1.0) : (a.y >= a.z ? (d.y >= 0.0 ? 2.0 : 3.0) : (d.z >= 0.0 ? 4.0 : 5.0));
+#else
+	float face = 0.0;
+#endif
+	int index = int(face);
+	vec4 coord = mul(u_shadow_matrix[index], vec4(world_position, 1.0));
+	if (coord.w <= 0.0)
+	{
+		return 1.0;
+	}
+
+	coord.xyz /= coord.w;
+	if (coord.x < 0.0 || coord.x > 1.0 || coord.y < 0.0 || coord.y > 1.0 || coord.z > 1.0)
+	{
+		return 1.0;
+	}
+
+	// Taps stay inside the face so that they never read a neighbouring one.
+	vec4 rect = u_shadow_rect[index];
+	vec2 texel = rect.zw / u_shadow_params.y;
+	vec2 uv = clamp(rect.xy + coord.xy * rect.zw, rect.xy + texel, rect.xy + rect.zw - texel);
+	float depth = coord.z - u_shadow_params.x;
+	if (u_shadow_params.z > 0.5)
+	{
+		float lit = shadow2D(s_shadow_map, vec3(uv + vec2(-0.5, -0.5) * texel, depth));
+		lit += shadow2D(s_shadow_map, vec3(uv + vec2(0.5, -0.5) * texel, depth));
+		lit += shadow2D(s_shadow_map, vec3(uv + vec2(-0.5, 0.5) * texel, depth));
+		lit += shadow2D(s_shadow_map, vec3(uv + vec2(0.5, 0.5) * texel, depth));
+		return lit * 0.25;
+	}
+	return shadow2D(s_shadow_map, vec3(uv, depth));
+}
+#endif
+
+vec3 pbr_world_position(vec2 texcoord0, float depth)
+{
+	vec3 clip = vec3(texcoord0 * 2.0 - 1.0, depth);
 	clip = clipTransform(clip);
-	vec3 world_position = clipToWorld(u_invViewProj, clip);
+	return clipToWorld(u_invViewProj, clip);
+}
+
+// Lighting of a single light, the light specific terms are computed by the caller.
+vec3 pbr_light_contribution(GBufferData data, vec3 world_position, vec3 indirect_specular, vec3 light_color, float intensity, vec3 vector_to_light, float indirect_diffuse_scale, float light_radius_mask, float spot_falloff, float surface_shadow)
+{
 	vec3 lobe_roughness = vec3(0.0f, data.roughness, 1.0f);
-	vec3 light_color = u_light_color_intensity.xyz;
-	float intensity = u_light_color_intensity.w;
 	vec3 specular_color = mix( 0.04f * light_color, data.base_color, data.metalness );
 	vec3 albedo_color = data.base_color - data.base_color * data.metalness;
-#if DIRECTIONAL_LIGHT
-	vec3 vector_to_light = -u_light_direction.xyz;
-	vec3 indirect_diffuse = albedo_color * 0.1f;
-#else
-	vec3 vector_to_light = u_light_position.xyz - world_position;
-	vec3 indirect_diffuse = vec3(0.0f, 0.0f, 0.0f);
-#endif
+	vec3 indirect_diffuse = albedo_color * indirect_diffuse_scale;
 	float distance_sqr = dot( vector_to_light, vector_to_light );
 	vec3 N = data.world_normal;
 	vec3 V = normalize(u_camera_position.xyz - world_position);
@@ -44,20 +93,6 @@ vec4 pbr_light(vec2 texcoord0)
 	float NoL = saturate( dot(N, L) );
 	float distance_attenuation = 1.0f;
 
-#if POINT_LIGHT
-	vec3 vector_to_light_over_radius = vector_to_light / u_light_data.x;
-	float light_radius_mask = RadialAttenuation(vector_to_light_over_radius, u_light_data.y);
-	float spot_falloff = 1.0f;
-#elif SPOT_LIGHT
-	vec3 vector_to_light_over_radius = vector_to_light / u_light_data.x;
-	float light_radius_mask = RadialAttenuation(vector_to_light_over_radius, 1.0f);
-	float spot_falloff = SpotAttenuation( vector_to_light_over_radius, normalize(u_light_direction.xyz), vec2(u_light_data.z, 1.0f / (u_light_data.y - u_light_data.z )));
-#else
-	float light_radius_mask = 1.0f;
-	float spot_falloff = 1.0f;
-#endif
-	
-	float surface_shadow = 1.0f;
 	float subsurface_shadow = 1.0f;
 	float surface_attenuation = (intensity * distance_attenuation * light_radius_mask * spot_falloff) * surface_shadow;
 	float subsurface_attenuation = (distance_attenuation * light_radius_mask * spot_falloff) * subsurface_shadow;
@@ -71,10 +106,43 @@ vec4 pbr_light(vec2 texcoord0)
 	vec3 surface_multiplier = light_color * (NoL * surface_attenuation);
 	vec3 subsurface_multiplier = (light_color * subsurface_attenuation);
 	
-	vec3 lighting = surface_multiplier * direct_surface_lighting + (subsurface_lighting + indirect_surface_lighting) * subsurface_multiplier + data.emissive_color;
+	return surface_multiplier * direct_surface_lighting + (subsurface_lighting + indirect_surface_lighting) * subsurface_multiplier + data.emissive_color;
+}
+
+vec4 pbr_light(vec2 texcoord0)
+{
+	GBufferData data = decodeGBuffer(texcoord0, s_tex0, s_tex1, s_tex2, s_tex3, s_tex4);
+	vec3 indirect_specular = texture2D(s_tex5, texcoord0).xyz;
+	vec3 world_position = pbr_world_position(texcoord0, data.depth);
+#if DIRECTIONAL_LIGHT
+	vec3 vector_to_light = -u_light_direction.xyz;
+	float indirect_diffuse_scale = 0.1f;
+#else
+	vec3 vector_to_light = u_light_position.xyz - world_position;
+	float indirect_diffuse_scale = 0.0f;
+#endif
+
+#if POINT_LIGHT
+	vec3 vector_to_light_over_radius = vector_to_light / u_light_data.x;
+	float light_radius_mask = RadialAttenuation(vector_to_light_over_radius, u_light_data.y);
+	float spot_falloff = 1.0f;
+#elif SPOT_LIGHT
+	vec3 vector_to_light_over_radius = vector_to_light / u_light_data.x;
+	float light_radius_mask = RadialAttenuation(vector_to_light_over_radius, 1.0f);
+	float spot_falloff = SpotAttenuation( vector_to_light_over_radius, normalize(u_light_direction.xyz), vec2(u_light_data.z, 1.0f / (u_light_data.y - u_light_data.z )));
+#else
+	float light_radius_mask = 1.0f;
+	float spot_falloff = 1.0f;
+#endif
 	
+#if SHADOW
+	float surface_shadow = pbr_shadow(world_position);
+#else
+	float surface_shadow = 1.0f;
+#endif
+
 	vec4 result;
-	result.xyz = lighting;
+	result.xyz = pbr_light_contribution(data, world_position, indirect_specular, u_light_color_intensity.xyz, u_light_color_intensity.w, vector_to_light, indirect_diffuse_scale, light_radius_mask, spot_falloff, surface_shadow);
 	result.w = 1.0f;
 	return result;
 }
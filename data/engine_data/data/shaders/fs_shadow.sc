@@ -0,0 +1,7 @@
+#include "common.sh"
+
+// Only the depth is written.
+void main()
+{
+	gl_FragColor = vec4_splat(0.0);
+}
\ No newline at end of file
@@ -0,0 +1 @@
+vec3 a_position  : POSITION;
\ No newline at end of file
@@ -0,0 +1,15 @@
+$input a_position, a_weight, a_indices
+
+#define BGFX_CONFIG_MAX_BONES 128
+#include "common.sh"
+
+void main()
+{
+	mat4 model = 	a_weight.x * u_model[int(a_indices.x)] + 
+					a_weight.y * u_model[int(a_indices.y)] +
+					a_weight.z * u_model[int(a_indices.z)] +
+					a_weight.w * u_model[int(a_indices.w)];
+
+	vec3 wpos = mul(model, vec4(a_position, 1.0) ).xyz;
+	gl_Position = mul(u_viewProj, vec4(wpos, 1.0) );
+}
\ No newline at end of file
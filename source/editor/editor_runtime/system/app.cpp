@@ -412,8 +412,17 @@ namespace editor
 
         // TODO
         gui::SameLine(width / 2.0f - 36.0f);
-        if (gui::ToolbarButton("play", icons["play"].get(), "PLAY", false))
+        if (gui::ToolbarButton("play", icons["play"].get(), "PLAY", play_snapshot_ != nullptr))
         {
+            if (!play_snapshot_)
+            {
+                play_snapshot_ = std::make_shared<ecs::utils::world_snapshot>(ecs::utils::take_snapshot());
+            }
+            else
+            {
+                ecs::utils::restore_snapshot(*play_snapshot_);
+                play_snapshot_.reset();
+            }
         }
         gui::SameLine(0.0f);
         if (gui::ToolbarButton("pause", icons["pause"].get(), "PAUSE", false))
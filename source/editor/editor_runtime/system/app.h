@@ -11,6 +11,14 @@ namespace imguidock
 class console_log;
 class render_window;
 
+namespace ecs
+{
+    namespace utils
+    {
+        struct world_snapshot;
+    }
+} // namespace ecs
+
 namespace editor
 {
     class app final : public runtime::app
@@ -41,5 +49,7 @@ namespace editor
         std::shared_ptr<console_log> console_log_;
         ///
         std::string console_dock_name_;
+        /// World as it was when play was pressed, restored on stop.
+        std::shared_ptr<ecs::utils::world_snapshot> play_snapshot_;
     };
 } // namespace editor
@@ -0,0 +1,518 @@
+#include <runtime/ecs/components/transform_component.h>
+#include <runtime/ecs/constructs/utils.h>
+#include <runtime/ecs/ecs.h>
+
+#include <core/system/subsystem.h>
+#include <core/tasks/task_system.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Allocation counting, every global allocation made by the process goes
+// through here so the benchmarks can report how many a run needed.
+//-----------------------------------------------------------------------------
+namespace
+{
+    std::atomic<std::uint64_t> allocation_count {0};
+
+    void* counted_alloc(std::size_t size)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        if (void* ptr = std::malloc(size ? size : 1))
+        {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+
+    void* counted_aligned_alloc(std::size_t size, std::align_val_t alignment)
+    {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+        const auto align   = static_cast<std::size_t>(alignment);
+        const auto rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#if defined(_MSC_VER)
+        void* ptr = _aligned_malloc(rounded, align);
+#else
+        void* ptr = std::aligned_alloc(align, rounded);
+#endif
+        if (ptr)
+        {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+
+    void counted_aligned_free(void* ptr)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+    }
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return counted_aligned_alloc(size, alignment); }
+void  operator delete(void* ptr) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void  operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void  operator delete(void* ptr, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void  operator delete[](void* ptr, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void  operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+void  operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { counted_aligned_free(ptr); }
+
+namespace bench
+{
+    using namespace runtime;
+
+    struct position : component_impl<position>
+    {
+        float x = 0.0f;
+        float y = 0.0f;
+        float z = 0.0f;
+    };
+
+    struct velocity : component_impl<velocity>
+    {
+        float x = 1.0f;
+        float y = 1.0f;
+        float z = 1.0f;
+    };
+
+    struct mass : component_impl<mass>
+    {
+        float value = 1.0f;
+    };
+
+    struct result
+    {
+        std::string   name;
+        std::size_t   entities      = 0;
+        double        ns_per_entity = 0.0;
+        std::uint64_t allocations   = 0;
+    };
+
+    /// Measures the part of a run between start() and stop(), so the setup and
+    /// teardown around it are left out.
+    class timer
+    {
+    public:
+        void start()
+        {
+            allocations_ = allocation_count.load(std::memory_order_relaxed);
+            start_       = std::chrono::steady_clock::now();
+        }
+
+        void stop()
+        {
+            elapsed_ += std::chrono::steady_clock::now() - start_;
+            allocated_ += allocation_count.load(std::memory_order_relaxed) - allocations_;
+        }
+
+        double        nanoseconds() const { return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed_).count()); }
+        std::uint64_t allocations() const { return allocated_; }
+
+    private:
+        std::chrono::steady_clock::time_point start_;
+        std::chrono::steady_clock::duration   elapsed_ {0};
+        std::uint64_t                         allocations_ = 0;
+        std::uint64_t                         allocated_   = 0;
+    };
+
+    struct options
+    {
+        std::size_t max_entities = 1000000;
+        std::size_t repeats      = 3;
+        std::string output;
+    };
+
+    class suite
+    {
+    public:
+        explicit suite(const options& opts) : options_(opts) {}
+
+        /// Runs f(timer&) options_.repeats times and keeps the fastest run.
+        void run(const std::string& name, std::size_t entities, const std::function<void(timer&)>& f)
+        {
+            result best;
+            best.name          = name;
+            best.entities      = entities;
+            best.ns_per_entity = std::numeric_limits<double>::max();
+            for (std::size_t i = 0; i < options_.repeats; ++i)
+            {
+                timer t;
+                f(t);
+
+                const auto ns_per_entity = t.nanoseconds() / double(std::max<std::size_t>(entities, 1));
+                if (ns_per_entity < best.ns_per_entity)
+                {
+                    best.ns_per_entity = ns_per_entity;
+                    best.allocations   = t.allocations();
+                }
+            }
+
+            std::cerr << name << " [" << entities << "]: " << best.ns_per_entity << " ns/entity, " << best.allocations << " allocations"
+                      << std::endl;
+            results_.push_back(best);
+        }
+
+        std::vector<std::size_t> sizes() const
+        {
+            std::vector<std::size_t> result;
+            for (std::size_t n : {std::size_t(1000), std::size_t(10000), std::size_t(100000), std::size_t(1000000)})
+            {
+                if (n <= options_.max_entities)
+                {
+                    result.push_back(n);
+                }
+            }
+            return result;
+        }
+
+        std::string to_json() const
+        {
+            std::ostringstream out;
+            out << "{\n  \"benchmarks\": [\n";
+            for (std::size_t i = 0; i < results_.size(); ++i)
+            {
+                const auto& r = results_[i];
+                out << "    {\"name\": \"" << r.name << "\", \"entities\": " << r.entities << ", \"ns_per_entity\": " << r.ns_per_entity
+                    << ", \"allocations\": " << r.allocations
+                    << ", \"allocations_per_entity\": " << double(r.allocations) / double(std::max<std::size_t>(r.entities, 1)) << "}"
+                    << (i + 1 < results_.size() ? ",\n" : "\n");
+            }
+            out << "  ]\n}\n";
+            return out.str();
+        }
+
+    private:
+        options             options_;
+        std::vector<result> results_;
+    };
+
+    /// Mimics the storage the ecs used before the packed pools: one shared_ptr
+    /// per entity slot, a bitset scan over every slot and a weak_ptr lock per
+    /// access, kept as the reference the pools are measured against.
+    struct shared_ptr_storage
+    {
+        std::vector<std::shared_ptr<position>> positions;
+        std::vector<std::shared_ptr<velocity>> velocities;
+        std::vector<std::bitset<2>>            masks;
+
+        /// Grows the slots one entity at a time, a shared_ptr per component.
+        void create(std::size_t n, int components)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                positions.push_back(std::make_shared<position>());
+                velocities.push_back(components > 1 ? std::make_shared<velocity>() : nullptr);
+                masks.emplace_back(components > 1 ? 3 : 1);
+            }
+        }
+
+        void destroy(std::size_t i)
+        {
+            positions[i].reset();
+            velocities[i].reset();
+            masks[i].reset();
+        }
+
+        void for_each(const std::function<void(position&, velocity&)>& f)
+        {
+            for (std::size_t i = 0; i < masks.size(); ++i)
+            {
+                if (!masks[i].all())
+                {
+                    continue;
+                }
+
+                std::weak_ptr<position> p = positions[i];
+                std::weak_ptr<velocity> v = velocities[i];
+                f(*p.lock(), *v.lock());
+            }
+        }
+    };
+
+    void populate(entity_component_system& ecs, std::size_t n, int components)
+    {
+        for (auto& e : ecs.create_many(n))
+        {
+            e.assign<position>();
+            if (components > 1)
+            {
+                e.assign<velocity>();
+            }
+            if (components > 2)
+            {
+                e.assign<mass>();
+            }
+        }
+    }
+
+    void run_all(suite& s)
+    {
+        auto& ecs = core::get_subsystem<entity_component_system>();
+
+        for (auto n : s.sizes())
+        {
+            s.run("create", n, [&](timer& t) {
+                t.start();
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    ecs.create();
+                }
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("create_assign/1", n, [&](timer& t) {
+                t.start();
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    ecs.create().assign<position>();
+                }
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("baseline_shared_ptr_storage/create_assign/1", n, [&](timer& t) {
+                shared_ptr_storage storage;
+                t.start();
+                storage.create(n, 1);
+                t.stop();
+            });
+
+            s.run("destroy", n, [&](timer& t) {
+                populate(ecs, n, 1);
+                std::vector<entity> entities;
+                entities.reserve(n);
+                for (auto e : ecs.all_entities())
+                {
+                    entities.push_back(e);
+                }
+                t.start();
+                for (auto& e : entities)
+                {
+                    e.destroy();
+                }
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("baseline_shared_ptr_storage/destroy", n, [&](timer& t) {
+                shared_ptr_storage storage;
+                storage.create(n, 1);
+                t.start();
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    storage.destroy(i);
+                }
+                t.stop();
+            });
+
+            s.run("create_many", n, [&](timer& t) {
+                t.start();
+                auto entities = ecs.create_many(n);
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("create_many_assign/1", n, [&](timer& t) {
+                t.start();
+                for (auto& e : ecs.create_many(n))
+                {
+                    e.assign<position>();
+                }
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("destroy_many", n, [&](timer& t) {
+                auto entities = ecs.create_many(n);
+                for (auto& e : entities)
+                {
+                    e.assign<position>();
+                }
+                t.start();
+                ecs.destroy_many(entities);
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("assign_remove", n, [&](timer& t) {
+                auto entities = ecs.create_many(n);
+                t.start();
+                for (auto& e : entities)
+                {
+                    e.assign<velocity>();
+                }
+                for (auto& e : entities)
+                {
+                    e.remove<velocity>();
+                }
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("for_each/1", n, [&](timer& t) {
+                populate(ecs, n, 1);
+                t.start();
+                ecs.for_each<position>([](entity, position& p) { p.x += 1.0f; });
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("for_each/2", n, [&](timer& t) {
+                populate(ecs, n, 2);
+                t.start();
+                ecs.for_each<position, velocity>([](entity, position& p, velocity& v) { p.x += v.x; });
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("for_each/3", n, [&](timer& t) {
+                populate(ecs, n, 3);
+                t.start();
+                ecs.for_each<position, velocity, mass>([](entity, position& p, velocity& v, mass& m) { p.x += v.x * m.value; });
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("query/3", n, [&](timer& t) {
+                populate(ecs, n, 3);
+                t.start();
+                ecs.query<position, const velocity, const mass>().each(
+                    [](entity, position& p, const velocity& v, const mass& m) { p.x += v.x * m.value; });
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("parallel_for_each/2", n, [&](timer& t) {
+                populate(ecs, n, 2);
+                t.start();
+                ecs.parallel_for_each<position, const velocity>([](entity, position& p, const velocity& v) { p.x += v.x; });
+                t.stop();
+                ecs.dispose();
+            });
+
+            s.run("get_component/random", n, [&](timer& t) {
+                auto entities = ecs.create_many(n);
+                for (auto& e : entities)
+                {
+                    e.assign<position>();
+                }
+                std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+                float sum = 0.0f;
+                t.start();
+                for (const auto& e : entities)
+                {
+                    sum += e.get_component<position>().lock()->x;
+                }
+                t.stop();
+                ecs.dispose();
+                volatile float sink = sum;
+                (void)sink;
+            });
+
+            s.run("baseline_shared_ptr_storage/for_each/2", n, [&](timer& t) {
+                shared_ptr_storage storage;
+                storage.create(n, 2);
+                t.start();
+                storage.for_each([](position& p, velocity& v) { p.x += v.x; });
+                t.stop();
+            });
+
+            // Serializes through the reflected transform component, so keep it to
+            // the sizes a scene would clone in one go.
+            if (n <= 10000)
+            {
+                s.run("clone_entity", n, [&](timer& t) {
+                    auto entities = ecs.create_many(n);
+                    for (auto& e : entities)
+                    {
+                        e.assign<transform_component>();
+                    }
+                    t.start();
+                    for (const auto& e : entities)
+                    {
+                        ecs::utils::clone_entity(e);
+                    }
+                    t.stop();
+                    ecs.dispose();
+                });
+            }
+        }
+    }
+
+    options parse_options(int argc, char* argv[])
+    {
+        options opts;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--max-entities" && i + 1 < argc)
+            {
+                opts.max_entities = std::stoull(argv[++i]);
+            }
+            else if (arg == "--repeats" && i + 1 < argc)
+            {
+                opts.repeats = std::max<std::size_t>(std::stoull(argv[++i]), 1);
+            }
+            else if (arg == "--output" && i + 1 < argc)
+            {
+                opts.output = argv[++i];
+            }
+            else
+            {
+                std::cerr << "usage: " << argv[0] << " [--max-entities n] [--repeats n] [--output file.json]" << std::endl;
+                std::exit(1);
+            }
+        }
+        return opts;
+    }
+} // namespace bench
+
+int main(int argc, char* argv[])
+{
+    const auto opts = bench::parse_options(argc, argv);
+
+    core::details::initialize();
+    core::add_subsystem<core::task_system>(true, std::max<std::size_t>(std::thread::hardware_concurrency(), 2) - 1);
+    core::add_subsystem<runtime::entity_component_system>();
+
+    bench::suite s(opts);
+    bench::run_all(s);
+
+    core::details::dispose();
+
+    const auto json = s.to_json();
+    if (opts.output.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream(opts.output) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include <core/math/bbox_soa.h>
+#include <core/math/math_includes.h>
+#include <core/math/transform_kernels.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+    struct result
+    {
+        std::string name;
+        std::size_t count     = 0;
+        double      ns_per_op = 0.0;
+    };
+
+    struct options
+    {
+        std::size_t count   = 100000;
+        std::size_t repeats = 5;
+        std::string output;
+    };
+
+    /// Results are folded in here so that the compiler can not drop the work.
+    volatile float sink = 0.0f;
+
+    class suite
+    {
+    public:
+        explicit suite(const options& opts) : options_(opts) {}
+
+        /// Runs f() options_.repeats times and keeps the fastest run.
+        void run(const std::string& name, const std::function<void()>& f)
+        {
+            result best;
+            best.name      = name;
+            best.count     = options_.count;
+            best.ns_per_op = std::numeric_limits<double>::max();
+            for (std::size_t i = 0; i < options_.repeats; ++i)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                f();
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                const auto ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                best.ns_per_op = std::min(best.ns_per_op, ns / double(std::max<std::size_t>(options_.count, 1)));
+            }
+
+            std::cerr << name << " [" << best.count << "]: " << best.ns_per_op << " ns/op" << std::endl;
+            results_.push_back(best);
+        }
+
+        std::size_t count() const { return options_.count; }
+
+        std::string to_json() const
+        {
+            std::ostringstream out;
+            out << "{\n  \"isa\": \"" << isa() << "\",\n  \"benchmarks\": [\n";
+            for (std::size_t i = 0; i < results_.size(); ++i)
+            {
+                const auto& r = results_[i];
+                out << "    {\"name\": \"" << r.name << "\", \"count\": " << r.count << ", \"ns_per_op\": " << r.ns_per_op << "}"
+                    << (i + 1 < results_.size() ? ",\n" : "\n");
+            }
+            out << "  ]\n}\n";
+            return out.str();
+        }
+
+        static const char* isa()
+        {
+#if defined(MATH_KERNELS_SSE)
+            return "sse";
+#elif defined(MATH_KERNELS_NEON)
+            return "neon";
+#else
+            return "scalar";
+#endif
+        }
+
+    private:
+        options             options_;
+        std::vector<result> results_;
+    };
+
+    struct trs
+    {
+        math::vec3 position;
+        math::quat rotation;
+        math::vec3 scale;
+    };
+
+    void run_all(suite& s)
+    {
+        const auto                            n = s.count();
+        std::mt19937                          rng(42);
+        std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+        std::uniform_real_distribution<float> positive(0.5f, 2.0f);
+
+        std::vector<trs> inputs(n);
+        for (auto& in : inputs)
+        {
+            in.position = {value(rng), value(rng), value(rng)};
+            in.rotation = math::normalize(math::quat(value(rng), value(rng), value(rng), value(rng)));
+            in.scale    = {positive(rng), positive(rng), positive(rng)};
+        }
+
+        std::vector<math::mat4> matrices(n);
+        std::vector<math::mat4> others(n);
+        std::vector<math::mat4> outputs(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const auto& in = inputs[i];
+            matrices[i]    = math::translate(in.position) * math::mat4_cast(in.rotation) * math::scale(in.scale);
+            others[i]      = matrices[(i * 7919) % n];
+        }
+
+        std::vector<math::vec3> points(n);
+        std::vector<math::vec3> transformed(n);
+        for (auto& p : points)
+        {
+            p = {value(rng), value(rng), value(rng)};
+        }
+
+        std::vector<math::bbox> boxes(n);
+        std::vector<math::bbox> transformed_boxes(n);
+        for (auto& b : boxes)
+        {
+            const math::vec3 a {value(rng), value(rng), value(rng)};
+            const math::vec3 c {value(rng), value(rng), value(rng)};
+            b = math::bbox(math::min(a, c), math::max(a, c));
+        }
+
+        auto checksum = [](const std::vector<math::mat4>& m) {
+            float sum = 0.0f;
+            for (const auto& v : m)
+            {
+                sum += v[3][0] + v[0][0];
+            }
+            sink = sink + sum;
+        };
+
+        s.run("glm/compose_trs", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const auto& in = inputs[i];
+                outputs[i]     = math::translate(in.position) * math::mat4_cast(in.rotation) * math::scale(in.scale);
+            }
+            checksum(outputs);
+        });
+        s.run("kernels/compose_trs", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const auto& in          = inputs[i];
+                const float rotation[4] = {in.rotation.x, in.rotation.y, in.rotation.z, in.rotation.w};
+                math::kernels::compose_trs(&in.position[0], rotation, &in.scale[0], &outputs[i][0][0]);
+            }
+            checksum(outputs);
+        });
+
+        s.run("glm/mul", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                outputs[i] = matrices[i] * others[i];
+            }
+            checksum(outputs);
+        });
+        s.run("kernels/mul", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                math::kernels::mul(&matrices[i][0][0], &others[i][0][0], &outputs[i][0][0]);
+            }
+            checksum(outputs);
+        });
+
+        s.run("glm/inverse", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                outputs[i] = math::inverse(matrices[i]);
+            }
+            checksum(outputs);
+        });
+        s.run("kernels/affine_inverse", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                math::kernels::affine_inverse(&matrices[i][0][0], &outputs[i][0][0]);
+            }
+            checksum(outputs);
+        });
+
+        const auto& m = matrices.front();
+        s.run("glm/transform_points", [&]() {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                transformed[i] = math::vec3(m * math::vec4(points[i], 1.0f));
+            }
+            sink = sink + transformed.back().x;
+        });
+        s.run("kernels/transform_points", [&]() {
+            math::kernels::transform_points(&m[0][0], &points[0][0], &transformed[0][0], n);
+            sink = sink + transformed.back().x;
+        });
+
+        const math::transform t(m);
+        s.run("bbox/mul", [&]() {
+            // The per box path bbox::mul took before the kernels.
+            const auto x_axis = t.x_axis();
+            const auto y_axis = t.y_axis();
+            const auto z_axis = t.z_axis();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const auto& b  = boxes[i];
+                auto        xa = x_axis * b.min.x;
+                auto        xb = x_axis * b.max.x;
+                auto        ya = y_axis * b.min.y;
+                auto        yb = y_axis * b.max.y;
+                auto        za = z_axis * b.min.z;
+                auto        zb = z_axis * b.max.z;
+
+                transformed_boxes[i] = math::bbox(math::min(xa, xb) + math::min(ya, yb) + math::min(za, zb) + t.get_position(),
+                                                  math::max(xa, xb) + math::max(ya, yb) + math::max(za, zb) + t.get_position());
+            }
+            sink = sink + transformed_boxes.back().min.x;
+        });
+        s.run("kernels/transform_aabbs", [&]() {
+            math::bbox::mul(boxes.data(), transformed_boxes.data(), n, t);
+            sink = sink + transformed_boxes.back().min.x;
+        });
+
+        // A camera at the origin looking down -z sees roughly a fifth of the boxes.
+        const math::transform view(math::lookAt(math::vec3(0.0f, 0.0f, 0.0f), math::vec3(0.0f, 0.0f, -1.0f), math::vec3(0.0f, 1.0f, 0.0f)));
+        const math::transform proj(math::perspective(math::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f));
+        const math::frustum   frustum(view, proj, false);
+
+        std::vector<math::transform> worlds(n);
+        math::bbox_soa               world_bounds;
+        world_bounds.resize(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            worlds[i] = math::transform(matrices[i]);
+            world_bounds.set(i, math::bbox::mul(boxes[i], worlds[i]));
+        }
+
+        s.run("frustum/test_obb", [&]() {
+            std::size_t visible = 0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                visible += math::frustum::test_obb(frustum, boxes[i], worlds[i]) ? 1 : 0;
+            }
+            sink = sink + float(visible);
+        });
+        std::vector<std::uint32_t> bits;
+        s.run("kernels/cull_aabbs", [&]() {
+            frustum.test_aabbs(world_bounds, bits);
+            sink = sink + float(bits.front());
+        });
+    }
+
+    options parse_options(int argc, char* argv[])
+    {
+        options opts;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            if (arg == "--count" && i + 1 < argc)
+            {
+                opts.count = std::max<std::size_t>(std::stoull(argv[++i]), 1);
+            }
+            else if (arg == "--repeats" && i + 1 < argc)
+            {
+                opts.repeats = std::max<std::size_t>(std::stoull(argv[++i]), 1);
+            }
+            else if (arg == "--output" && i + 1 < argc)
+            {
+                opts.output = argv[++i];
+            }
+            else
+            {
+                std::cerr << "usage: " << argv[0] << " [--count n] [--repeats n] [--output file.json]" << std::endl;
+                std::exit(1);
+            }
+        }
+        return opts;
+    }
+} // namespace bench
+
+int main(int argc, char* argv[])
+{
+    const auto opts = bench::parse_options(argc, argv);
+
+    bench::suite s(opts);
+    bench::run_all(s);
+
+    const auto json = s.to_json();
+    if (opts.output.empty())
+    {
+        std::cout << json;
+    }
+    else
+    {
+        std::ofstream(opts.output) << json;
+    }
+    return 0;
+}
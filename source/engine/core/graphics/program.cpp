@@ -4,8 +4,50 @@
 #include "texture.h"
 #include "uniform.h"
 
+#include <mutex>
+
 namespace gfx
 {
+    namespace
+    {
+        struct uniform_registry
+        {
+            std::mutex                                     mutex;
+            std::vector<std::string>                       names;
+            std::unordered_map<std::string, std::uint16_t> ids;
+        };
+
+        uniform_registry& get_uniform_registry()
+        {
+            static uniform_registry registry;
+            return registry;
+        }
+
+        std::string get_uniform_name(uniform_id _id)
+        {
+            auto&                       registry = get_uniform_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            return registry.names[_id.index];
+        }
+    } // namespace
+
+    uniform_id get_uniform_id(const std::string& _name)
+    {
+        auto&                       registry = get_uniform_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+
+        auto it = registry.ids.find(_name);
+        if (it == registry.ids.end())
+        {
+            it = registry.ids.emplace(_name, std::uint16_t(registry.names.size())).first;
+            registry.names.emplace_back(_name);
+        }
+
+        uniform_id id;
+        id.index = it->second;
+        return id;
+    }
+
     program::program(const std::shared_ptr<shader>& compute_shader)
     {
         if (compute_shader)
@@ -93,4 +135,60 @@ namespace gfx
 
         return hUniform;
     }
+
+    void program::set_texture(std::uint8_t       _stage,
+                              uniform_id         _sampler,
+                              gfx::frame_buffer* frameBuffer,
+                              uint8_t            _attachment /*= 0 */,
+                              std::uint32_t      _flags /*= std::numeric_limits<std::uint32_t>::max()*/)
+    {
+        if (frameBuffer == nullptr)
+        {
+            return;
+        }
+
+        gfx::set_texture(_stage, get_uniform(_sampler, true)->native_handle(), frameBuffer->get_texture(_attachment)->native_handle(), _flags);
+    }
+
+    void program::set_texture(std::uint8_t  _stage,
+                              uniform_id    _sampler,
+                              gfx::texture* _texture,
+                              std::uint32_t _flags /*= std::numeric_limits<std::uint32_t>::max()*/)
+    {
+        if (_texture == nullptr)
+        {
+            return;
+        }
+
+        gfx::set_texture(_stage, get_uniform(_sampler, true)->native_handle(), _texture->native_handle(), _flags);
+    }
+
+    void program::set_uniform(uniform_id _id, const void* _value, uint16_t _num)
+    {
+        const auto& uniform = get_uniform(_id);
+
+        if (uniform)
+        {
+            gfx::set_uniform(uniform->native_handle(), _value, _num);
+        }
+    }
+
+    const std::shared_ptr<gfx::uniform>& program::get_uniform(uniform_id _id, bool texture)
+    {
+        if (_id.index >= uniforms_by_id.size())
+        {
+            uniforms_by_id.resize(_id.index + 1);
+            resolved_ids.resize(_id.index + 1, false);
+        }
+
+        // A missing uniform is looked up again when wanted as a sampler, which creates it.
+        auto& uniform = uniforms_by_id[_id.index];
+        if (!resolved_ids[_id.index] || (!uniform && texture))
+        {
+            uniform                 = get_uniform(get_uniform_name(_id), texture);
+            resolved_ids[_id.index] = true;
+        }
+
+        return uniform;
+    }
 } // namespace gfx
@@ -3,6 +3,7 @@
 #include "handle_impl.h"
 #include <limits>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -13,6 +14,31 @@ namespace gfx
     struct shader;
     struct uniform;
 
+    //-----------------------------------------------------------------------------
+    //  Name : uniform_id (Struct)
+    /// <summary>
+    /// A uniform name resolved once with get_uniform_id. The same id works with
+    /// every program, each program looks its uniform up on first use only.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct uniform_id
+    {
+        static constexpr std::uint16_t invalid_index = std::numeric_limits<std::uint16_t>::max();
+
+        inline bool is_valid() const { return index != invalid_index; }
+
+        std::uint16_t index = invalid_index;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_uniform_id ()
+    /// <summary>
+    /// Returns the id of a uniform or sampler name, registering it on the first
+    /// call. Thread safe, meant to be called once and the id kept.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    uniform_id get_uniform_id(const std::string& _name);
+
     struct program : public handle_impl<program_handle>
     {
         //-----------------------------------------------------------------------------
@@ -92,7 +118,49 @@ namespace gfx
         //-----------------------------------------------------------------------------
         std::shared_ptr<gfx::uniform> get_uniform(const std::string& _name, bool texture = false);
 
+        //-----------------------------------------------------------------------------
+        //  Name : set_texture ()
+        /// <summary>
+        /// Same as the named overload, without looking the sampler up by name.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void set_texture(std::uint8_t       _stage,
+                         uniform_id         _sampler,
+                         gfx::frame_buffer* _handle,
+                         uint8_t            _attachment = 0,
+                         std::uint32_t      _flags      = std::numeric_limits<std::uint32_t>::max());
+
+        //-----------------------------------------------------------------------------
+        //  Name : set_texture ()
+        /// <summary>
+        /// Same as the named overload, without looking the sampler up by name.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void set_texture(std::uint8_t  _stage,
+                         uniform_id    _sampler,
+                         gfx::texture* _texture,
+                         std::uint32_t _flags = std::numeric_limits<std::uint32_t>::max());
+
+        //-----------------------------------------------------------------------------
+        //  Name : set_uniform ()
+        /// <summary>
+        /// Same as the named overload, without looking the uniform up by name.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void set_uniform(uniform_id _id, const void* _value, std::uint16_t _num = 1);
+
+        //-----------------------------------------------------------------------------
+        //  Name : get_uniform ()
+        /// <summary>
+        /// Uniform of an id, resolved by name the first time and cached after.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        const std::shared_ptr<gfx::uniform>& get_uniform(uniform_id _id, bool texture = false);
+
         /// All uniforms for this program.
         std::unordered_map<std::string, std::shared_ptr<gfx::uniform>> uniforms;
+        /// Uniforms by uniform_id, filled on first use.
+        std::vector<std::shared_ptr<gfx::uniform>> uniforms_by_id;
+        std::vector<bool>                          resolved_ids;
     };
 } // namespace gfx
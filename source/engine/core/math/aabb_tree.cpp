@@ -0,0 +1,289 @@
+#include "aabb_tree.h"
+#include <algorithm>
+
+namespace math
+{
+    namespace
+    {
+        inline bbox combine(const bbox& a, const bbox& b) { return bbox(min(a.min, b.min), max(a.max, b.max)); }
+
+        inline float surface_area(const bbox& b)
+        {
+            const vec3 d = b.max - b.min;
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        inline bool contains(const bbox& outer, const bbox& inner)
+        {
+            return all(lessThanEqual(outer.min, inner.min)) && all(greaterThanEqual(outer.max, inner.max));
+        }
+    } // namespace
+
+    ///////////////////////////////////////////////////////////////////////////////
+    // aabb_tree Member Functions
+    ///////////////////////////////////////////////////////////////////////////////
+    //-----------------------------------------------------------------------------
+    //  Name : insert ()
+    /// <summary>
+    /// Adds a leaf for bounds grown by margin and returns its handle.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::uint32_t aabb_tree::insert(const bbox& bounds, const vec3& margin, std::uint32_t user_data)
+    {
+        const auto leaf        = allocate_node();
+        nodes_[leaf].bounds    = bbox(bounds.min - margin, bounds.max + margin);
+        nodes_[leaf].user_data = user_data;
+        nodes_[leaf].height    = 0;
+
+        insert_leaf(leaf);
+        ++leaf_count_;
+        return leaf;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : remove ()
+    /// <summary>
+    /// Removes a leaf returned by insert.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void aabb_tree::remove(std::uint32_t leaf)
+    {
+        remove_leaf(leaf);
+        free_node(leaf);
+        --leaf_count_;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : move ()
+    /// <summary>
+    /// Updates the bounds of a leaf. Returns false when the new bounds still
+    /// fit the fattened ones and the tree was left as it was.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    bool aabb_tree::move(std::uint32_t leaf, const bbox& bounds, const vec3& margin)
+    {
+        if (contains(nodes_[leaf].bounds, bounds))
+        {
+            // Still inside, unless it shrank so much that the fat box is a poor fit.
+            const bbox loose(bounds.min - margin * 4.0f, bounds.max + margin * 4.0f);
+            if (contains(loose, nodes_[leaf].bounds))
+            {
+                return false;
+            }
+        }
+
+        remove_leaf(leaf);
+        nodes_[leaf].bounds = bbox(bounds.min - margin, bounds.max + margin);
+        insert_leaf(leaf);
+        return true;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : clear ()
+    /// <summary>
+    /// Removes every leaf.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void aabb_tree::clear()
+    {
+        nodes_.clear();
+        root_       = null_node;
+        free_list_  = null_node;
+        leaf_count_ = 0;
+    }
+
+    std::uint32_t aabb_tree::allocate_node()
+    {
+        if (free_list_ == null_node)
+        {
+            nodes_.emplace_back();
+            return std::uint32_t(nodes_.size() - 1);
+        }
+
+        const auto index = free_list_;
+        free_list_       = nodes_[index].parent;
+        nodes_[index]    = node();
+        return index;
+    }
+
+    void aabb_tree::free_node(std::uint32_t index)
+    {
+        nodes_[index].parent = free_list_;
+        nodes_[index].child1 = null_node;
+        nodes_[index].child2 = null_node;
+        nodes_[index].height = -1;
+        free_list_           = index;
+    }
+
+    void aabb_tree::insert_leaf(std::uint32_t leaf)
+    {
+        if (root_ == null_node)
+        {
+            root_               = leaf;
+            nodes_[leaf].parent = null_node;
+            return;
+        }
+
+        // Walk down to the sibling that makes the tree cheapest, by surface area.
+        const auto leaf_bounds = nodes_[leaf].bounds;
+        auto       index       = root_;
+        while (!nodes_[index].is_leaf())
+        {
+            const auto& n      = nodes_[index];
+            const auto  area   = surface_area(n.bounds);
+            const auto  merged = surface_area(combine(n.bounds, leaf_bounds));
+
+            // Cost of pairing the leaf with this node, and the cost pushed down to the children.
+            const auto cost        = 2.0f * merged;
+            const auto inheritance = 2.0f * (merged - area);
+
+            auto child_cost = [&](std::uint32_t child) {
+                const auto& c    = nodes_[child];
+                const auto  grow = surface_area(combine(c.bounds, leaf_bounds));
+                return c.is_leaf() ? grow + inheritance : grow - surface_area(c.bounds) + inheritance;
+            };
+
+            const auto cost1 = child_cost(n.child1);
+            const auto cost2 = child_cost(n.child2);
+            if (cost < cost1 && cost < cost2)
+            {
+                break;
+            }
+
+            index = cost1 < cost2 ? n.child1 : n.child2;
+        }
+
+        const auto sibling    = index;
+        const auto old_parent = nodes_[sibling].parent;
+        const auto new_parent = allocate_node();
+
+        auto& p  = nodes_[new_parent];
+        p.parent = old_parent;
+        p.bounds = combine(leaf_bounds, nodes_[sibling].bounds);
+        p.height = nodes_[sibling].height + 1;
+        p.child1 = sibling;
+        p.child2 = leaf;
+
+        if (old_parent != null_node)
+        {
+            auto& op = nodes_[old_parent];
+            (op.child1 == sibling ? op.child1 : op.child2) = new_parent;
+        }
+        else
+        {
+            root_ = new_parent;
+        }
+
+        nodes_[sibling].parent = new_parent;
+        nodes_[leaf].parent    = new_parent;
+
+        refit(new_parent);
+    }
+
+    void aabb_tree::remove_leaf(std::uint32_t leaf)
+    {
+        if (leaf == root_)
+        {
+            root_ = null_node;
+            return;
+        }
+
+        const auto parent       = nodes_[leaf].parent;
+        const auto grand_parent = nodes_[parent].parent;
+        const auto sibling      = nodes_[parent].child1 == leaf ? nodes_[parent].child2 : nodes_[parent].child1;
+
+        if (grand_parent != null_node)
+        {
+            auto& gp = nodes_[grand_parent];
+            (gp.child1 == parent ? gp.child1 : gp.child2) = sibling;
+            nodes_[sibling].parent = grand_parent;
+            free_node(parent);
+
+            refit(grand_parent);
+        }
+        else
+        {
+            root_                  = sibling;
+            nodes_[sibling].parent = null_node;
+            free_node(parent);
+        }
+    }
+
+    void aabb_tree::refit(std::uint32_t index)
+    {
+        while (index != null_node)
+        {
+            index = balance(index);
+
+            auto&       n = nodes_[index];
+            const auto& a = nodes_[n.child1];
+            const auto& b = nodes_[n.child2];
+            n.height      = 1 + std::max(a.height, b.height);
+            n.bounds      = combine(a.bounds, b.bounds);
+
+            index = n.parent;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : balance ()
+    /// <summary>
+    /// Rotates the taller child of a up when the heights of its children differ
+    /// by more than one. Returns the node now standing where a was.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::uint32_t aabb_tree::balance(std::uint32_t ia)
+    {
+        if (nodes_[ia].is_leaf() || nodes_[ia].height < 2)
+        {
+            return ia;
+        }
+
+        const auto ib      = nodes_[ia].child1;
+        const auto ic      = nodes_[ia].child2;
+        const auto balance = nodes_[ic].height - nodes_[ib].height;
+        if (balance >= -1 && balance <= 1)
+        {
+            return ia;
+        }
+
+        // Lift the taller child (up) over a, the other child (other) stays below a.
+        const auto up    = balance > 1 ? ic : ib;
+        const auto other = balance > 1 ? ib : ic;
+
+        const auto ifirst  = nodes_[up].child1;
+        const auto isecond = nodes_[up].child2;
+
+        // Swap a and up.
+        nodes_[up].child1 = ia;
+        nodes_[up].parent = nodes_[ia].parent;
+        nodes_[ia].parent = up;
+
+        if (nodes_[up].parent != null_node)
+        {
+            auto& p                                = nodes_[nodes_[up].parent];
+            (p.child1 == ia ? p.child1 : p.child2) = up;
+        }
+        else
+        {
+            root_ = up;
+        }
+
+        // The taller grandchild stays under up, the shorter one moves to a.
+        const bool first_taller = nodes_[ifirst].height > nodes_[isecond].height;
+        const auto keep         = first_taller ? ifirst : isecond;
+        const auto give         = first_taller ? isecond : ifirst;
+
+        nodes_[up].child2   = keep;
+        nodes_[give].parent = ia;
+        (balance > 1 ? nodes_[ia].child2 : nodes_[ia].child1) = give;
+
+        nodes_[ia].bounds = combine(nodes_[other].bounds, nodes_[give].bounds);
+        nodes_[ia].height = 1 + std::max(nodes_[other].height, nodes_[give].height);
+
+        nodes_[up].bounds = combine(nodes_[ia].bounds, nodes_[keep].bounds);
+        nodes_[up].height = 1 + std::max(nodes_[ia].height, nodes_[keep].height);
+
+        return up;
+    }
+} // namespace math
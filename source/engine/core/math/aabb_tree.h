@@ -0,0 +1,253 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// aabb_tree Header Includes
+//-----------------------------------------------------------------------------
+#include "bbox.h"
+#include "frustum.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace math
+{
+    //-----------------------------------------------------------------------------
+    // Main class declarations
+    //-----------------------------------------------------------------------------
+    //-----------------------------------------------------------------------------
+    //  Name : aabb_tree (Class)
+    /// <summary>
+    /// Dynamic bounding volume hierarchy over axis aligned boxes. Leaves are
+    /// inserted, removed and moved one at a time and the tree is kept balanced
+    /// with rotations, so the cost of a query depends on what it finds rather
+    /// than on the number of leaves. Leaves store a fattened box, small moves
+    /// inside it do not touch the tree.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    class aabb_tree
+    {
+    public:
+        static constexpr std::uint32_t null_node = ~std::uint32_t(0);
+
+        //-------------------------------------------------------------------------
+        // Public Methods
+        //-------------------------------------------------------------------------
+        //-----------------------------------------------------------------------------
+        //  Name : insert ()
+        /// <summary>
+        /// Adds a leaf for bounds grown by margin and returns its handle.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        std::uint32_t insert(const bbox& bounds, const vec3& margin, std::uint32_t user_data);
+
+        //-----------------------------------------------------------------------------
+        //  Name : remove ()
+        /// <summary>
+        /// Removes a leaf returned by insert.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void remove(std::uint32_t leaf);
+
+        //-----------------------------------------------------------------------------
+        //  Name : move ()
+        /// <summary>
+        /// Updates the bounds of a leaf. Returns false when the new bounds still
+        /// fit the fattened ones and the tree was left as it was.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        bool move(std::uint32_t leaf, const bbox& bounds, const vec3& margin);
+
+        //-----------------------------------------------------------------------------
+        //  Name : clear ()
+        /// <summary>
+        /// Removes every leaf.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void clear();
+
+        inline std::uint32_t get_user_data(std::uint32_t leaf) const { return nodes_[leaf].user_data; }
+        inline const bbox&   get_fat_bounds(std::uint32_t leaf) const { return nodes_[leaf].bounds; }
+        inline std::size_t   size() const { return leaf_count_; }
+        inline std::uint32_t get_height() const { return root_ == null_node ? 0 : std::uint32_t(nodes_[root_].height); }
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(user_data, fully_inside) for every leaf whose box is not
+        /// outside the frustum. Subtrees fully inside are reported without
+        /// testing their leaves, fully_inside is then true.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const frustum& f, F&& callback) const
+        {
+            traverse(
+                [&f](const node& n) {
+                    const auto result = f.classify_aabb(n.bounds);
+                    return result == volume_query::outside ? visit::skip : result == volume_query::inside ? visit::all : visit::test;
+                },
+                [&callback](const node& n, bool inside) { callback(n.user_data, inside); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(user_data) for every leaf whose box touches the sphere.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const vec3& center, float radius, F&& callback) const
+        {
+            const float radius_sq = radius * radius;
+            traverse(
+                [&center, radius_sq](const node& n) {
+                    const vec3 closest = clamp(center, n.bounds.min, n.bounds.max);
+                    const vec3 delta   = closest - center;
+                    return dot(delta, delta) <= radius_sq ? visit::test : visit::skip;
+                },
+                [&callback](const node& n, bool) { callback(n.user_data); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(user_data) for every leaf whose box overlaps bounds.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const bbox& bounds, F&& callback) const
+        {
+            traverse([&bounds](const node& n) { return n.bounds.intersect(bounds) ? visit::test : visit::skip; },
+                     [&callback](const node& n, bool) { callback(n.user_data); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : raycast ()
+        /// <summary>
+        /// Calls f(user_data, t) for every leaf whose box is hit by the segment
+        /// origin + velocity * t, t in [0, 1]. Boxes are hit in no particular
+        /// order.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void raycast(const vec3& origin, const vec3& velocity, F&& callback) const
+        {
+            float t = 0.0f;
+            traverse([&origin, &velocity, &t](const node& n) { return n.bounds.intersect(origin, velocity, t, true) ? visit::test : visit::skip; },
+                     [&callback, &t](const node& n, bool) { callback(n.user_data, t); });
+        }
+
+    private:
+        struct node
+        {
+            /// Fattened box for leaves, union of the children otherwise.
+            bbox          bounds;
+            std::uint32_t parent    = null_node;
+            std::uint32_t child1    = null_node;
+            std::uint32_t child2    = null_node;
+            std::int32_t  height    = 0;
+            std::uint32_t user_data = 0;
+
+            inline bool is_leaf() const { return child1 == null_node; }
+        };
+
+        enum class visit
+        {
+            skip,
+            test,
+            all
+        };
+
+        /// Walks the tree, classify(node) decides whether to skip a subtree,
+        /// keep testing or take all of it. report(leaf, whole_subtree_taken).
+        template<typename Classify, typename Report>
+        void traverse(Classify&& classify, Report&& report) const
+        {
+            if (root_ == null_node)
+            {
+                return;
+            }
+
+            std::uint32_t              local[64];
+            std::vector<std::uint32_t> overflow;
+            std::size_t                count = 0;
+
+            auto push = [&](std::uint32_t index) {
+                if (count < 64)
+                {
+                    local[count] = index;
+                }
+                else
+                {
+                    overflow.push_back(index);
+                }
+                ++count;
+            };
+            auto pop = [&]() {
+                --count;
+                if (count < 64)
+                {
+                    return local[count];
+                }
+                const auto index = overflow.back();
+                overflow.pop_back();
+                return index;
+            };
+
+            push(root_);
+            while (count > 0)
+            {
+                const auto  index = pop();
+                const auto& n     = nodes_[index];
+                const auto  v     = classify(n);
+                if (v == visit::skip)
+                {
+                    continue;
+                }
+
+                if (v == visit::all)
+                {
+                    report_all(index, report);
+                }
+                else if (n.is_leaf())
+                {
+                    report(n, false);
+                }
+                else
+                {
+                    push(n.child1);
+                    push(n.child2);
+                }
+            }
+        }
+
+        template<typename Report>
+        void report_all(std::uint32_t index, Report& report) const
+        {
+            const auto& n = nodes_[index];
+            if (n.is_leaf())
+            {
+                report(n, true);
+                return;
+            }
+
+            report_all(n.child1, report);
+            report_all(n.child2, report);
+        }
+
+        std::uint32_t allocate_node();
+        void          free_node(std::uint32_t index);
+        void          insert_leaf(std::uint32_t leaf);
+        void          remove_leaf(std::uint32_t leaf);
+        std::uint32_t balance(std::uint32_t index);
+        void          refit(std::uint32_t index);
+
+        //-------------------------------------------------------------------------
+        // Private Member Variables
+        //-------------------------------------------------------------------------
+        std::vector<node> nodes_;
+        std::uint32_t     root_       = null_node;
+        std::uint32_t     free_list_  = null_node;
+        std::size_t       leaf_count_ = 0;
+    };
+} // namespace math
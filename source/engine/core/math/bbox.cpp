@@ -1024,18 +1024,44 @@ namespace math
     //-----------------------------------------------------------------------------
     bbox bbox::mul(const bbox& bounds, const transform& t)
     {
+        bbox result;
+        mul(&bounds, &result, 1, t);
+        return result;
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : mul () (Static)
+    /// <summary>
+    /// Transforms count bounding boxes by the provided matrix at once.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void bbox::mul(const bbox* bounds, bbox* out, std::size_t count, const transform& t)
+    {
+        const auto& m = t.get_matrix();
+        if constexpr (sizeof(bbox) == sizeof(float) * 6)
+        {
+            if (kernels::is_affine(&m[0][0]))
+            {
+                kernels::transform_aabbs(&m[0][0], reinterpret_cast<const float*>(bounds), reinterpret_cast<float*>(out), count);
+                return;
+            }
+        }
+
         const auto x_axis = t.x_axis();
         const auto y_axis = t.y_axis();
         const auto z_axis = t.z_axis();
-        auto       xa     = x_axis * bounds.min.x;
-        auto       xb     = x_axis * bounds.max.x;
-        auto       ya     = y_axis * bounds.min.y;
-        auto       yb     = y_axis * bounds.max.y;
-        auto       za     = z_axis * bounds.min.z;
-        auto       zb     = z_axis * bounds.max.z;
-
-        return bbox(math::min(xa, xb) + math::min(ya, yb) + math::min(za, zb) + t.get_position(),
-                    math::max(xa, xb) + math::max(ya, yb) + math::max(za, zb) + t.get_position());
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto xa = x_axis * bounds[i].min.x;
+            auto xb = x_axis * bounds[i].max.x;
+            auto ya = y_axis * bounds[i].min.y;
+            auto yb = y_axis * bounds[i].max.y;
+            auto za = z_axis * bounds[i].min.z;
+            auto zb = z_axis * bounds[i].max.z;
+
+            out[i] = bbox(math::min(xa, xb) + math::min(ya, yb) + math::min(za, zb) + t.get_position(),
+                          math::max(xa, xb) + math::max(ya, yb) + math::max(za, zb) + t.get_position());
+        }
     }
 
     //-----------------------------------------------------------------------------
@@ -60,6 +60,7 @@ namespace math
         // Public Static Functions
         //-------------------------------------------------------------------------
         static bbox mul(const bbox& bounds, const transform& t);
+        static void mul(const bbox* bounds, bbox* out, std::size_t count, const transform& t);
 
         //-------------------------------------------------------------------------
         // Public Operators
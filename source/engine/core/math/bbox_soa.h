@@ -0,0 +1,125 @@
+#pragma once
+
+//-----------------------------------------------------------------------------
+// bbox_soa Header Includes
+//-----------------------------------------------------------------------------
+#include "bbox.h"
+#include "bsphere.h"
+
+#include <vector>
+
+namespace math
+{
+    //-----------------------------------------------------------------------------
+    // Main class declarations
+    //-----------------------------------------------------------------------------
+    //-----------------------------------------------------------------------------
+    //  Name : bbox_soa (Class)
+    /// <summary>
+    /// Boxes stored one array per coordinate, the layout the batched culling
+    /// kernels read.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct bbox_soa
+    {
+        std::vector<float> min_x, min_y, min_z;
+        std::vector<float> max_x, max_y, max_z;
+
+        inline std::size_t size() const { return min_x.size(); }
+        inline bool        empty() const { return min_x.empty(); }
+
+        inline void resize(std::size_t n)
+        {
+            for (auto* v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+            {
+                v->resize(n, 0.0f);
+            }
+        }
+
+        inline void reserve(std::size_t n)
+        {
+            for (auto* v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+            {
+                v->reserve(n);
+            }
+        }
+
+        inline void clear() { resize(0); }
+
+        inline void set(std::size_t i, const bbox& b)
+        {
+            min_x[i] = b.min.x;
+            min_y[i] = b.min.y;
+            min_z[i] = b.min.z;
+            max_x[i] = b.max.x;
+            max_y[i] = b.max.y;
+            max_z[i] = b.max.z;
+        }
+
+        inline void push_back(const bbox& b)
+        {
+            resize(size() + 1);
+            set(size() - 1, b);
+        }
+
+        inline bbox get(std::size_t i) const { return bbox(min_x[i], min_y[i], min_z[i], max_x[i], max_y[i], max_z[i]); }
+
+        /// The six arrays in the order the kernels take them.
+        inline void get_arrays(const float* out[6]) const
+        {
+            out[0] = min_x.data();
+            out[1] = min_y.data();
+            out[2] = min_z.data();
+            out[3] = max_x.data();
+            out[4] = max_y.data();
+            out[5] = max_z.data();
+        }
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : bsphere_soa (Class)
+    /// <summary>
+    /// Spheres stored one array per component, see bbox_soa.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct bsphere_soa
+    {
+        std::vector<float> x, y, z, radius;
+
+        inline std::size_t size() const { return x.size(); }
+        inline bool        empty() const { return x.empty(); }
+
+        inline void resize(std::size_t n)
+        {
+            for (auto* v : {&x, &y, &z, &radius})
+            {
+                v->resize(n, 0.0f);
+            }
+        }
+
+        inline void clear() { resize(0); }
+
+        inline void set(std::size_t i, const bsphere& s)
+        {
+            x[i]      = s.position.x;
+            y[i]      = s.position.y;
+            z[i]      = s.position.z;
+            radius[i] = s.radius;
+        }
+
+        inline void push_back(const bsphere& s)
+        {
+            resize(size() + 1);
+            set(size() - 1, s);
+        }
+
+        /// The four arrays in the order the kernels take them.
+        inline void get_arrays(const float* out[4]) const
+        {
+            out[0] = x.data();
+            out[1] = y.data();
+            out[2] = z.data();
+            out[3] = radius.data();
+        }
+    };
+} // namespace math
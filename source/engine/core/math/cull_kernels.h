@@ -0,0 +1,322 @@
+#pragma once
+//-----------------------------------------------------------------------------
+// cull_kernels Header Includes
+//-----------------------------------------------------------------------------
+#include "transform_kernels.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// 8 wide versions on top of the SSE ones when the compiler targets AVX.
+#if defined(MATH_KERNELS_SSE) && defined(__AVX__)
+#define MATH_KERNELS_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace math
+{
+    namespace kernels
+    {
+        //-----------------------------------------------------------------------------
+        // Culling kernels
+        //
+        // planes are 6 (a, b, c, d) planes facing out of the volume, as stored by
+        // math::frustum. Boxes come as 6 separate arrays {min_x, min_y, min_z,
+        // max_x, max_y, max_z} and spheres as 4 {x, y, z, radius}. Bit i of
+        // visible is set when element i is not fully outside one of the planes,
+        // visible must hold (count + 31) / 32 words and is overwritten.
+        //-----------------------------------------------------------------------------
+        inline std::size_t cull_words(std::size_t count) { return (count + 31) / 32; }
+
+        namespace scalar
+        {
+            inline bool cull_aabb(const float* planes, const float* const* bounds, std::size_t i)
+            {
+                for (int p = 0; p < 6; ++p)
+                {
+                    const float* plane = planes + p * 4;
+
+                    // Distance of the corner furthest along the inside direction.
+                    const float d = plane[3] + std::min(plane[0] * bounds[0][i], plane[0] * bounds[3][i]) +
+                                    std::min(plane[1] * bounds[1][i], plane[1] * bounds[4][i]) +
+                                    std::min(plane[2] * bounds[2][i], plane[2] * bounds[5][i]);
+                    if (d > 0.0f)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            inline bool cull_sphere(const float* planes, const float* const* spheres, std::size_t i)
+            {
+                for (int p = 0; p < 6; ++p)
+                {
+                    const float* plane = planes + p * 4;
+
+                    const float d = plane[0] * spheres[0][i] + plane[1] * spheres[1][i] + plane[2] * spheres[2][i] + plane[3];
+                    if (d > spheres[3][i])
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /// Fills the bits of [first, count) one element at a time.
+            template<typename Test>
+            inline void cull_tail(std::size_t first, std::size_t count, std::uint32_t* visible, Test&& test)
+            {
+                for (std::size_t i = first; i < count; ++i)
+                {
+                    if (test(i))
+                    {
+                        visible[i >> 5] |= 1u << (i & 31);
+                    }
+                }
+            }
+
+            inline void cull_aabbs(const float* planes, const float* const* bounds, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+                cull_tail(0, count, visible, [planes, bounds](std::size_t i) { return cull_aabb(planes, bounds, i); });
+            }
+
+            inline void cull_spheres(const float* planes, const float* const* spheres, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+                cull_tail(0, count, visible, [planes, spheres](std::size_t i) { return cull_sphere(planes, spheres, i); });
+            }
+        } // namespace scalar
+
+#if defined(MATH_KERNELS_SSE)
+        namespace sse
+        {
+            inline void cull_aabbs(const float* planes, const float* const* bounds, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const __m128 zero = _mm_setzero_ps();
+                const auto   end  = count & ~std::size_t(3);
+                for (std::size_t i = 0; i < end; i += 4)
+                {
+                    const __m128 min_x = _mm_loadu_ps(bounds[0] + i);
+                    const __m128 min_y = _mm_loadu_ps(bounds[1] + i);
+                    const __m128 min_z = _mm_loadu_ps(bounds[2] + i);
+                    const __m128 max_x = _mm_loadu_ps(bounds[3] + i);
+                    const __m128 max_y = _mm_loadu_ps(bounds[4] + i);
+                    const __m128 max_z = _mm_loadu_ps(bounds[5] + i);
+
+                    __m128 outside = zero;
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        const __m128 a = _mm_set1_ps(planes[p * 4 + 0]);
+                        const __m128 b = _mm_set1_ps(planes[p * 4 + 1]);
+                        const __m128 c = _mm_set1_ps(planes[p * 4 + 2]);
+
+                        __m128 d = _mm_set1_ps(planes[p * 4 + 3]);
+                        d        = _mm_add_ps(d, _mm_min_ps(_mm_mul_ps(a, min_x), _mm_mul_ps(a, max_x)));
+                        d        = _mm_add_ps(d, _mm_min_ps(_mm_mul_ps(b, min_y), _mm_mul_ps(b, max_y)));
+                        d        = _mm_add_ps(d, _mm_min_ps(_mm_mul_ps(c, min_z), _mm_mul_ps(c, max_z)));
+                        outside  = _mm_or_ps(outside, _mm_cmpgt_ps(d, zero));
+                    }
+
+                    const auto bits = std::uint32_t(~_mm_movemask_ps(outside) & 0xf);
+                    visible[i >> 5] |= bits << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, bounds](std::size_t i) { return scalar::cull_aabb(planes, bounds, i); });
+            }
+
+            inline void cull_spheres(const float* planes, const float* const* spheres, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const auto end = count & ~std::size_t(3);
+                for (std::size_t i = 0; i < end; i += 4)
+                {
+                    const __m128 x = _mm_loadu_ps(spheres[0] + i);
+                    const __m128 y = _mm_loadu_ps(spheres[1] + i);
+                    const __m128 z = _mm_loadu_ps(spheres[2] + i);
+                    const __m128 r = _mm_loadu_ps(spheres[3] + i);
+
+                    __m128 outside = _mm_setzero_ps();
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        __m128 d = _mm_set1_ps(planes[p * 4 + 3]);
+                        d        = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p * 4 + 0]), x));
+                        d        = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p * 4 + 1]), y));
+                        d        = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(planes[p * 4 + 2]), z));
+                        outside  = _mm_or_ps(outside, _mm_cmpgt_ps(d, r));
+                    }
+
+                    const auto bits = std::uint32_t(~_mm_movemask_ps(outside) & 0xf);
+                    visible[i >> 5] |= bits << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, spheres](std::size_t i) { return scalar::cull_sphere(planes, spheres, i); });
+            }
+        } // namespace sse
+#endif
+
+#if defined(MATH_KERNELS_AVX)
+        namespace avx
+        {
+            inline void cull_aabbs(const float* planes, const float* const* bounds, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const __m256 zero = _mm256_setzero_ps();
+                const auto   end  = count & ~std::size_t(7);
+                for (std::size_t i = 0; i < end; i += 8)
+                {
+                    const __m256 min_x = _mm256_loadu_ps(bounds[0] + i);
+                    const __m256 min_y = _mm256_loadu_ps(bounds[1] + i);
+                    const __m256 min_z = _mm256_loadu_ps(bounds[2] + i);
+                    const __m256 max_x = _mm256_loadu_ps(bounds[3] + i);
+                    const __m256 max_y = _mm256_loadu_ps(bounds[4] + i);
+                    const __m256 max_z = _mm256_loadu_ps(bounds[5] + i);
+
+                    __m256 outside = zero;
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        const __m256 a = _mm256_set1_ps(planes[p * 4 + 0]);
+                        const __m256 b = _mm256_set1_ps(planes[p * 4 + 1]);
+                        const __m256 c = _mm256_set1_ps(planes[p * 4 + 2]);
+
+                        __m256 d = _mm256_set1_ps(planes[p * 4 + 3]);
+                        d        = _mm256_add_ps(d, _mm256_min_ps(_mm256_mul_ps(a, min_x), _mm256_mul_ps(a, max_x)));
+                        d        = _mm256_add_ps(d, _mm256_min_ps(_mm256_mul_ps(b, min_y), _mm256_mul_ps(b, max_y)));
+                        d        = _mm256_add_ps(d, _mm256_min_ps(_mm256_mul_ps(c, min_z), _mm256_mul_ps(c, max_z)));
+                        outside  = _mm256_or_ps(outside, _mm256_cmp_ps(d, zero, _CMP_GT_OQ));
+                    }
+
+                    const auto bits = std::uint32_t(~_mm256_movemask_ps(outside) & 0xff);
+                    visible[i >> 5] |= bits << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, bounds](std::size_t i) { return scalar::cull_aabb(planes, bounds, i); });
+            }
+
+            inline void cull_spheres(const float* planes, const float* const* spheres, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const auto end = count & ~std::size_t(7);
+                for (std::size_t i = 0; i < end; i += 8)
+                {
+                    const __m256 x = _mm256_loadu_ps(spheres[0] + i);
+                    const __m256 y = _mm256_loadu_ps(spheres[1] + i);
+                    const __m256 z = _mm256_loadu_ps(spheres[2] + i);
+                    const __m256 r = _mm256_loadu_ps(spheres[3] + i);
+
+                    __m256 outside = _mm256_setzero_ps();
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        __m256 d = _mm256_set1_ps(planes[p * 4 + 3]);
+                        d        = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[p * 4 + 0]), x));
+                        d        = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[p * 4 + 1]), y));
+                        d        = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(planes[p * 4 + 2]), z));
+                        outside  = _mm256_or_ps(outside, _mm256_cmp_ps(d, r, _CMP_GT_OQ));
+                    }
+
+                    const auto bits = std::uint32_t(~_mm256_movemask_ps(outside) & 0xff);
+                    visible[i >> 5] |= bits << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, spheres](std::size_t i) { return scalar::cull_sphere(planes, spheres, i); });
+            }
+        } // namespace avx
+#endif
+
+#if defined(MATH_KERNELS_NEON)
+        namespace neon
+        {
+            inline std::uint32_t lane_bits(uint32x4_t outside)
+            {
+                return (vgetq_lane_u32(outside, 0) ? 0u : 1u) | (vgetq_lane_u32(outside, 1) ? 0u : 2u) | (vgetq_lane_u32(outside, 2) ? 0u : 4u) |
+                       (vgetq_lane_u32(outside, 3) ? 0u : 8u);
+            }
+
+            inline void cull_aabbs(const float* planes, const float* const* bounds, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const float32x4_t zero = vdupq_n_f32(0.0f);
+                const auto        end  = count & ~std::size_t(3);
+                for (std::size_t i = 0; i < end; i += 4)
+                {
+                    const float32x4_t min_x = vld1q_f32(bounds[0] + i);
+                    const float32x4_t min_y = vld1q_f32(bounds[1] + i);
+                    const float32x4_t min_z = vld1q_f32(bounds[2] + i);
+                    const float32x4_t max_x = vld1q_f32(bounds[3] + i);
+                    const float32x4_t max_y = vld1q_f32(bounds[4] + i);
+                    const float32x4_t max_z = vld1q_f32(bounds[5] + i);
+
+                    uint32x4_t outside = vdupq_n_u32(0);
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        const float a = planes[p * 4 + 0];
+                        const float b = planes[p * 4 + 1];
+                        const float c = planes[p * 4 + 2];
+
+                        float32x4_t d = vdupq_n_f32(planes[p * 4 + 3]);
+                        d             = vaddq_f32(d, vminq_f32(vmulq_n_f32(min_x, a), vmulq_n_f32(max_x, a)));
+                        d             = vaddq_f32(d, vminq_f32(vmulq_n_f32(min_y, b), vmulq_n_f32(max_y, b)));
+                        d             = vaddq_f32(d, vminq_f32(vmulq_n_f32(min_z, c), vmulq_n_f32(max_z, c)));
+                        outside       = vorrq_u32(outside, vcgtq_f32(d, zero));
+                    }
+
+                    visible[i >> 5] |= lane_bits(outside) << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, bounds](std::size_t i) { return scalar::cull_aabb(planes, bounds, i); });
+            }
+
+            inline void cull_spheres(const float* planes, const float* const* spheres, std::size_t count, std::uint32_t* visible)
+            {
+                std::fill(visible, visible + cull_words(count), 0u);
+
+                const auto end = count & ~std::size_t(3);
+                for (std::size_t i = 0; i < end; i += 4)
+                {
+                    const float32x4_t x = vld1q_f32(spheres[0] + i);
+                    const float32x4_t y = vld1q_f32(spheres[1] + i);
+                    const float32x4_t z = vld1q_f32(spheres[2] + i);
+                    const float32x4_t r = vld1q_f32(spheres[3] + i);
+
+                    uint32x4_t outside = vdupq_n_u32(0);
+                    for (int p = 0; p < 6; ++p)
+                    {
+                        float32x4_t d = vdupq_n_f32(planes[p * 4 + 3]);
+                        d             = vmlaq_n_f32(d, x, planes[p * 4 + 0]);
+                        d             = vmlaq_n_f32(d, y, planes[p * 4 + 1]);
+                        d             = vmlaq_n_f32(d, z, planes[p * 4 + 2]);
+                        outside       = vorrq_u32(outside, vcgtq_f32(d, r));
+                    }
+
+                    visible[i >> 5] |= lane_bits(outside) << (i & 31);
+                }
+
+                scalar::cull_tail(end, count, visible, [planes, spheres](std::size_t i) { return scalar::cull_sphere(planes, spheres, i); });
+            }
+        } // namespace neon
+#endif
+
+#if defined(MATH_KERNELS_AVX)
+        namespace cull_simd = avx;
+#else
+        namespace cull_simd = simd;
+#endif
+
+        inline void cull_aabbs(const float* planes, const float* const* bounds, std::size_t count, std::uint32_t* visible)
+        {
+            cull_simd::cull_aabbs(planes, bounds, count, visible);
+        }
+
+        inline void cull_spheres(const float* planes, const float* const* spheres, std::size_t count, std::uint32_t* visible)
+        {
+            cull_simd::cull_spheres(planes, spheres, count, visible);
+        }
+    } // namespace kernels
+} // namespace math
@@ -1,4 +1,5 @@
 #include "frustum.h"
+#include "cull_kernels.h"
 
 namespace math
 {
@@ -431,6 +432,60 @@ namespace math
         return frustum.classify_aabb(AABB, FrustumBits, LastOutside);
     }
 
+    //-----------------------------------------------------------------------------
+    //  Name : get_plane_data ()
+    /// <summary>
+    /// Copies the six planes out as packed (a, b, c, d) floats, the layout the
+    /// batched culling kernels take.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void frustum::get_plane_data(float out[24]) const
+    {
+        for (std::size_t i = 0; i < planes.size(); ++i)
+        {
+            out[i * 4 + 0] = planes[i].data.x;
+            out[i * 4 + 1] = planes[i].data.y;
+            out[i * 4 + 2] = planes[i].data.z;
+            out[i * 4 + 3] = planes[i].data.w;
+        }
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : test_aabbs ()
+    /// <summary>
+    /// Batched test_aabb, bit i of visible is set when box i is not outside.
+    /// visible is resized to hold one bit per box.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void frustum::test_aabbs(const bbox_soa& bounds, std::vector<std::uint32_t>& visible) const
+    {
+        float        plane_data[24];
+        const float* arrays[6];
+        get_plane_data(plane_data);
+        bounds.get_arrays(arrays);
+
+        visible.resize(kernels::cull_words(bounds.size()));
+        kernels::cull_aabbs(plane_data, arrays, bounds.size(), visible.data());
+    }
+
+    //-----------------------------------------------------------------------------
+    //  Name : test_spheres ()
+    /// <summary>
+    /// Batched test_sphere, bit i of visible is set when sphere i is not
+    /// outside. visible is resized to hold one bit per sphere.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void frustum::test_spheres(const bsphere_soa& spheres, std::vector<std::uint32_t>& visible) const
+    {
+        float        plane_data[24];
+        const float* arrays[4];
+        get_plane_data(plane_data);
+        spheres.get_arrays(arrays);
+
+        visible.resize(kernels::cull_words(spheres.size()));
+        kernels::cull_spheres(plane_data, arrays, spheres.size(), visible.data());
+    }
+
     //-----------------------------------------------------------------------------
     //  Name : testAABB ()
     /// <summary>
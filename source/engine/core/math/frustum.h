@@ -2,10 +2,13 @@
 
 #include "bbox.h"
 #include "bbox_extruded.h"
+#include "bbox_soa.h"
 #include "math_types.h"
 #include "plane.h"
 #include "transform.h"
 #include <array>
+#include <cstdint>
+#include <vector>
 
 namespace math
 {
@@ -42,6 +45,9 @@ namespace math
         volume_query classify_plane(const plane& plane) const;
         bool         test_point(const vec3& point) const;
         bool         test_aabb(const bbox& bounds) const;
+        void         test_aabbs(const bbox_soa& bounds, std::vector<std::uint32_t>& visible) const;
+        void         test_spheres(const bsphere_soa& spheres, std::vector<std::uint32_t>& visible) const;
+        void         get_plane_data(float out[24]) const;
 
         bool     test_extruded_aabb(const bbox_extruded& box) const;
         bool     test_sphere(const vec3& center, float radius) const;
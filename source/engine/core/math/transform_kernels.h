@@ -0,0 +1,401 @@
+#pragma once
+//-----------------------------------------------------------------------------
+// transform_kernels Header Includes
+//-----------------------------------------------------------------------------
+#include <cmath>
+#include <cstddef>
+
+// Pick the instruction set at compile time, MATH_KERNELS_SCALAR forces the
+// portable path.
+#if !defined(MATH_KERNELS_SCALAR)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATH_KERNELS_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MATH_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace math
+{
+    //-----------------------------------------------------------------------------
+    // Main function declarations
+    //-----------------------------------------------------------------------------
+    //-----------------------------------------------------------------------------
+    //  Name : kernels (Namespace)
+    /// <summary>
+    /// Hot loops of the transform math written against plain float arrays. All
+    /// matrices are 4x4, column major, laid out like glm's mat4. The scalar
+    /// versions are always available and are the reference for the SIMD ones.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    namespace kernels
+    {
+        namespace scalar
+        {
+            //-----------------------------------------------------------------------------
+            //  Name : compose_trs ()
+            /// <summary>
+            /// out = translate(t) * mat4_cast(q) * scale(s), q is (x, y, z, w).
+            /// </summary>
+            //-----------------------------------------------------------------------------
+            inline void compose_trs(const float* t, const float* q, const float* s, float* out)
+            {
+                const float x = q[0], y = q[1], z = q[2], w = q[3];
+
+                out[0]  = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+                out[1]  = (2.0f * (x * y + w * z)) * s[0];
+                out[2]  = (2.0f * (x * z - w * y)) * s[0];
+                out[3]  = 0.0f;
+                out[4]  = (2.0f * (x * y - w * z)) * s[1];
+                out[5]  = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+                out[6]  = (2.0f * (y * z + w * x)) * s[1];
+                out[7]  = 0.0f;
+                out[8]  = (2.0f * (x * z + w * y)) * s[2];
+                out[9]  = (2.0f * (y * z - w * x)) * s[2];
+                out[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+                out[11] = 0.0f;
+                out[12] = t[0];
+                out[13] = t[1];
+                out[14] = t[2];
+                out[15] = 1.0f;
+            }
+
+            //-----------------------------------------------------------------------------
+            //  Name : mul ()
+            /// <summary>
+            /// out = a * b. out may not alias a or b.
+            /// </summary>
+            //-----------------------------------------------------------------------------
+            inline void mul(const float* a, const float* b, float* out)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    for (int r = 0; r < 4; ++r)
+                    {
+                        out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] + a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+                    }
+                }
+            }
+
+            //-----------------------------------------------------------------------------
+            //  Name : affine_inverse ()
+            /// <summary>
+            /// Inverse of a matrix whose last row is (0, 0, 0, 1).
+            /// </summary>
+            //-----------------------------------------------------------------------------
+            inline void affine_inverse(const float* m, float* out)
+            {
+                const float* a = m;
+                const float* b = m + 4;
+                const float* c = m + 8;
+
+                // Rows of the inverse of the upper 3x3 are the cross products of its columns.
+                const float r0[3] = {b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0]};
+                const float r1[3] = {c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0]};
+                const float r2[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+
+                const float inv_det = 1.0f / (a[0] * r0[0] + a[1] * r0[1] + a[2] * r0[2]);
+                for (int i = 0; i < 3; ++i)
+                {
+                    out[i * 4 + 0] = r0[i] * inv_det;
+                    out[i * 4 + 1] = r1[i] * inv_det;
+                    out[i * 4 + 2] = r2[i] * inv_det;
+                    out[i * 4 + 3] = 0.0f;
+                }
+
+                const float* t = m + 12;
+                for (int r = 0; r < 3; ++r)
+                {
+                    out[12 + r] = -(out[r] * t[0] + out[4 + r] * t[1] + out[8 + r] * t[2]);
+                }
+                out[15] = 1.0f;
+            }
+
+            //-----------------------------------------------------------------------------
+            //  Name : transform_points ()
+            /// <summary>
+            /// Transforms count packed xyz points by the affine matrix m. in and
+            /// out may be the same.
+            /// </summary>
+            //-----------------------------------------------------------------------------
+            inline void transform_points(const float* m, const float* in, float* out, std::size_t count)
+            {
+                for (std::size_t i = 0; i < count; ++i, in += 3, out += 3)
+                {
+                    const float x = in[0], y = in[1], z = in[2];
+                    out[0]        = m[0] * x + m[4] * y + m[8] * z + m[12];
+                    out[1]        = m[1] * x + m[5] * y + m[9] * z + m[13];
+                    out[2]        = m[2] * x + m[6] * y + m[10] * z + m[14];
+                }
+            }
+
+            //-----------------------------------------------------------------------------
+            //  Name : transform_aabbs ()
+            /// <summary>
+            /// Bounds of count boxes after the affine matrix m. Every box is six
+            /// floats, min xyz then max xyz. in and out may be the same.
+            /// </summary>
+            //-----------------------------------------------------------------------------
+            inline void transform_aabbs(const float* m, const float* in, float* out, std::size_t count)
+            {
+                for (std::size_t i = 0; i < count; ++i, in += 6, out += 6)
+                {
+                    // Copied first so that in and out may be the same boxes.
+                    const float box[6] = {in[0], in[1], in[2], in[3], in[4], in[5]};
+                    for (int r = 0; r < 3; ++r)
+                    {
+                        float lo = m[12 + r];
+                        float hi = m[12 + r];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            const float a = m[c * 4 + r] * box[c];
+                            const float b = m[c * 4 + r] * box[3 + c];
+                            lo += a < b ? a : b;
+                            hi += a < b ? b : a;
+                        }
+                        out[r]     = lo;
+                        out[3 + r] = hi;
+                    }
+                }
+            }
+        } // namespace scalar
+
+#if defined(MATH_KERNELS_SSE)
+        namespace sse
+        {
+            inline void store3(float* p, __m128 v)
+            {
+                _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+                _mm_store_ss(p + 2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+            }
+
+            inline __m128 cross(__m128 a, __m128 b)
+            {
+                const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+                const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+                const __m128 c     = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+                return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+            }
+
+            inline void compose_trs(const float* t, const float* q, const float* s, float* out)
+            {
+                // Every rotation column is a unit axis plus 2 * (q.a * u + q.b * v)
+                // for a pair of swizzled, sign flipped copies of q.
+                const __m128 qv  = _mm_loadu_ps(q);
+                const __m128 two = _mm_set1_ps(2.0f);
+                const __m128 x   = _mm_shuffle_ps(qv, qv, _MM_SHUFFLE(0, 0, 0, 0));
+                const __m128 y   = _mm_shuffle_ps(qv, qv, _MM_SHUFFLE(1, 1, 1, 1));
+                const __m128 z   = _mm_shuffle_ps(qv, qv, _MM_SHUFFLE(2, 2, 2, 2));
+
+                // (-y, x, -w), (-z, w, x)
+                const __m128 c0u = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 3, 0, 1)), _mm_setr_ps(-1.0f, 1.0f, -1.0f, 0.0f));
+                const __m128 c0v = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 0, 3, 2)), _mm_setr_ps(-1.0f, 1.0f, 1.0f, 0.0f));
+                // (y, -x, w), (-w, -z, y)
+                const __m128 c1u = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 3, 0, 1)), _mm_setr_ps(1.0f, -1.0f, 1.0f, 0.0f));
+                const __m128 c1v = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 1, 2, 3)), _mm_setr_ps(-1.0f, -1.0f, 1.0f, 0.0f));
+                // (z, -w, -x), (w, z, -y)
+                const __m128 c2u = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 0, 3, 2)), _mm_setr_ps(1.0f, -1.0f, -1.0f, 0.0f));
+                const __m128 c2v = _mm_mul_ps(_mm_shuffle_ps(qv, qv, _MM_SHUFFLE(3, 1, 2, 3)), _mm_setr_ps(1.0f, 1.0f, -1.0f, 0.0f));
+
+                __m128 c0 = _mm_add_ps(_mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f), _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(y, c0u), _mm_mul_ps(z, c0v))));
+                __m128 c1 = _mm_add_ps(_mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f), _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, c1u), _mm_mul_ps(z, c1v))));
+                __m128 c2 = _mm_add_ps(_mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f), _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, c2u), _mm_mul_ps(y, c2v))));
+
+                _mm_storeu_ps(out, _mm_mul_ps(c0, _mm_set1_ps(s[0])));
+                _mm_storeu_ps(out + 4, _mm_mul_ps(c1, _mm_set1_ps(s[1])));
+                _mm_storeu_ps(out + 8, _mm_mul_ps(c2, _mm_set1_ps(s[2])));
+                _mm_storeu_ps(out + 12, _mm_setr_ps(t[0], t[1], t[2], 1.0f));
+            }
+
+            inline void mul(const float* a, const float* b, float* out)
+            {
+                const __m128 a0 = _mm_loadu_ps(a);
+                const __m128 a1 = _mm_loadu_ps(a + 4);
+                const __m128 a2 = _mm_loadu_ps(a + 8);
+                const __m128 a3 = _mm_loadu_ps(a + 12);
+                for (int c = 0; c < 4; ++c)
+                {
+                    const float* bc = b + c * 4;
+                    __m128       r  = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+                    r               = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+                    r               = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+                    r               = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+                    _mm_storeu_ps(out + c * 4, r);
+                }
+            }
+
+            inline void affine_inverse(const float* m, float* out)
+            {
+                const __m128 a = _mm_loadu_ps(m);
+                const __m128 b = _mm_loadu_ps(m + 4);
+                const __m128 c = _mm_loadu_ps(m + 8);
+
+                __m128 r0 = cross(b, c);
+                __m128 r1 = cross(c, a);
+                __m128 r2 = cross(a, b);
+
+                // det = dot(a, r0), summed across the lanes.
+                __m128 d = _mm_mul_ps(a, r0);
+                d        = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+                d        = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+                const __m128 inv_det = _mm_div_ps(_mm_set1_ps(1.0f), d);
+
+                r0        = _mm_mul_ps(r0, inv_det);
+                r1        = _mm_mul_ps(r1, inv_det);
+                r2        = _mm_mul_ps(r2, inv_det);
+                __m128 r3 = _mm_setzero_ps();
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+                const float* t  = m + 12;
+                __m128       c3 = _mm_mul_ps(r0, _mm_set1_ps(t[0]));
+                c3              = _mm_add_ps(c3, _mm_mul_ps(r1, _mm_set1_ps(t[1])));
+                c3              = _mm_add_ps(c3, _mm_mul_ps(r2, _mm_set1_ps(t[2])));
+                c3              = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), c3);
+
+                _mm_storeu_ps(out, r0);
+                _mm_storeu_ps(out + 4, r1);
+                _mm_storeu_ps(out + 8, r2);
+                _mm_storeu_ps(out + 12, c3);
+            }
+
+            inline void transform_points(const float* m, const float* in, float* out, std::size_t count)
+            {
+                const __m128 c0 = _mm_loadu_ps(m);
+                const __m128 c1 = _mm_loadu_ps(m + 4);
+                const __m128 c2 = _mm_loadu_ps(m + 8);
+                const __m128 c3 = _mm_loadu_ps(m + 12);
+                for (std::size_t i = 0; i < count; ++i, in += 3, out += 3)
+                {
+                    __m128 r = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(in[0])));
+                    r        = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[1])));
+                    r        = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[2])));
+                    store3(out, r);
+                }
+            }
+
+            inline void transform_aabbs(const float* m, const float* in, float* out, std::size_t count)
+            {
+                const __m128 c0 = _mm_loadu_ps(m);
+                const __m128 c1 = _mm_loadu_ps(m + 4);
+                const __m128 c2 = _mm_loadu_ps(m + 8);
+                const __m128 c3 = _mm_loadu_ps(m + 12);
+                for (std::size_t i = 0; i < count; ++i, in += 6, out += 6)
+                {
+                    const __m128 xa = _mm_mul_ps(c0, _mm_set1_ps(in[0]));
+                    const __m128 xb = _mm_mul_ps(c0, _mm_set1_ps(in[3]));
+                    const __m128 ya = _mm_mul_ps(c1, _mm_set1_ps(in[1]));
+                    const __m128 yb = _mm_mul_ps(c1, _mm_set1_ps(in[4]));
+                    const __m128 za = _mm_mul_ps(c2, _mm_set1_ps(in[2]));
+                    const __m128 zb = _mm_mul_ps(c2, _mm_set1_ps(in[5]));
+
+                    __m128 lo = _mm_add_ps(c3, _mm_add_ps(_mm_min_ps(xa, xb), _mm_add_ps(_mm_min_ps(ya, yb), _mm_min_ps(za, zb))));
+                    __m128 hi = _mm_add_ps(c3, _mm_add_ps(_mm_max_ps(xa, xb), _mm_add_ps(_mm_max_ps(ya, yb), _mm_max_ps(za, zb))));
+                    store3(out, lo);
+                    store3(out + 3, hi);
+                }
+            }
+        } // namespace sse
+#endif
+
+#if defined(MATH_KERNELS_NEON)
+        namespace neon
+        {
+            inline void store3(float* p, float32x4_t v)
+            {
+                vst1_f32(p, vget_low_f32(v));
+                p[2] = vgetq_lane_f32(v, 2);
+            }
+
+            inline void mul(const float* a, const float* b, float* out)
+            {
+                const float32x4_t a0 = vld1q_f32(a);
+                const float32x4_t a1 = vld1q_f32(a + 4);
+                const float32x4_t a2 = vld1q_f32(a + 8);
+                const float32x4_t a3 = vld1q_f32(a + 12);
+                for (int c = 0; c < 4; ++c)
+                {
+                    const float* bc = b + c * 4;
+                    float32x4_t  r  = vmulq_n_f32(a0, bc[0]);
+                    r               = vmlaq_n_f32(r, a1, bc[1]);
+                    r               = vmlaq_n_f32(r, a2, bc[2]);
+                    r               = vmlaq_n_f32(r, a3, bc[3]);
+                    vst1q_f32(out + c * 4, r);
+                }
+            }
+
+            // Mostly independent scalar products, the compiler already emits
+            // about the same code for these as hand written NEON would.
+            using scalar::affine_inverse;
+            using scalar::compose_trs;
+
+            inline void transform_points(const float* m, const float* in, float* out, std::size_t count)
+            {
+                const float32x4_t c0 = vld1q_f32(m);
+                const float32x4_t c1 = vld1q_f32(m + 4);
+                const float32x4_t c2 = vld1q_f32(m + 8);
+                const float32x4_t c3 = vld1q_f32(m + 12);
+                for (std::size_t i = 0; i < count; ++i, in += 3, out += 3)
+                {
+                    float32x4_t r = vmlaq_n_f32(c3, c0, in[0]);
+                    r             = vmlaq_n_f32(r, c1, in[1]);
+                    r             = vmlaq_n_f32(r, c2, in[2]);
+                    store3(out, r);
+                }
+            }
+
+            inline void transform_aabbs(const float* m, const float* in, float* out, std::size_t count)
+            {
+                const float32x4_t c0 = vld1q_f32(m);
+                const float32x4_t c1 = vld1q_f32(m + 4);
+                const float32x4_t c2 = vld1q_f32(m + 8);
+                const float32x4_t c3 = vld1q_f32(m + 12);
+                for (std::size_t i = 0; i < count; ++i, in += 6, out += 6)
+                {
+                    const float32x4_t xa = vmulq_n_f32(c0, in[0]);
+                    const float32x4_t xb = vmulq_n_f32(c0, in[3]);
+                    const float32x4_t ya = vmulq_n_f32(c1, in[1]);
+                    const float32x4_t yb = vmulq_n_f32(c1, in[4]);
+                    const float32x4_t za = vmulq_n_f32(c2, in[2]);
+                    const float32x4_t zb = vmulq_n_f32(c2, in[5]);
+
+                    float32x4_t lo = vaddq_f32(c3, vaddq_f32(vminq_f32(xa, xb), vaddq_f32(vminq_f32(ya, yb), vminq_f32(za, zb))));
+                    float32x4_t hi = vaddq_f32(c3, vaddq_f32(vmaxq_f32(xa, xb), vaddq_f32(vmaxq_f32(ya, yb), vmaxq_f32(za, zb))));
+                    store3(out, lo);
+                    store3(out + 3, hi);
+                }
+            }
+        } // namespace neon
+#endif
+
+#if defined(MATH_KERNELS_SSE)
+        namespace simd = sse;
+#elif defined(MATH_KERNELS_NEON)
+        namespace simd = neon;
+#else
+        namespace simd = scalar;
+#endif
+
+        inline void compose_trs(const float* t, const float* q, const float* s, float* out) { simd::compose_trs(t, q, s, out); }
+
+        inline void mul(const float* a, const float* b, float* out) { simd::mul(a, b, out); }
+
+        inline void affine_inverse(const float* m, float* out) { simd::affine_inverse(m, out); }
+
+        inline void transform_points(const float* m, const float* in, float* out, std::size_t count)
+        {
+            simd::transform_points(m, in, out, count);
+        }
+
+        inline void transform_aabbs(const float* m, const float* in, float* out, std::size_t count) { simd::transform_aabbs(m, in, out, count); }
+
+        //-----------------------------------------------------------------------------
+        //  Name : is_affine ()
+        /// <summary>
+        /// Whether the last row is (0, 0, 0, 1), ie. the affine kernels apply.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        inline bool is_affine(const float* m) { return m[3] == 0.0f && m[7] == 0.0f && m[11] == 0.0f && m[15] == 1.0f; }
+    } // namespace kernels
+} // namespace math
@@ -3,10 +3,37 @@
 // transform Header Includes
 //-----------------------------------------------------------------------------
 #include "glm_includes.h"
+#include "transform_kernels.h"
+
+#include <cstddef>
+#include <type_traits>
 
 namespace math
 {
     using namespace glm;
+
+    //-----------------------------------------------------------------------------
+    //  Name : inverse_matrix ()
+    /// <summary>
+    /// Inverse of m, through the affine kernel when m is a float affine matrix
+    /// and glm::inverse otherwise (eg. projections).
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    template<typename T, qualifier Q>
+    inline mat<4, 4, T, Q> inverse_matrix(const mat<4, 4, T, Q>& m)
+    {
+        if constexpr (std::is_same_v<T, float>)
+        {
+            if (kernels::is_affine(&m[0][0]))
+            {
+                mat<4, 4, T, Q> result;
+                kernels::affine_inverse(&m[0][0], &result[0][0]);
+                return result;
+            }
+        }
+
+        return glm::inverse(m);
+    }
     //-----------------------------------------------------------------------------
     // Main class declarations
     //-----------------------------------------------------------------------------
@@ -77,6 +104,14 @@ namespace math
         vec3_t transform_normal(const vec3_t& v) const;
         vec3_t inverse_transform_normal(const vec3_t& v) const;
 
+        //-----------------------------------------------------------------------------
+        //  Name : transform_coords ()
+        /// <summary>
+        /// transform_coord over count points at once.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void transform_coords(const vec3_t* in, vec3_t* out, std::size_t count) const;
+
         static vec3_t transform_coord(const vec3_t& v, const transform_t& t);
         static vec3_t inverse_transform_coord(const vec3_t& v, const transform_t& t);
         static vec3_t transform_normal(const vec3_t& v, const transform_t& t);
@@ -123,11 +158,19 @@ namespace math
         {
             if (dirty_)
             {
-                auto translation = glm::translate(position_);
-                auto rotation    = glm::mat4_cast(rotation_);
-                auto scale       = glm::scale(scale_);
-
-                matrix_ = translation * rotation * scale;
+                if constexpr (std::is_same_v<T, float>)
+                {
+                    const T rotation[4] = {rotation_.x, rotation_.y, rotation_.z, rotation_.w};
+                    kernels::compose_trs(&position_[0], rotation, &scale_[0], &matrix_[0][0]);
+                }
+                else
+                {
+                    auto translation = glm::translate(position_);
+                    auto rotation    = glm::mat4_cast(rotation_);
+                    auto scale       = glm::scale(scale_);
+
+                    matrix_ = translation * rotation * scale;
+                }
 
                 dirty_ = false;
             }
@@ -150,7 +193,7 @@ namespace math
     transform_t<T, Q> inverse(transform_t<T, Q> const& t)
     {
         const auto& m = t.get_matrix();
-        return glm::inverse(m);
+        return inverse_matrix(m);
     }
 
     template<typename T, qualifier Q>
@@ -388,6 +431,25 @@ namespace math
         return inverse_transform_normal(v, *this);
     }
 
+    template<typename T, qualifier Q>
+    inline void transform_t<T, Q>::transform_coords(const vec3_t* in, vec3_t* out, std::size_t count) const
+    {
+        const mat4_t& m = get_matrix();
+        if constexpr (std::is_same_v<T, float> && sizeof(vec3_t) == sizeof(T) * 3)
+        {
+            if (kernels::is_affine(&m[0][0]))
+            {
+                kernels::transform_points(&m[0][0], reinterpret_cast<const T*>(in), reinterpret_cast<T*>(out), count);
+                return;
+            }
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = transform_coord(in[i], *this);
+        }
+    }
+
     template<typename T, qualifier Q>
     inline typename transform_t<T, Q>::vec3_t transform_t<T, Q>::transform_coord(const typename transform_t::vec3_t& v, const transform_t& t)
     {
@@ -401,7 +463,7 @@ namespace math
     inline typename transform_t<T, Q>::vec3_t transform_t<T, Q>::inverse_transform_coord(const typename transform_t::vec3_t& v, const transform_t& t)
     {
         const mat4_t& m      = t.get_matrix();
-        mat4_t        im     = glm::inverse(m);
+        mat4_t        im     = inverse_matrix(m);
         vec3_t        result = im * vec4_t {v, 1.0f};
         return result;
     }
@@ -419,7 +481,7 @@ namespace math
     inline typename transform_t<T, Q>::vec3_t transform_t<T, Q>::inverse_transform_normal(const typename transform_t::vec3_t& v, const transform_t& t)
     {
         const mat4_t& m      = t.get_matrix();
-        mat4_t        im     = glm::inverse(m);
+        mat4_t        im     = inverse_matrix(m);
         vec3_t        result = im * vec4_t {v, 0.0f};
         return result;
     }
@@ -434,8 +496,17 @@ namespace math
     template<typename T, qualifier Q>
     inline transform_t<T, Q> transform_t<T, Q>::operator*(const transform_t& t) const
     {
-        transform_t result(get_matrix() * t.get_matrix());
-        return result;
+        if constexpr (std::is_same_v<T, float>)
+        {
+            mat4_t m;
+            kernels::mul(&get_matrix()[0][0], &t.get_matrix()[0][0], &m[0][0]);
+            return transform_t(m);
+        }
+        else
+        {
+            transform_t result(get_matrix() * t.get_matrix());
+            return result;
+        }
     }
 
     template<typename T, qualifier Q>
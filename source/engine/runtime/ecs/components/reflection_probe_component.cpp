@@ -25,16 +25,31 @@ int reflection_probe_component::compute_projected_sphere_rect(irect32_t&
     }
 }
 
+namespace
+{
+    gfx::texture_format get_cubemap_format()
+    {
+        static auto buffer_format =
+            gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER | BGFX_CAPS_FORMAT_TEXTURE_CUBE | BGFX_CAPS_FORMAT_TEXTURE_MIP_AUTOGEN,
+                                 gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha);
+        return buffer_format;
+    }
+
+    constexpr std::uint16_t cubemap_size = 256;
+} // namespace
+
 std::shared_ptr<gfx::texture> reflection_probe_component::get_cubemap()
 {
-    static auto buffer_format =
-        gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER | BGFX_CAPS_FORMAT_TEXTURE_CUBE | BGFX_CAPS_FORMAT_TEXTURE_MIP_AUTOGEN,
-                             gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha);
+    static auto flags = gfx::get_default_rt_sampler_flags() | BGFX_TEXTURE_BLIT_DST;
+
+    return render_view_[0].get_texture("CUBEMAP", cubemap_size, true, 1, get_cubemap_format(), flags);
+}
 
+std::shared_ptr<gfx::texture> reflection_probe_component::get_staging_cubemap()
+{
     static auto flags = gfx::get_default_rt_sampler_flags() | BGFX_TEXTURE_BLIT_DST;
 
-    std::uint16_t size = 256;
-    return render_view_[0].get_texture("CUBEMAP", size, true, 1, buffer_format, flags);
+    return render_view_[0].get_texture("CUBEMAP_STAGING", cubemap_size, false, 1, get_cubemap_format(), flags);
 }
 
 std::shared_ptr<gfx::frame_buffer> reflection_probe_component::get_cubemap_fbo() { return render_view_[0].get_fbo("CUBEMAP", {get_cubemap()}); }
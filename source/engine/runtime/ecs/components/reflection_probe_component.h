@@ -91,6 +91,15 @@ public:
     //-----------------------------------------------------------------------------
     std::shared_ptr<gfx::frame_buffer> get_cubemap_fbo();
 
+    //-----------------------------------------------------------------------------
+    //  Name : get_staging_cubemap ()
+    /// <summary>
+    /// Cubemap without mips the faces of a running update are rendered into,
+    /// copied to the cubemap once complete. Kept while someone holds it.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::shared_ptr<gfx::texture> get_staging_cubemap();
+
     void update();
 
 private:
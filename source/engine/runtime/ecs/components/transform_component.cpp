@@ -3,9 +3,26 @@
 #include <core/logging/logging.h>
 
 #include <algorithm>
+#include <atomic>
+
+namespace runtime
+{
+    hpp::event<void(entity)> on_parent_changed;
+}
+
+namespace
+{
+    std::atomic<std::uint64_t> hierarchy_version {0};
+}
+
+std::uint64_t transform_component::get_hierarchy_version() { return hierarchy_version.load(std::memory_order_acquire); }
+
+void transform_component::hierarchy_changed() { hierarchy_version.fetch_add(1, std::memory_order_acq_rel); }
 
 void transform_component::on_entity_set()
 {
+    hierarchy_changed();
+
     for (auto& child : children_)
     {
         if (child.valid())
@@ -14,6 +31,7 @@ void transform_component::on_entity_set()
             if (child_transform)
             {
                 child_transform->parent_ = get_entity();
+                runtime::on_parent_changed(child);
             }
         }
     }
@@ -116,6 +134,8 @@ const math::transform& transform_component::get_transform()
     return world_transform_;
 }
 
+const math::transform& transform_component::get_transform() const { return world_transform_; }
+
 const math::transform& transform_component::get_local_transform() const
 {
     // Return reference to our internal matrix
@@ -310,7 +330,10 @@ void transform_component::set_parent(runtime::entity parent, bool world_position
             set_local_transform(math::transform::identity());
     }
 
-    set_dirty(is_dirty());
+    // The world transform depends on the new parent even if the local one stayed.
+    set_dirty(true);
+
+    runtime::on_parent_changed(get_entity());
 }
 
 const runtime::entity& transform_component::get_parent() const { return parent_; }
@@ -318,6 +341,7 @@ const runtime::entity& transform_component::get_parent() const { return parent_;
 void transform_component::attach_child(const runtime::entity& child)
 {
     children_.push_back(child);
+    hierarchy_changed();
 
     set_dirty(is_dirty());
 }
@@ -326,12 +350,14 @@ void transform_component::remove_child(const runtime::entity& child)
 {
     children_.erase(std::remove_if(std::begin(children_), std::end(children_), [&child](const auto& other) { return child == other; }),
                     std::end(children_));
+    hierarchy_changed();
 }
 
 void transform_component::cleanup_dead_children()
 {
     children_.erase(std::remove_if(std::begin(children_), std::end(children_), [](const auto& other) { return other.valid() == false; }),
                     std::end(children_));
+    hierarchy_changed();
 }
 
 void transform_component::set_transform(const math::transform& tr)
@@ -413,6 +439,20 @@ void transform_component::resolve(bool force)
     }
 }
 
+void transform_component::resolve_from(const math::transform* parent_world)
+{
+    if (parent_world)
+    {
+        world_transform_ = *parent_world * local_transform_;
+    }
+    else
+    {
+        world_transform_ = local_transform_;
+    }
+
+    dirty_ = false;
+}
+
 bool transform_component::is_dirty() const { return dirty_; }
 
 void transform_component::set_dirty(bool dirty)
@@ -427,8 +467,10 @@ void transform_component::set_dirty(bool dirty)
         {
             if (child.valid())
             {
+                // A dirty node always has a dirty subtree, since resolving
+                // goes through the parents first.
                 auto child_transform = child.get_component<transform_component>().lock();
-                if (child_transform)
+                if (child_transform && !child_transform->is_dirty())
                 {
                     child_transform->set_dirty(dirty);
                 }
@@ -4,6 +4,12 @@
 
 #include <core/math/math_includes.h>
 
+namespace runtime
+{
+    /// Fired with the entity whose transform got a different parent.
+    extern hpp::event<void(entity)> on_parent_changed;
+} // namespace runtime
+
 //-----------------------------------------------------------------------------
 // Main Class Declarations
 //-----------------------------------------------------------------------------
@@ -57,6 +63,24 @@ public:
     //-----------------------------------------------------------------------------
     void resolve(bool force = false);
 
+    //-----------------------------------------------------------------------------
+    //  Name : resolve_from ()
+    /// <summary>
+    /// Resolves against the already resolved world transform of the parent,
+    /// nullptr for a root. Does not look at the parent entity, used by the
+    /// batched pass of the transform_system.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void resolve_from(const math::transform* parent_world);
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_hierarchy_version (static )
+    /// <summary>
+    /// Bumped whenever any parent / child link changes.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    static std::uint64_t get_hierarchy_version();
+
     //-----------------------------------------------------------------------------
     //  Name : is_dirty (virtual )
     /// <summary>
@@ -97,6 +121,15 @@ public:
     //-----------------------------------------------------------------------------
     const math::transform& get_transform();
 
+    //-----------------------------------------------------------------------------
+    //  Name : get_transform ()
+    /// <summary>
+    /// Returns the cached world transform without resolving it. Meant for read
+    /// only access after resolve() has run, e.g. from parallel queries.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    const math::transform& get_transform() const;
+
     //-----------------------------------------------------------------------------
     //  Name : get_position ()
     /// <summary>
@@ -535,6 +568,7 @@ public:
 protected:
     void apply_transform(math::transform& trans);
     void apply_local_transform(const math::transform& trans);
+    static void hierarchy_changed();
 
     //-------------------------------------------------------------------------
     // Protected Member Variables
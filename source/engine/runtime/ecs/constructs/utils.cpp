@@ -4,11 +4,36 @@
 #include <core/serialization/associative_archive.h>
 #include <core/serialization/binary_archive.h>
 #include <core/serialization/serialization.h>
+#include <core/system/subsystem.h>
+
+#include <sstream>
 
 namespace ecs
 {
     namespace utils
     {
+        /// Loads the same data as a std::vector<runtime::entity>, but reads the
+        /// count up front to size the ecs once for the whole batch.
+        struct entity_batch
+        {
+            std::vector<runtime::entity>& entities;
+        };
+
+        template<typename Archive>
+        static void load(Archive& ar, entity_batch& batch)
+        {
+            cereal::size_type size = 0;
+            ar(cereal::make_size_tag(size));
+
+            auto& ecs = core::get_subsystem<runtime::entity_component_system>();
+            ecs.reserve(ecs.size() + static_cast<std::size_t>(size));
+
+            batch.entities.resize(static_cast<std::size_t>(size));
+            for (auto& entity : batch.entities)
+            {
+                ar(entity);
+            }
+        }
 
         template<typename OArchive>
         static void serialize_t(std::ostream& stream, const std::vector<runtime::entity>& data)
@@ -30,9 +55,10 @@ namespace ecs
             stream.seekg(0, stream.beg);
             if (length > 0)
             {
-                IArchive ar(stream);
+                IArchive     ar(stream);
+                entity_batch batch {out_data};
 
-                try_load(ar, cereal::make_nvp("data", out_data));
+                try_load(ar, cereal::make_nvp("data", batch));
 
                 stream.clear();
                 stream.seekg(0);
@@ -87,5 +113,70 @@ namespace ecs
         {
             return deserialize_t<cereal::iarchive_associative_t>(stream, out_data);
         }
+
+        world_snapshot take_snapshot()
+        {
+            auto& ecs = core::get_subsystem<runtime::entity_component_system>();
+
+            world_snapshot snapshot;
+            snapshot.layout = ecs.save_layout();
+
+            // With every live entity already known, references between them are
+            // written as bare ids.
+            std::vector<runtime::entity> entities;
+            auto&                        serialization_map = runtime::get_serialization_map();
+            serialization_map.clear();
+            for (auto e : ecs.all_entities())
+            {
+                entities.push_back(e);
+                serialization_map[e.id().id()] = e;
+            }
+
+            std::ostringstream stream;
+            {
+                cereal::oarchive_binary_t ar(stream);
+                for (const auto& e : entities)
+                {
+                    try_save(ar, cereal::make_nvp("components", e.all_components()));
+                }
+            }
+            serialization_map.clear();
+
+            snapshot.components = stream.str();
+            return snapshot;
+        }
+
+        void restore_snapshot(const world_snapshot& snapshot)
+        {
+            auto& ecs      = core::get_subsystem<runtime::entity_component_system>();
+            auto  entities = ecs.restore_layout(snapshot.layout);
+
+            auto& serialization_map = runtime::get_serialization_map();
+            serialization_map.clear();
+            for (const auto& e : entities)
+            {
+                serialization_map[e.id().id()] = e;
+            }
+
+            std::istringstream stream(snapshot.components);
+            {
+                cereal::iarchive_binary_t ar(stream);
+                for (auto& e : entities)
+                {
+                    std::vector<runtime::chandle<runtime::component>> components;
+                    try_load(ar, cereal::make_nvp("components", components));
+                    for (const auto& component : components)
+                    {
+                        auto component_shared = component.lock();
+                        if (component_shared)
+                        {
+                            e.assign(component_shared);
+                            component_shared->touch();
+                        }
+                    }
+                }
+            }
+            serialization_map.clear();
+        }
     } // namespace utils
 } // namespace ecs
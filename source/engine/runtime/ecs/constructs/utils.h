@@ -5,6 +5,7 @@
 #include <core/filesystem/filesystem.h>
 
 #include <fstream>
+#include <string>
 #include <vector>
 
 namespace ecs
@@ -62,5 +63,29 @@ namespace ecs
         /// </summary>
         //-----------------------------------------------------------------------------
         bool deserialize_data(std::istream& stream, std::vector<runtime::entity>& out_data);
+
+        /// In memory copy of the whole world, see take_snapshot.
+        struct world_snapshot
+        {
+            runtime::entity_component_system::entity_layout layout;
+            /// Components of every live entity in slot order, binary archive.
+            std::string components;
+        };
+        //-----------------------------------------------------------------------------
+        //  Name : take_snapshot ()
+        /// <summary>
+        /// Captures every entity of the world with its id, name and components,
+        /// e.g. before entering play mode.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        world_snapshot take_snapshot();
+        //-----------------------------------------------------------------------------
+        //  Name : restore_snapshot ()
+        /// <summary>
+        /// Replaces the world with the snapshot. Entity ids come back as they were
+        /// so handles taken before the snapshot stay valid.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void restore_snapshot(const world_snapshot& snapshot);
     } // namespace utils
 } // namespace ecs
@@ -1,5 +1,8 @@
 #include "ecs.h"
 
+#include <core/system/subsystem.h>
+#include <core/tasks/task_system.h>
+
 namespace runtime
 {
 
@@ -25,6 +28,58 @@ namespace runtime
             }
             return 0;
         }
+
+        void parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t begin, std::size_t end)>& job)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+
+            grain             = std::max<std::size_t>(grain, 1);
+            const auto chunks = (count + grain - 1) / grain;
+            if (chunks == 1 || !core::has_subsystems<core::task_system>())
+            {
+                job(0, count);
+                return;
+            }
+
+            auto&                                ts = core::get_subsystem<core::task_system>();
+            std::vector<core::task_future<void>> futures;
+            futures.reserve(chunks - 1);
+            for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+            {
+                const auto begin = chunk * grain;
+                const auto end   = std::min(begin + grain, count);
+                futures.emplace_back(ts.push_on_worker_thread([&job, begin, end]() { job(begin, end); }));
+            }
+
+            // The jobs reference the caller's state, so join before anything can unwind.
+            std::exception_ptr error;
+            try
+            {
+                job(0, grain);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            for (auto& future : futures)
+            {
+                future.wait();
+            }
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+
+            for (auto& future : futures)
+            {
+                future.get();
+            }
+        }
     } // namespace ecs
 
     hpp::event<void(entity)>                     on_entity_created;
@@ -32,31 +87,373 @@ namespace runtime
     hpp::event<void(entity, chandle<component>)> on_component_added;
     hpp::event<void(entity, chandle<component>)> on_component_removed;
 
+    void change_journal::record(entity::id_t id, std::uint64_t frame, change_kind kind)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frame != frame_)
+        {
+            frame_ = frame;
+
+            // Entries are in frame order, drop the ones that fell out of the history.
+            auto first = std::find_if(entries_.begin(), entries_.end(), [frame](const entry& e) { return e.frame + history >= frame; });
+            base_ += std::uint64_t(std::distance(entries_.begin(), first));
+            entries_.erase(entries_.begin(), first);
+        }
+
+        entries_.push_back({id, frame, kind});
+    }
+
+    std::uint64_t change_journal::end() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return base_ + entries_.size();
+    }
+
+    name_table::name_table()
+    {
+        names_.emplace_back();
+        refs_.push_back(0);
+        ids_.emplace(names_.back(), none);
+    }
+
+    name_table::name_id name_table::intern(const std::string& name)
+    {
+        auto it = ids_.find(name);
+        if (it != ids_.end())
+        {
+            return it->second;
+        }
+
+        name_id id;
+        if (free_ids_.empty())
+        {
+            id = static_cast<name_id>(names_.size());
+            names_.push_back(name);
+            refs_.push_back(0);
+        }
+        else
+        {
+            id = free_ids_.back();
+            free_ids_.pop_back();
+            names_[id] = name;
+        }
+        ids_.emplace(names_[id], id);
+        return id;
+    }
+
+    void name_table::add_ref(name_id id)
+    {
+        if (id != none)
+        {
+            ++refs_[id];
+        }
+    }
+
+    void name_table::release(name_id id)
+    {
+        if (id == none || --refs_[id] > 0)
+        {
+            return;
+        }
+
+        ids_.erase(names_[id]);
+        names_[id].clear();
+        names_[id].shrink_to_fit();
+        free_ids_.push_back(id);
+    }
+
+    name_table::name_id name_table::find(std::string_view name) const
+    {
+        auto it = ids_.find(name);
+        return it != ids_.end() ? it->second : none;
+    }
+
+    command_buffer::pending_entity command_buffer::create()
+    {
+        const auto index = pending_++;
+        record([index](context& ctx) { ctx.entities[index] = ctx.ecs.create(); });
+        return {index};
+    }
+
+    command_buffer::pending_entity command_buffer::reference(entity e)
+    {
+        const auto index = pending_++;
+        record([index, e](context& ctx) { ctx.entities[index] = e; });
+        return {index};
+    }
+
+    void command_buffer::destroy(pending_entity e)
+    {
+        record([e](context& ctx) {
+            auto target = ctx.get(e);
+            if (target.valid())
+            {
+                target.destroy();
+            }
+        });
+    }
+
+    void command_buffer::clear()
+    {
+        commands_.clear();
+        pending_  = 0;
+        sort_key_ = 0;
+    }
+
+    component_arena::component_arena(std::size_t stride, std::size_t alignment, std::size_t chunk_capacity) :
+        stride_((stride + alignment - 1) / alignment * alignment), alignment_(alignment), chunk_capacity_(chunk_capacity)
+    {}
+
+    component_arena::~component_arena()
+    {
+        for (auto chunk : chunks_)
+        {
+            ::operator delete(chunk, std::align_val_t(alignment_));
+        }
+    }
+
+    void* component_arena::allocate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (free_.empty())
+        {
+            add_chunk();
+        }
+
+        auto ptr = free_.back();
+        free_.pop_back();
+        return ptr;
+    }
+
+    void component_arena::deallocate(void* ptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(ptr);
+    }
+
+    void component_arena::reserve(std::size_t n)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (free_.size() < n)
+        {
+            add_chunk();
+        }
+    }
+
+    void component_arena::add_chunk()
+    {
+        auto chunk = static_cast<std::uint8_t*>(::operator new(stride_ * chunk_capacity_, std::align_val_t(alignment_)));
+        chunks_.push_back(chunk);
+
+        // Hand out the new chunk front to back, after whatever is already free.
+        const auto offset = free_.size();
+        free_.resize(offset + chunk_capacity_);
+        for (std::size_t i = 0; i < chunk_capacity_; ++i)
+        {
+            free_[offset + chunk_capacity_ - 1 - i] = chunk + i * stride_;
+        }
+    }
+
     component_storage::component_storage(std::size_t size) { expand(size); }
 
-    void component_storage::expand(std::size_t n) { data.resize(n); }
+    void component_storage::expand(std::size_t n)
+    {
+        if (n > sparse_.size())
+        {
+            sparse_.resize(n, npos);
+        }
+    }
 
-    void component_storage::reserve(std::size_t n) { data.reserve(n); }
+    void component_storage::reserve(std::size_t n)
+    {
+        sparse_.reserve(n);
+        packed_entities_.reserve(n);
+        packed_components_.reserve(n);
+        packed_owners_.reserve(n);
+    }
 
     std::shared_ptr<component> component_storage::get(std::size_t n) const
     {
-        expects(n < size());
-        return data[n];
+        if (!contains(n))
+        {
+            return nullptr;
+        }
+        return packed_owners_[sparse_[n]];
     }
 
     void component_storage::destroy(std::size_t n)
     {
-        expects(n < size());
-        auto& element = data[n];
+        if (!contains(n))
+        {
+            return;
+        }
+
+        const auto packed = sparse_[n];
+
+        // Keep the component alive until the bookkeeping is done, its destructor
+        // may reenter the ecs (eg. a transform destroying its children).
+        auto element = std::move(packed_owners_[packed]);
+        sparse_[n]   = npos;
+
+        if (locks_ > 0)
+        {
+            packed_entities_[packed]   = npos;
+            packed_components_[packed] = nullptr;
+            ++holes_;
+
+            // Whoever iterates may still hold a reference to it.
+            retired_.push_back(std::move(element));
+            return;
+        }
+        else
+        {
+            const auto last = packed_entities_.size() - 1;
+            if (packed != last)
+            {
+                packed_entities_[packed]          = packed_entities_[last];
+                packed_components_[packed]        = packed_components_[last];
+                packed_owners_[packed]            = std::move(packed_owners_[last]);
+                sparse_[packed_entities_[packed]] = packed;
+            }
+            packed_entities_.pop_back();
+            packed_components_.pop_back();
+            packed_owners_.pop_back();
+        }
+
         element.reset();
     }
 
     std::weak_ptr<component> component_storage::set(unsigned int index, const std::shared_ptr<component>& component)
     {
-        data[index] = component;
+        expand(std::size_t(index) + 1);
+
+        auto packed = sparse_[index];
+        if (packed == npos)
+        {
+            packed         = static_cast<std::uint32_t>(packed_entities_.size());
+            sparse_[index] = packed;
+            packed_entities_.push_back(index);
+            packed_components_.push_back(component.get());
+            packed_owners_.push_back(component);
+        }
+        else
+        {
+            // Replacing releases the previous component last, see destroy().
+            auto previous              = std::move(packed_owners_[packed]);
+            packed_components_[packed] = component.get();
+            packed_owners_[packed]     = component;
+
+            // Whoever iterates may still hold a reference to it.
+            if (locks_ > 0)
+            {
+                retired_.push_back(std::move(previous));
+            }
+        }
         return component;
     }
 
+    void component_storage::unlock()
+    {
+        expects(locks_ > 0);
+        if (--locks_ > 0)
+        {
+            return;
+        }
+
+        if (holes_ > 0)
+        {
+            compact();
+        }
+
+        // Released last, their destructors may reenter the ecs.
+        auto retired = std::move(retired_);
+        retired_.clear();
+    }
+
+    void component_storage::compact()
+    {
+        std::size_t write = 0;
+        for (std::size_t read = 0; read < packed_entities_.size(); ++read)
+        {
+            const auto index = packed_entities_[read];
+            if (index == npos)
+            {
+                continue;
+            }
+
+            if (write != read)
+            {
+                packed_entities_[write]   = index;
+                packed_components_[write] = packed_components_[read];
+                packed_owners_[write]     = std::move(packed_owners_[read]);
+                sparse_[index]            = static_cast<std::uint32_t>(write);
+            }
+            ++write;
+        }
+
+        packed_entities_.resize(write);
+        packed_components_.resize(write);
+        packed_owners_.resize(write);
+        holes_ = 0;
+    }
+
+    void entity_component_system::query_group::insert(std::uint32_t index)
+    {
+        if (contains(index))
+        {
+            return;
+        }
+
+        if (sparse_.size() <= index)
+        {
+            sparse_.resize(std::size_t(index) + 1, npos);
+        }
+
+        sparse_[index] = static_cast<std::uint32_t>(entities_.size());
+        entities_.push_back(index);
+    }
+
+    void entity_component_system::query_group::erase(std::uint32_t index)
+    {
+        if (!contains(index))
+        {
+            return;
+        }
+
+        const auto packed = sparse_[index];
+        sparse_[index]    = npos;
+
+        if (locks_ > 0)
+        {
+            entities_[packed] = npos;
+            ++holes_;
+            return;
+        }
+
+        const auto last = entities_.back();
+        if (last != index)
+        {
+            entities_[packed] = last;
+            sparse_[last]     = packed;
+        }
+        entities_.pop_back();
+    }
+
+    void entity_component_system::query_group::unlock()
+    {
+        expects(locks_ > 0);
+        if (--locks_ == 0 && holes_ > 0)
+        {
+            auto it = std::remove(entities_.begin(), entities_.end(), npos);
+            entities_.erase(it, entities_.end());
+            for (std::size_t i = 0; i < entities_.size(); ++i)
+            {
+                sparse_[entities_[i]] = static_cast<std::uint32_t>(i);
+            }
+            holes_ = 0;
+        }
+    }
+
     /////////////////////////////////////////////////////////////////////////////
     const entity::id_t entity::INVALID;
 
@@ -118,22 +515,268 @@ namespace runtime
         return entity;
     }
 
-    void entity_component_system::set_entity_name(entity::id_t id, const std::string& name) { entity_names_[id.id()] = name; }
+    std::vector<entity> entity_component_system::create_many(std::size_t n)
+    {
+        std::vector<entity> result;
+        result.reserve(n);
+
+        // Reuse the free slots first, then append the rest in one go.
+        const auto reused = std::min(n, free_list_.size());
+        for (std::size_t i = 0; i < reused; ++i)
+        {
+            const auto index = free_list_.back();
+            free_list_.pop_back();
+            result.emplace_back(this, entity::id_t(index, entity_version_[index]));
+        }
+
+        const auto added = static_cast<std::uint32_t>(n - reused);
+        if (added > 0)
+        {
+            const auto first = index_counter_;
+            index_counter_ += added;
+            accomodate_entity(index_counter_ - 1);
+            for (auto index = first; index < index_counter_; ++index)
+            {
+                entity_version_[index] = 1;
+                result.emplace_back(this, entity::id_t(index, 1));
+            }
+        }
+
+        for (const auto& entity : result)
+        {
+            on_entity_created(entity);
+        }
+        return result;
+    }
+
+    void entity_component_system::destroy_many(std::span<const entity> entities)
+    {
+        // In slot order, so the freed slots can be appended in one go.
+        std::vector<entity::id_t> ids;
+        ids.reserve(entities.size());
+        for (const auto& entity : entities)
+        {
+            if (entity.valid())
+            {
+                ids.push_back(entity.id());
+            }
+        }
+        std::sort(ids.begin(), ids.end(), [](const entity::id_t& lhs, const entity::id_t& rhs) { return lhs.index() < rhs.index(); });
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        component_mask_t families;
+        for (const auto& id : ids)
+        {
+            unlink_name(id.index());
+            families |= entity_component_mask_[id.index()];
+        }
+
+        // Family by family, with the pool locked so that the removals leave
+        // holes compacted once and the components are released together.
+        // Their destructors may destroy entities of the batch, eg. children
+        // with their parent, so each entity is checked again.
+        for (std::size_t family = 0; family < component_pools_.size(); ++family)
+        {
+            auto pool = component_pools_[family].get();
+            if (!families.test(family) || pool == nullptr)
+            {
+                continue;
+            }
+
+            pool->lock();
+            for (const auto& id : ids)
+            {
+                if (valid(id) && entity_component_mask_[id.index()].test(family))
+                {
+                    remove(id, static_cast<rtti::type_index_sequential_t::index_t>(family));
+                }
+            }
+            pool->unlock();
+        }
+
+        std::vector<std::uint32_t> freed;
+        freed.reserve(ids.size());
+        for (const auto& id : ids)
+        {
+            if (!valid(id))
+            {
+                continue;
+            }
+
+            const auto index = id.index();
+            on_entity_destroyed(get(id));
+            entity_component_mask_[index].reset();
+            entity_version_[index]++;
+            freed.push_back(index);
+        }
+
+        if (freed.empty())
+        {
+            return;
+        }
+
+        if (!free_list_.empty() && free_list_.back() > freed.front())
+        {
+            free_list_sorted_ = false;
+        }
+        free_list_.insert(free_list_.end(), freed.begin(), freed.end());
+    }
+
+    void entity_component_system::set_entity_name(entity::id_t id, const std::string& name)
+    {
+        assert_valid(id);
+        const auto index   = id.index();
+        const auto name_id = names_.intern(name);
+        if (entity_name_ids_[index] == name_id)
+        {
+            return;
+        }
+
+        unlink_name(index);
+        entity_name_ids_[index] = name_id;
+        if (name_id != name_table::none)
+        {
+            if (name_index_.size() <= name_id)
+            {
+                name_index_.resize(name_id + 1);
+            }
+
+            auto& slots               = name_index_[name_id];
+            entity_name_slots_[index] = static_cast<std::uint32_t>(slots.size());
+            slots.push_back(index);
+            names_.add_ref(name_id);
+        }
+    }
+
+    const std::string& entity_component_system::get_entity_name(entity::id_t id) const
+    {
+        assert_valid(id);
+        return names_.get(entity_name_ids_[id.index()]);
+    }
+
+    entity_component_system::entity_layout entity_component_system::save_layout() const
+    {
+        entity_layout layout;
+        layout.versions  = entity_version_;
+        layout.free_list = free_list_;
+        layout.names.reserve(entity_name_ids_.size());
+        for (auto name_id : entity_name_ids_)
+        {
+            layout.names.emplace_back(names_.get(name_id));
+        }
+        return layout;
+    }
+
+    std::vector<entity> entity_component_system::restore_layout(const entity_layout& layout)
+    {
+        dispose();
+
+        const auto count = static_cast<std::uint32_t>(layout.versions.size());
+        if (count > 0)
+        {
+            index_counter_ = count;
+            accomodate_entity(count - 1);
+        }
+
+        entity_version_   = layout.versions;
+        free_list_        = layout.free_list;
+        free_list_sorted_ = std::is_sorted(free_list_.begin(), free_list_.end());
+
+        std::vector<bool> free(count, false);
+        for (auto index : free_list_)
+        {
+            free[index] = true;
+        }
+
+        std::vector<entity> result;
+        result.reserve(count - free_list_.size());
+        for (std::uint32_t index = 0; index < count; ++index)
+        {
+            if (!free[index])
+            {
+                result.emplace_back(this, entity::id_t(index, entity_version_[index]));
+                if (index < layout.names.size())
+                {
+                    set_entity_name(result.back().id(), layout.names[index]);
+                }
+            }
+        }
+
+        for (const auto& entity : result)
+        {
+            on_entity_created(entity);
+        }
+        return result;
+    }
+
+    entity entity_component_system::find_by_name(const std::string& name)
+    {
+        const auto name_id = names_.find(name);
+        if (name_id == name_table::none || name_id >= name_index_.size() || name_index_[name_id].empty())
+        {
+            return {};
+        }
+
+        return get(create_id(name_index_[name_id].front()));
+    }
+
+    std::vector<entity> entity_component_system::find_all_by_name(const std::string& name)
+    {
+        std::vector<entity> result;
+        const auto          name_id = names_.find(name);
+        if (name_id == name_table::none || name_id >= name_index_.size())
+        {
+            return result;
+        }
+
+        const auto& slots = name_index_[name_id];
+        result.reserve(slots.size());
+        for (auto index : slots)
+        {
+            result.emplace_back(get(create_id(index)));
+        }
+        return result;
+    }
 
-    const std::string& entity_component_system::get_entity_name(entity::id_t id) { return entity_names_[id.id()]; }
+    void entity_component_system::unlink_name(std::uint32_t index)
+    {
+        const auto name_id = entity_name_ids_[index];
+        if (name_id == name_table::none)
+        {
+            return;
+        }
+
+        // Swap remove, patching the position of the slot moved into the gap.
+        auto&      slots = name_index_[name_id];
+        const auto pos   = entity_name_slots_[index];
+        const auto last  = slots.back();
+        slots[pos]               = last;
+        entity_name_slots_[last] = pos;
+        slots.pop_back();
+        entity_name_ids_[index] = name_table::none;
+        names_.release(name_id);
+    }
 
     void entity_component_system::dispose()
     {
+        std::vector<entity> entities;
+        entities.reserve(size());
         for (entity entity : all_entities())
         {
-            entity.destroy();
+            entities.push_back(entity);
         }
+        destroy_many(entities);
 
         component_pools_.clear();
         entity_component_mask_.clear();
         entity_version_.clear();
+        entity_name_ids_.clear();
+        entity_name_slots_.clear();
+        name_index_.clear();
+        names_ = name_table();
         free_list_.clear();
-        index_counter_ = 0;
+        free_list_sorted_ = true;
+        index_counter_    = 0;
     }
 
     void entity_component_system::remove(entity::id_t id, const std::shared_ptr<component>& component) { remove(id, component->runtime_id()); }
@@ -147,8 +790,16 @@ namespace runtime
         auto&              pool = component_pools_[family];
         chandle<component> handle(pool->get(id.index()));
         on_component_removed(get(id), handle);
+        record_change(id, family, change_kind::removed);
         // Remove component bit.
         entity_component_mask_[id.index()].reset(family);
+        if (family < family_groups_.size())
+        {
+            for (auto group : family_groups_[family])
+            {
+                group->erase(index);
+            }
+        }
 
         // Call destructor.
         pool->destroy(index);
@@ -213,25 +864,41 @@ namespace runtime
         const auto family = comp->runtime_id();
         // assert(!entity_component_mask_[id.index()].test(family));
 
-        // Placement new into the component pool.
         auto& pool = accomodate_component(family);
+        pool.set(id.index(), comp);
 
-        auto ptr = pool.set(id.index(), comp);
+        on_assigned(id, family, comp);
+        return comp;
+    }
+
+    void entity_component_system::on_assigned(entity::id_t id, rtti::type_index_sequential_t::index_t family, const std::shared_ptr<component>& comp)
+    {
         // Set the bit for this component.
-        entity_component_mask_[id.index()].set(family);
+        auto& mask = entity_component_mask_[id.index()];
+        mask.set(family);
+        if (family < family_groups_.size())
+        {
+            for (auto group : family_groups_[family])
+            {
+                if ((mask & group->mask()) == group->mask())
+                {
+                    group->insert(id.index());
+                }
+            }
+        }
 
         // Create and return handle.
         comp->entity_ = get(id);
         comp->on_entity_set();
-        chandle<component> handle(ptr);
+        record_change(id, family, change_kind::added);
+        chandle<component> handle(comp);
         on_component_added(get(id), handle);
-        return handle;
     }
 
     void entity_component_system::destroy(entity::id_t id)
     {
-        entity_names_[id.id()].clear();
         assert_valid(id);
+        unlink_name(id.index());
         std::uint32_t index = id.index();
         auto          mask  = entity_component_mask_[index];
         for (size_t i = 0; i < component_pools_.size(); ++i)
@@ -250,9 +917,117 @@ namespace runtime
         on_entity_destroyed(get(id));
         entity_component_mask_[index].reset();
         entity_version_[index]++;
+        if (!free_list_.empty() && free_list_.back() > index)
+        {
+            free_list_sorted_ = false;
+        }
         free_list_.push_back(index);
     }
 
+    entity_component_system::query_group& entity_component_system::get_group(const component_mask_t& mask)
+    {
+        auto& group = query_groups_[mask];
+        if (group)
+        {
+            return *group;
+        }
+
+        group = std::make_unique<query_group>(mask);
+        for (std::size_t family = 0; family < mask.size(); ++family)
+        {
+            if (mask.test(family))
+            {
+                if (family_groups_.size() <= family)
+                {
+                    family_groups_.resize(family + 1);
+                }
+                family_groups_[family].push_back(group.get());
+            }
+        }
+
+        // Fill it once, assign and remove keep it current from here on.
+        for (std::uint32_t index = 0; index < entity_component_mask_.size(); ++index)
+        {
+            if ((entity_component_mask_[index] & mask) == mask)
+            {
+                group->insert(index);
+            }
+        }
+
+        return *group;
+    }
+
+    command_buffer& entity_component_system::get_command_buffer()
+    {
+        std::lock_guard<std::mutex> lock(command_buffers_mutex_);
+        auto&                       buffer = command_buffers_[std::this_thread::get_id()];
+        if (!buffer)
+        {
+            buffer = std::make_unique<command_buffer>();
+        }
+        return *buffer;
+    }
+
+    void entity_component_system::playback_commands()
+    {
+        std::vector<command_buffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(command_buffers_mutex_);
+            buffers.reserve(command_buffers_.size());
+            for (auto& kvp : command_buffers_)
+            {
+                buffers.push_back(kvp.second.get());
+            }
+        }
+
+        playback(buffers);
+    }
+
+    void entity_component_system::playback(command_buffer& buffer) { playback(std::vector<command_buffer*> {&buffer}); }
+
+    void entity_component_system::playback(const std::vector<command_buffer*>& buffers)
+    {
+        struct recorded
+        {
+            std::vector<command_buffer::command> commands;
+            std::vector<entity>                  entities;
+        };
+
+        struct item
+        {
+            std::uint64_t key;
+            std::size_t   buffer;
+            std::size_t   command;
+        };
+
+        // Take the commands out first, so the ones being applied can record new ones
+        // for the next playback.
+        std::vector<recorded> recordings(buffers.size());
+        std::vector<item>     order;
+        for (std::size_t i = 0; i < buffers.size(); ++i)
+        {
+            auto& buffer = *buffers[i];
+            auto& rec    = recordings[i];
+            rec.commands = std::move(buffer.commands_);
+            rec.entities.resize(buffer.pending_);
+            buffer.clear();
+
+            for (std::size_t j = 0; j < rec.commands.size(); ++j)
+            {
+                order.push_back({rec.commands[j].key, i, j});
+            }
+        }
+
+        std::stable_sort(order.begin(), order.end(), [](const item& lhs, const item& rhs) { return lhs.key < rhs.key; });
+
+        for (const auto& it : order)
+        {
+            auto&                   rec = recordings[it.buffer];
+            command_buffer::context ctx {*this, rec.entities};
+            rec.commands[it.command].apply(ctx);
+        }
+    }
+
     entity entity_component_system::get(entity::id_t id)
     {
         assert_valid(id);
@@ -265,5 +1040,36 @@ namespace runtime
         return id;
     }
 
+    void entity_component_system::record_change(entity::id_t id, rtti::type_index_sequential_t::index_t family, change_kind kind)
+    {
+        auto journal = find_journal(family);
+        if (journal == nullptr)
+        {
+            return;
+        }
+
+        // A component kept alive after being removed has nothing left to report.
+        if (kind == change_kind::modified && !entity_component_mask_[id.index()].test(family))
+        {
+            return;
+        }
+
+        journal->record(id, ecs::get_frame(), kind);
+    }
+
     component::~component() {}
+
+    void component::touch()
+    {
+        const auto frame = static_cast<std::uint32_t>(ecs::get_frame());
+        const bool first = last_touched_ != frame;
+        last_touched_    = frame;
+
+        // Journal only the first touch of a frame. While constructing there is no
+        // entity yet, the assignment is journaled instead.
+        if (first && entity_.valid())
+        {
+            entity_.manager_->record_change(entity_.id(), runtime_id(), change_kind::modified);
+        }
+    }
 } // namespace runtime
@@ -10,13 +10,20 @@
 #include <algorithm>
 #include <bitset>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -28,22 +35,82 @@ namespace runtime
         using frame_getter_t = std::function<std::uint64_t()>;
         void          set_frame_getter(frame_getter_t frame_getter);
         std::uint64_t get_frame();
+
+        //-----------------------------------------------------------------------------
+        //  Name : parallel_for ()
+        /// <summary>
+        /// Splits [0, count) into ranges of grain elements and runs them on the
+        /// task_system workers. The calling thread takes a range itself and the
+        /// call returns once every range is done. Runs inline when there is no
+        /// task_system or only a single range.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void parallel_for(std::size_t count, std::size_t grain, const std::function<void(std::size_t begin, std::size_t end)>& job);
     } // namespace ecs
 
     template<typename C>
     using chandle = std::weak_ptr<C>;
 
     class component;
+
+    /// Chunked block allocator backing a single component family. Objects are
+    /// laid out back to back inside fixed size chunks which never move, so the
+    /// addresses handed out stay stable for as long as the object lives.
+    class component_arena
+    {
+    public:
+        component_arena(std::size_t stride, std::size_t alignment, std::size_t chunk_capacity = 256);
+        ~component_arena();
+
+        component_arena(const component_arena&)            = delete;
+        component_arena& operator=(const component_arena&) = delete;
+
+        inline std::size_t stride() const { return stride_; }
+        inline std::size_t alignment() const { return alignment_; }
+
+        void* allocate();
+        void  deallocate(void* ptr);
+        /// Makes sure n allocations can be served without growing.
+        void reserve(std::size_t n);
+
+    private:
+        void add_chunk();
+
+        std::size_t        stride_         = 0;
+        std::size_t        alignment_      = 0;
+        std::size_t        chunk_capacity_ = 0;
+        std::vector<void*> chunks_;
+        std::vector<void*> free_;
+        // Components may die on whichever thread drops the last reference.
+        std::mutex mutex_;
+    };
+
+    /// Packed sparse set of components for one family.
+    ///
+    /// The sparse array maps an entity slot to a position in the packed arrays,
+    /// which hold the owning entity slot and a pointer to the component for
+    /// every live element. Components created through the typed
+    /// set() are constructed inside the pool's arena together with their
+    /// reference counts, so they sit next to each other in memory. Components
+    /// adopted from outside (deserialization, reflection) keep their own
+    /// allocation. The packed array holds pointers rather than the components
+    /// themselves since handles rely on components never moving.
     class component_storage
     {
     public:
+        static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
         component_storage(std::size_t size = 100);
 
-        inline std::size_t size() const { return data.size(); }
-        inline std::size_t capacity() const { return data.capacity(); }
+        /// Number of entity slots the pool can address.
+        inline std::size_t size() const { return sparse_.size(); }
+        inline std::size_t capacity() const { return sparse_.capacity(); }
+        /// Number of live components in the packed arrays.
+        inline std::size_t count() const { return packed_entities_.size(); }
         /// Ensure at least n elements will fit in the pool.
         void                       expand(std::size_t n);
         void                       reserve(std::size_t n);
+        bool                       contains(std::size_t n) const { return n < sparse_.size() && sparse_[n] != npos; }
         std::shared_ptr<component> get(std::size_t n) const;
 
         template<typename T>
@@ -54,20 +121,143 @@ namespace runtime
             return std::static_pointer_cast<T>(get(n));
         }
 
+        /// Raw access to the component of entity slot n, nullptr if absent.
+        component* get_ptr(std::size_t n) const { return contains(n) ? packed_components_[sparse_[n]] : nullptr; }
+
+        template<typename T>
+        T& get_ref(std::size_t n) const
+        {
+            expects(contains(n));
+            return *static_cast<T*>(packed_components_[sparse_[n]]);
+        }
+
+        /// Packed entity slots, parallel to the packed components.
+        const std::vector<std::uint32_t>& packed_entities() const { return packed_entities_; }
+
+        template<typename T>
+        T& packed_at(std::size_t i) const
+        {
+            return *static_cast<T*>(packed_components_[i]);
+        }
+
         void destroy(std::size_t n);
 
+        /// Same as reserve(n), also preallocating arena slots for n components of T.
+        template<typename T>
+        void reserve(std::size_t n)
+        {
+            reserve(n);
+            if (n > count())
+            {
+                arena<T>().reserve(n - count());
+            }
+        }
+
         template<typename T, typename... Args>
         std::weak_ptr<T> set(unsigned int index, Args&&... args)
         {
-            auto element = std::make_shared<T>(std::forward<Args>(args)...);
-            data[index]  = std::move(element);
-            return std::static_pointer_cast<T>(data[index]);
+            static_assert(std::is_base_of<component, T>::value, "Invalid component type.");
+
+            // The reference counts and the component share a single arena slot.
+            arena<T>();
+            auto element = std::allocate_shared<T>(arena_allocator<T>(arena_), std::forward<Args>(args)...);
+            set(index, element);
+            return element;
         }
 
         std::weak_ptr<component> set(unsigned int index, const std::shared_ptr<component>& component);
 
+        /// While locked, destroy() leaves a hole instead of moving the last
+        /// element and defers the release of the component, so packed positions
+        /// and references stay put under an iterating caller.
+        void lock() { ++locks_; }
+        void unlock();
+
     private:
-        std::vector<std::shared_ptr<component>> data;
+        /// Serves the block allocate_shared asks for out of the family's arena.
+        /// Blocks that do not fit a slot, like those of a derived type larger
+        /// than the family's, come from the heap.
+        template<typename T>
+        struct arena_allocator
+        {
+            using value_type = T;
+
+            explicit arena_allocator(std::shared_ptr<component_arena> a) : arena(std::move(a)) {}
+
+            template<typename U>
+            arena_allocator(const arena_allocator<U>& other) : arena(other.arena)
+            {
+            }
+
+            T* allocate(std::size_t n)
+            {
+                if (fits(n))
+                {
+                    return static_cast<T*>(arena->allocate());
+                }
+                return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+            }
+
+            void deallocate(T* ptr, std::size_t n)
+            {
+                if (fits(n))
+                {
+                    arena->deallocate(ptr);
+                    return;
+                }
+                ::operator delete(ptr, std::align_val_t(alignof(T)));
+            }
+
+            bool fits(std::size_t n) const { return n == 1 && sizeof(T) <= arena->stride() && alignof(T) <= arena->alignment(); }
+
+            template<typename U>
+            bool operator==(const arena_allocator<U>& other) const
+            {
+                return arena == other.arena;
+            }
+
+            template<typename U>
+            bool operator!=(const arena_allocator<U>& other) const
+            {
+                return arena != other.arena;
+            }
+
+            std::shared_ptr<component_arena> arena;
+        };
+
+        /// Room kept in front of the component for the reference counts of
+        /// allocate_shared, which are a vtable pointer, two counters and the
+        /// allocator with the common standard libraries.
+        struct shared_block_header
+        {
+            void*                            vtable;
+            long                             uses;
+            long                             weaks;
+            std::shared_ptr<component_arena> allocator;
+        };
+
+        void compact();
+
+        template<typename T>
+        component_arena& arena()
+        {
+            if (!arena_)
+            {
+                constexpr auto alignment = std::max(alignof(T), alignof(shared_block_header));
+                constexpr auto header    = (sizeof(shared_block_header) + alignof(T) - 1) / alignof(T) * alignof(T);
+                arena_                   = std::make_shared<component_arena>(header + sizeof(T), alignment);
+            }
+            return *arena_;
+        }
+
+        std::vector<std::uint32_t>              sparse_;
+        std::vector<std::uint32_t>              packed_entities_;
+        std::vector<component*>                 packed_components_;
+        std::vector<std::shared_ptr<component>> packed_owners_;
+        std::vector<std::shared_ptr<component>> retired_;
+        std::shared_ptr<component_arena>        arena_;
+        std::size_t                             locks_ = 0;
+        std::size_t                             holes_ = 0;
     };
 
     class entity_component_system;
@@ -185,6 +375,8 @@ namespace runtime
         void destroy();
 
     private:
+        friend class component;
+
         entity::id_t             id_      = INVALID;
         entity_component_system* manager_ = nullptr;
     };
@@ -234,7 +426,7 @@ namespace runtime
         ///
         /// </summary>
         //-----------------------------------------------------------------------------
-        void touch() { last_touched_ = static_cast<std::uint32_t>(ecs::get_frame()); }
+        void touch();
 
         //-----------------------------------------------------------------------------
         //  Name : is_dirty (virtual )
@@ -298,6 +490,209 @@ namespace runtime
         chandle<T> handle() { return std::static_pointer_cast<T>(shared_from_this()); }
     };
 
+    enum class change_kind : std::uint8_t
+    {
+        added,
+        modified,
+        removed
+    };
+
+    /// Append only record of the entities whose component of one family was
+    /// added, modified or removed, tagged with the frame it happened in.
+    /// Readers keep a cursor into it and visit only what changed since their
+    /// last read. Entries older than `history` frames are dropped.
+    class change_journal
+    {
+    public:
+        struct entry
+        {
+            entity::id_t  id;
+            std::uint64_t frame;
+            change_kind   kind;
+        };
+
+        static constexpr std::uint64_t history = 4;
+
+        void record(entity::id_t id, std::uint64_t frame, change_kind kind);
+
+        /// Position past the last entry, a cursor starting here sees only new changes.
+        std::uint64_t end() const;
+
+        /// Calls f(entry) for each entry from cursor on and moves cursor past
+        /// them. Returns false if some entries after cursor were already dropped,
+        /// the reader has then missed changes and should rescan.
+        template<typename F>
+        bool read(std::uint64_t& cursor, F&& f) const
+        {
+            std::vector<entry> entries;
+            bool               complete = true;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                // A cursor past the end was taken before the journal restarted.
+                if (cursor < base_ || cursor > base_ + entries_.size())
+                {
+                    complete = false;
+                    cursor   = base_;
+                }
+                entries.assign(entries_.begin() + std::ptrdiff_t(cursor - base_), entries_.end());
+                cursor = base_ + entries_.size();
+            }
+
+            // Outside of the lock, f may well touch components itself.
+            for (const auto& e : entries)
+            {
+                f(e);
+            }
+            return complete;
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<entry> entries_;
+        std::uint64_t      base_  = 0;
+        std::uint64_t      frame_ = 0;
+    };
+
+    /// Interned strings, each distinct name is stored once and referred to by a
+    /// small id. Names are reference counted by the entity slots carrying them,
+    /// a name no slot carries any more is dropped and its id reused. Ids and
+    /// the returned references stay valid while the name is in use.
+    class name_table
+    {
+    public:
+        using name_id = std::uint32_t;
+
+        static constexpr name_id none = 0;
+
+        name_table();
+
+        /// Id of name, adding it if needed. The empty name is none.
+        name_id intern(const std::string& name);
+        /// Id of name if it was interned, none otherwise.
+        name_id            find(std::string_view name) const;
+        const std::string& get(name_id id) const { return names_[id]; }
+        /// Number of names in use, none included.
+        std::size_t size() const { return names_.size() - free_ids_.size(); }
+
+        /// A slot starts or stops carrying the name, none is not counted.
+        void add_ref(name_id id);
+        void release(name_id id);
+
+    private:
+        // A deque keeps the strings in place, the index keys view into them.
+        std::deque<std::string>                       names_;
+        std::vector<std::uint32_t>                    refs_;
+        std::vector<name_id>                          free_ids_;
+        std::unordered_map<std::string_view, name_id> ids_;
+    };
+
+    /**
+     * Records structural changes (create, destroy, assign, remove) so they can
+     * be made from worker tasks and applied later at a sync point on the thread
+     * owning the entity_component_system, see
+     * entity_component_system::get_command_buffer and playback_commands.
+     *
+     * Entities created through the buffer only exist once it is played back,
+     * until then they are referred to by a pending_entity. Arguments are copied
+     * into the command. A buffer itself is not thread safe, each thread records
+     * into its own.
+     *
+     * Playback runs commands ordered by the sort key current when they were
+     * recorded, keeping the recording order for equal keys within a buffer.
+     * Using a key per work item, eg. the index of the entity being processed,
+     * makes the result independent of how the work got scheduled. Buffers
+     * belong to threads, not to work items, so whoever sets a key restores
+     * the previous one when done; playback resets it to 0.
+     */
+    class command_buffer
+    {
+    public:
+        struct pending_entity
+        {
+            std::uint32_t index = 0;
+        };
+
+        struct context
+        {
+            entity_component_system& ecs;
+            std::vector<entity>&     entities;
+
+            /// The entity a pending_entity stands for, invalid if it was not created.
+            entity get(pending_entity e) const { return e.index < entities.size() ? entities[e.index] : entity(); }
+        };
+
+        void          set_sort_key(std::uint64_t key) { sort_key_ = key; }
+        std::uint64_t get_sort_key() const { return sort_key_; }
+
+        pending_entity create();
+        /// Refers to an existing entity from commands taking a pending_entity.
+        pending_entity reference(entity e);
+        void           destroy(pending_entity e);
+        void           destroy(entity e) { destroy(reference(e)); }
+
+        template<typename C, typename... Args>
+        void assign(pending_entity e, Args&&... args)
+        {
+            record([e, args = std::make_tuple(std::forward<Args>(args)...)](context& ctx) mutable {
+                auto target = ctx.get(e);
+                if (target.valid())
+                {
+                    std::apply([&target](auto&&... a) { target.assign<C>(std::move(a)...); }, std::move(args));
+                }
+            });
+        }
+
+        template<typename C, typename... Args>
+        void assign(entity e, Args&&... args)
+        {
+            assign<C>(reference(e), std::forward<Args>(args)...);
+        }
+
+        template<typename C>
+        void remove(pending_entity e)
+        {
+            record([e](context& ctx) {
+                auto target = ctx.get(e);
+                if (target.has_component<C>())
+                {
+                    target.remove<C>();
+                }
+            });
+        }
+
+        template<typename C>
+        void remove(entity e)
+        {
+            remove<C>(reference(e));
+        }
+
+        /// Runs f(context&) in order with the other commands, for whatever needs
+        /// the created entities, eg. parenting them.
+        template<typename F>
+        void run(F&& f)
+        {
+            record(std::forward<F>(f));
+        }
+
+        bool empty() const { return commands_.empty(); }
+        void clear();
+
+    private:
+        friend class entity_component_system;
+
+        struct command
+        {
+            std::uint64_t                 key;
+            std::function<void(context&)> apply;
+        };
+
+        void record(std::function<void(context&)> apply) { commands_.push_back({sort_key_, std::move(apply)}); }
+
+        std::vector<command> commands_;
+        std::uint32_t        pending_  = 0;
+        std::uint64_t        sort_key_ = 0;
+    };
+
     extern hpp::event<void(entity)>                     on_entity_created;
     extern hpp::event<void(entity)>                     on_entity_destroyed;
     extern hpp::event<void(entity, chandle<component>)> on_component_added;
@@ -314,9 +709,42 @@ namespace runtime
 
         explicit entity_component_system() = default;
         virtual ~entity_component_system();
+
+        /// Entities matching a component mask. A group is registered once per mask
+        /// and kept up to date on assign and remove, so iterating a query only
+        /// visits the entities that match instead of every entity slot.
+        class query_group
+        {
+        public:
+            static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+            explicit query_group(const component_mask_t& mask) : mask_(mask) {}
+
+            const component_mask_t& mask() const { return mask_; }
+            /// Packed entity slots. May contain npos holes while locked.
+            const std::vector<std::uint32_t>& entities() const { return entities_; }
+            std::size_t                       count() const { return entities_.size() - holes_; }
+            bool contains(std::uint32_t index) const { return index < sparse_.size() && sparse_[index] != npos; }
+
+            void insert(std::uint32_t index);
+            void erase(std::uint32_t index);
+
+            /// While locked, erase() leaves a hole so positions stay put under an
+            /// iterating caller.
+            void lock() { ++locks_; }
+            void unlock();
+
+        private:
+            component_mask_t           mask_;
+            std::vector<std::uint32_t> sparse_;
+            std::vector<std::uint32_t> entities_;
+            std::size_t                locks_ = 0;
+            std::size_t                holes_ = 0;
+        };
+
         /// An iterator over a view of the entities in an entity_component_system.
         /// If All is true it will iterate over all valid entities and will ignore the
-        /// entity mask.
+        /// entity mask, otherwise it walks the query group registered for the mask.
         template<class Delegate, bool All = false>
         class view_iterator
         {
@@ -332,7 +760,7 @@ namespace runtime
             {
                 if (All)
                 {
-                    std::sort(manager_->free_list_.begin(), manager_->free_list_.end());
+                    manager_->sort_free_list();
                     free_cursor_ = 0;
                 }
             }
@@ -342,9 +770,40 @@ namespace runtime
             {
                 if (All)
                 {
-                    std::sort(manager_->free_list_.begin(), manager_->free_list_.end());
+                    manager_->sort_free_list();
                     free_cursor_ = 0;
                 }
+                else
+                {
+                    group_ = &manager_->get_group(mask_);
+                    group_->lock();
+                    capacity_ = group_->entities().size();
+                    i_        = std::min<std::uint32_t>(i_, std::uint32_t(capacity_));
+                }
+            }
+
+            view_iterator(const view_iterator& other) :
+                manager_(other.manager_),
+                group_(other.group_),
+                mask_(other.mask_),
+                i_(other.i_),
+                capacity_(other.capacity_),
+                free_cursor_(other.free_cursor_)
+            {
+                if (group_)
+                {
+                    group_->lock();
+                }
+            }
+
+            view_iterator& operator=(const view_iterator& other) = delete;
+
+            ~view_iterator()
+            {
+                if (group_)
+                {
+                    group_->unlock();
+                }
             }
 
             Delegate& operator++()
@@ -357,8 +816,8 @@ namespace runtime
             bool operator==(const Delegate& rhs) const { return i_ == rhs.i_; }
             bool operator!=(const Delegate& rhs) const { return i_ != rhs.i_; }
 
-            entity operator*() { return entity(manager_, manager_->create_id(i_)); }
-            entity operator*() const { return entity(manager_, manager_->create_id(i_)); }
+            entity operator*() { return entity(manager_, manager_->create_id(slot())); }
+            entity operator*() const { return entity(manager_, manager_->create_id(slot())); }
 
         protected:
             void next()
@@ -370,12 +829,28 @@ namespace runtime
 
                 if (i_ < capacity_)
                 {
-                    entity entity = manager_->get(manager_->create_id(i_));
+                    entity entity = manager_->get(manager_->create_id(slot()));
                     static_cast<Delegate*>(this)->next_entity(entity);
                 }
             }
 
-            bool predicate() { return (All && valid_entity()) || (manager_->entity_component_mask_[i_] & mask_) == mask_; }
+            std::uint32_t slot() const
+            {
+                if (All)
+                {
+                    return i_;
+                }
+                return group_->entities()[i_];
+            }
+
+            bool predicate()
+            {
+                if (All)
+                {
+                    return valid_entity();
+                }
+                return group_->entities()[i_] != query_group::npos;
+            }
 
             bool valid_entity()
             {
@@ -389,6 +864,7 @@ namespace runtime
             }
 
             entity_component_system* manager_;
+            query_group*             group_ = nullptr;
             component_mask_t         mask_;
             std::uint32_t            i_;
             size_t                   capacity_;
@@ -414,9 +890,9 @@ namespace runtime
             iterator_type       begin() { return iterator_type(manager_, mask_, 0); }
             iterator_type       end() { return iterator_type(manager_, mask_, std::uint32_t(manager_->capacity())); }
             const iterator_type begin() const { return iterator_type(manager_, mask_, 0); }
-            const iterator_type end() const { return iterator_type(manager_, mask_, manager_->capacity()); }
+            const iterator_type end() const { return iterator_type(manager_, mask_, std::uint32_t(manager_->capacity())); }
 
-        private:
+        protected:
             friend class entity_component_system;
 
             explicit base_view(entity_component_system* manager) : manager_(manager) { mask_.set(); }
@@ -438,9 +914,16 @@ namespace runtime
 
             void for_each(typename identity<std::function<void(entity entity, Components&...)>>::type f)
             {
-                for (auto it : *this)
+                if constexpr (All)
+                {
+                    for (auto it : *this)
+                    {
+                        f(it, *(it.template get_component<Components>().lock().get())...);
+                    }
+                }
+                else
                 {
-                    f(it, *(it.template get_component<Components>().lock().get())...);
+                    this->manager_->template for_each_packed<Components...>(f);
                 }
             }
 
@@ -454,6 +937,46 @@ namespace runtime
         template<typename... Components>
         using view = typed_view<false, Components...>;
 
+        /// Compile time typed access to the entities having all of the
+        /// Components. Callbacks are taken as template parameters and receive raw
+        /// references straight from the packed pools, with the constness of each
+        /// component kept in its type.
+        template<typename... Components>
+        class typed_query
+        {
+        public:
+            static_assert(sizeof...(Components) > 0, "A query needs at least one component.");
+
+            /// Whether every component is accessed through a const reference,
+            /// such a query only reads and is safe to run in parallel.
+            static constexpr bool read_only = (std::is_const<Components>::value && ...);
+
+            template<typename F>
+            void each(F&& f)
+            {
+                manager_->template for_each_packed<Components...>(std::forward<F>(f));
+            }
+
+            template<typename F>
+            void parallel_each(F&& f, std::size_t grain = 256)
+            {
+                manager_->template parallel_for_each<Components...>(std::forward<F>(f), grain);
+            }
+
+            template<typename T, typename F>
+            std::vector<T> parallel_collect(F&& f, std::size_t grain = 256)
+            {
+                return manager_->template parallel_collect<T, Components...>(std::forward<F>(f), grain);
+            }
+
+        private:
+            friend class entity_component_system;
+
+            explicit typed_query(entity_component_system* manager) : manager_(manager) {}
+
+            entity_component_system* manager_;
+        };
+
         template<typename... Components>
         class unpacking_view
         {
@@ -546,6 +1069,41 @@ namespace runtime
          */
         void destroy(entity::id_t id);
 
+        /**
+         * Create n entities at once, growing the entity arrays a single time.
+         *
+         * Emits EntityCreatedEvent for each.
+         */
+        std::vector<entity> create_many(std::size_t n);
+
+        /**
+         * Destroy the valid entities among the given ones. Components are
+         * removed one family at a time with the pool locked, so each pool is
+         * compacted once, and the freed slots are appended to the free list
+         * in one go. Every entity's components are gone before the first
+         * on_entity_destroyed is sent.
+         */
+        void destroy_many(std::span<const entity> entities);
+
+        /**
+         * Make room for `entities` entities in total, and in the pools of the
+         * given Components for as many components, so that filling them in
+         * does not reallocate along the way.
+         *
+         * @code
+         * ecs.reserve<transform_component, model_component>(20000);
+         * @endcode
+         */
+        template<typename... Components>
+        void reserve(std::size_t entities)
+        {
+            entity_component_mask_.reserve(entities);
+            entity_version_.reserve(entities);
+            entity_name_ids_.reserve(entities);
+            entity_name_slots_.reserve(entities);
+            (accomodate_component<std::remove_const_t<Components>>().template reserve<std::remove_const_t<Components>>(entities), ...);
+        }
+
         entity get(entity::id_t id);
 
         /**
@@ -567,7 +1125,14 @@ namespace runtime
         template<typename C, typename... Args>
         chandle<C> assign(entity::id_t id, Args&&... args)
         {
-            return std::static_pointer_cast<C>(assign(id, std::make_shared<C>(std::forward<Args>(args)...)).lock());
+            assert_valid(id);
+            const auto family = rtti::type_index_sequential_t::id<component, C>();
+
+            // Construct in place so the component lands in its family's arena.
+            auto& pool = accomodate_component(family);
+            auto  comp = pool.template set<C>(id.index(), std::forward<Args>(args)...).lock();
+            on_assigned(id, family, comp);
+            return comp;
         }
 
         chandle<component> assign(entity::id_t id, const std::shared_ptr<component>& comp);
@@ -650,6 +1215,21 @@ namespace runtime
             return view<Components...>(this, mask);
         }
 
+        /**
+         * Typed query over the entities having all of the Components. Mark the
+         * components only read with const.
+         *
+         * @code
+         * ecs.query<const transform_component, model_component>().each(
+         *     [](entity e, const transform_component& transform, model_component& model) {});
+         * @endcode
+         */
+        template<typename... Components>
+        typed_query<Components...> query()
+        {
+            return typed_query<Components...>(this);
+        }
+
         template<typename T>
         struct identity
         {
@@ -662,6 +1242,156 @@ namespace runtime
             return entities_with_components<Components...>().for_each(f);
         }
 
+        /**
+         * Same as for_each, but the matching entities are split into chunks of
+         * `grain` which run on the task_system workers. Returns once every chunk
+         * is done.
+         *
+         * The callback runs concurrently and must not create, destroy, assign or
+         * remove anything, record such changes and apply them afterwards.
+         *
+         * @code
+         * ecs.parallel_for_each<transform_component, model_component>(
+         *     [](entity e, transform_component& transform, model_component& model) {});
+         * @endcode
+         */
+        template<typename... Components, typename F>
+        void parallel_for_each(F&& f, std::size_t grain = 256)
+        {
+            component_storage* pools[] = {find_pool(rtti::type_index_sequential_t::id<component, std::remove_const_t<Components>>())...};
+            component_storage* lead    = lead_pool(pools);
+            if (lead == nullptr)
+            {
+                return;
+            }
+
+            const auto mask = component_mask<Components...>();
+            ecs::parallel_for(lead->count(), grain, [this, &f, &pools, lead, &mask](std::size_t begin, std::size_t end) {
+                const auto& entities = lead->packed_entities();
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    const auto index = entities[i];
+                    if (index == component_storage::npos || (entity_component_mask_[index] & mask) != mask)
+                    {
+                        continue;
+                    }
+
+                    invoke_packed<Components...>(f, index, pools, std::index_sequence_for<Components...>());
+                }
+            });
+        }
+
+        /**
+         * Parallel gather over the entities having all of the Components. Every
+         * chunk appends to its own output through f(out, entity, Components&...)
+         * and the chunks are concatenated in iteration order, so the result does
+         * not depend on the scheduling. Same restrictions as parallel_for_each.
+         */
+        template<typename T, typename... Components, typename F>
+        std::vector<T> parallel_collect(F&& f, std::size_t grain = 256)
+        {
+            std::vector<T>     result;
+            component_storage* pools[] = {find_pool(rtti::type_index_sequential_t::id<component, std::remove_const_t<Components>>())...};
+            component_storage* lead    = lead_pool(pools);
+            if (lead == nullptr)
+            {
+                return result;
+            }
+
+            grain              = std::max<std::size_t>(grain, 1);
+            const auto count   = lead->count();
+            const auto mask    = component_mask<Components...>();
+            auto       outputs = std::vector<std::vector<T>>((count + grain - 1) / grain);
+            ecs::parallel_for(count, grain, [this, &f, &pools, lead, &mask, &outputs, grain](std::size_t begin, std::size_t end) {
+                auto&       out      = outputs[begin / grain];
+                const auto& entities = lead->packed_entities();
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    const auto index = entities[i];
+                    if (index == component_storage::npos || (entity_component_mask_[index] & mask) != mask)
+                    {
+                        continue;
+                    }
+
+                    invoke_packed<Components...>(
+                        [&f, &out](entity e, Components&... components) { f(out, e, components...); }, index, pools, std::index_sequence_for<Components...>());
+                }
+            });
+
+            std::size_t total = 0;
+            for (const auto& out : outputs)
+            {
+                total += out.size();
+            }
+
+            result.reserve(total);
+            for (auto& out : outputs)
+            {
+                std::move(out.begin(), out.end(), std::back_inserter(result));
+            }
+            return result;
+        }
+
+        /**
+         * Calls f(entity, Components&...) if e is valid and has all of the
+         * Components, reading the pools directly like each does. Returns whether
+         * f was called. Safe to call from parallel_for jobs under the same
+         * restrictions as parallel_for_each.
+         *
+         * @code
+         * ecs.visit<const transform_component>(e, [](entity e, const transform_component& transform) {});
+         * @endcode
+         */
+        template<typename... Components, typename F>
+        bool visit(entity e, F&& f)
+        {
+            if (!valid(e.id()))
+            {
+                return false;
+            }
+
+            const auto index = e.id().index();
+            const auto mask  = component_mask<Components...>();
+            if ((entity_component_mask_[index] & mask) != mask)
+            {
+                return false;
+            }
+
+            component_storage* pools[] = {find_pool(rtti::type_index_sequential_t::id<component, std::remove_const_t<Components>>())...};
+            invoke_packed<Components...>(f, index, pools, std::index_sequence_for<Components...>());
+            return true;
+        }
+
+        /**
+         * Visits the entities whose C was added, modified (touched) or removed
+         * since cursor and advances it, f(entity, change_kind). The same entity
+         * may come up more than once and may no longer be valid. Start from 0 or
+         * from change_end<C>(). Returns false when changes were missed because the
+         * journal dropped them, the caller should then fall back to a full scan.
+         *
+         * @code
+         * ecs.for_each_change<transform_component>(cursor_, [](entity e, change_kind kind) {});
+         * @endcode
+         */
+        template<typename C, typename F>
+        bool for_each_change(std::uint64_t& cursor, F&& f)
+        {
+            auto journal = find_journal(rtti::type_index_sequential_t::id<component, std::remove_const_t<C>>());
+            if (journal == nullptr)
+            {
+                return true;
+            }
+
+            return journal->read(cursor, [this, &f](const change_journal::entry& e) { f(entity(this, e.id), e.kind); });
+        }
+
+        template<typename C>
+        std::uint64_t change_end() const
+        {
+            auto journal = find_journal(rtti::type_index_sequential_t::id<component, std::remove_const_t<C>>());
+            return journal ? journal->end() : 0;
+        }
+
         /**
          * Find Entities that have all of the specified Components and assign them
          * to the given parameters.
@@ -718,16 +1448,61 @@ namespace runtime
             unpack<Args...>(id, args...);
         }
 
+        /**
+         * The command buffer of the calling thread, safe to call from worker
+         * tasks. Everything recorded is applied by the next playback_commands().
+         */
+        command_buffer& get_command_buffer();
+
+        /**
+         * Sync point, applies the commands recorded in every thread's buffer.
+         * Must run on the thread owning the ecs with no parallel pass in flight.
+         */
+        void playback_commands();
+
+        /// Applies the commands of a buffer owned by the caller.
+        void playback(command_buffer& buffer);
+
         /**
          * Destroy all entities and reset the entity_component_system.
          */
         void dispose();
 
         void               set_entity_name(entity::id_t id, const std::string& name);
-        const std::string& get_entity_name(entity::id_t id);
+        const std::string& get_entity_name(entity::id_t id) const;
+
+        /// Entity bookkeeping of the world, enough to bring back every entity
+        /// with the same id. Components are left to the caller.
+        struct entity_layout
+        {
+            std::vector<std::uint32_t> versions;
+            std::vector<std::uint32_t> free_list;
+            // Name of each slot.
+            std::vector<std::string> names;
+        };
+
+        entity_layout save_layout() const;
+
+        /**
+         * Disposes the world and recreates the entities of layout, with their
+         * ids and names but without components. Returns them in slot order.
+         *
+         * Emits EntityCreatedEvent for each.
+         */
+        std::vector<entity> restore_layout(const entity_layout& layout);
+
+        /**
+         * Any entity named name, an invalid one if there is none. Constant time,
+         * names are interned and indexed.
+         */
+        entity find_by_name(const std::string& name);
+
+        /// Every entity named name.
+        std::vector<entity> find_all_by_name(const std::string& name);
 
     private:
         friend class entity;
+        friend class component;
 
         inline void assert_valid(entity::id_t id) const
         {
@@ -750,7 +1525,7 @@ namespace runtime
         component_mask_t component_mask()
         {
             component_mask_t mask;
-            mask.set(rtti::type_index_sequential_t::id<component, C>());
+            mask.set(rtti::type_index_sequential_t::id<component, std::remove_const_t<C>>());
             return mask;
         }
 
@@ -772,19 +1547,15 @@ namespace runtime
             return component_mask<C1, Components...>();
         }
 
+        // The pools grow on their own when a component gets set.
         inline void accomodate_entity(std::uint32_t index)
         {
             if (entity_component_mask_.size() <= index)
             {
                 entity_component_mask_.resize(index + 1);
                 entity_version_.resize(index + 1);
-                for (auto& pool : component_pools_)
-                {
-                    if (pool)
-                    {
-                        pool->expand(index + 1);
-                    }
-                }
+                entity_name_ids_.resize(index + 1, name_table::none);
+                entity_name_slots_.resize(index + 1);
             }
         }
 
@@ -795,6 +1566,118 @@ namespace runtime
             return accomodate_component(family);
         }
 
+        component_storage* find_pool(rtti::type_index_sequential_t::index_t family) const
+        {
+            return family < component_pools_.size() ? component_pools_[family].get() : nullptr;
+        }
+
+        template<typename... Components, typename F, std::size_t... I>
+        void invoke_packed(F&& f, std::uint32_t index, component_storage* const* pools, std::index_sequence<I...> /*unused*/)
+        {
+            f(entity(this, create_id(index)), pools[I]->template get_ref<Components>(index)...);
+        }
+
+        /// Walks the packed entities of the single pool involved, or of the query
+        /// group for several components, and hands the components out by
+        /// reference, skipping the per entity handle locks.
+        template<typename... Components, typename F>
+        void for_each_packed(F&& f)
+        {
+            component_storage* pools[] = {find_pool(rtti::type_index_sequential_t::id<component, std::remove_const_t<Components>>())...};
+            component_storage* lead    = lead_pool(pools);
+            if (lead == nullptr)
+            {
+                return;
+            }
+
+            const auto   mask  = component_mask<Components...>();
+            query_group* group = sizeof...(Components) > 1 ? &get_group(mask) : nullptr;
+
+            struct scoped_lock
+            {
+                component_storage* const* begin;
+                component_storage* const* end;
+                query_group*              group;
+
+                scoped_lock(component_storage* const* b, component_storage* const* e, query_group* g) : begin(b), end(e), group(g)
+                {
+                    std::for_each(begin, end, [](auto pool) { pool->lock(); });
+                    if (group)
+                    {
+                        group->lock();
+                    }
+                }
+                ~scoped_lock()
+                {
+                    if (group)
+                    {
+                        group->unlock();
+                    }
+                    std::for_each(begin, end, [](auto pool) { pool->unlock(); });
+                }
+            } guard(std::begin(pools), std::end(pools), group);
+
+            const auto& entities = group ? group->entities() : lead->packed_entities();
+            const auto  count    = entities.size();
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                // Re-read every step, the callback is allowed to grow the list.
+                const auto index = entities[i];
+                if (index == component_storage::npos || (entity_component_mask_[index] & mask) != mask)
+                {
+                    continue;
+                }
+
+                invoke_packed<Components...>(f, index, pools, std::index_sequence_for<Components...>());
+            }
+        }
+
+        /// The smallest of the given pools, nullptr if any of them is missing.
+        template<std::size_t N>
+        static component_storage* lead_pool(component_storage* const (&pools)[N])
+        {
+            component_storage* lead = nullptr;
+            for (auto pool : pools)
+            {
+                if (pool == nullptr)
+                {
+                    return nullptr;
+                }
+
+                if (lead == nullptr || pool->count() < lead->count())
+                {
+                    lead = pool;
+                }
+            }
+            return lead;
+        }
+
+        void on_assigned(entity::id_t id, rtti::type_index_sequential_t::index_t family, const std::shared_ptr<component>& comp);
+
+        change_journal* find_journal(rtti::type_index_sequential_t::index_t family) const
+        {
+            return family < change_journals_.size() ? change_journals_[family].get() : nullptr;
+        }
+
+        void record_change(entity::id_t id, rtti::type_index_sequential_t::index_t family, change_kind kind);
+
+        /// Drops the slot from the reverse index of its current name.
+        void unlink_name(std::uint32_t index);
+
+        void playback(const std::vector<command_buffer*>& buffers);
+
+        /// Returns the query group for mask, registering and filling it on first use.
+        query_group& get_group(const component_mask_t& mask);
+
+        void sort_free_list()
+        {
+            if (!free_list_sorted_)
+            {
+                std::sort(free_list_.begin(), free_list_.end());
+                free_list_sorted_ = true;
+            }
+        }
+
         component_storage& accomodate_component(rtti::type_index_sequential_t::index_t family)
         {
             if (component_pools_.size() <= family)
@@ -806,7 +1689,17 @@ namespace runtime
             if (!pool)
             {
                 pool = std::make_unique<component_storage>();
-                pool->expand(index_counter_);
+            }
+
+            if (change_journals_.size() <= family)
+            {
+                change_journals_.resize(family + 1);
+            }
+
+            auto& journal = change_journals_[family];
+            if (!journal)
+            {
+                journal = std::make_unique<change_journal>();
             }
 
             return *pool;
@@ -825,8 +1718,26 @@ namespace runtime
         std::vector<std::uint32_t> entity_version_;
         // List of available entity slots.
         std::vector<std::uint32_t> free_list_;
-
-        std::unordered_map<std::uint64_t, std::string> entity_names_;
+        // Whether free_list_ is in ascending order, which the All views rely on.
+        bool free_list_sorted_ = true;
+        // Registered query groups by mask, and the groups each component family
+        // takes part in, indexed by family.
+        std::unordered_map<component_mask_t, std::unique_ptr<query_group>> query_groups_;
+        std::vector<std::vector<query_group*>>                             family_groups_;
+        // Change journal of each component family, kept across dispose() so
+        // readers' cursors stay meaningful.
+        std::vector<std::unique_ptr<change_journal>> change_journals_;
+        // Command buffer of each thread that asked for one.
+        std::mutex                                                           command_buffers_mutex_;
+        std::unordered_map<std::thread::id, std::unique_ptr<command_buffer>> command_buffers_;
+
+        // Interned entity names, the name id of each entity slot and the slots
+        // carrying each name id. entity_name_slots_ is the position of a slot in
+        // its name's list, for constant time removal.
+        name_table                              names_;
+        std::vector<name_table::name_id>        entity_name_ids_;
+        std::vector<std::uint32_t>              entity_name_slots_;
+        std::vector<std::vector<std::uint32_t>> name_index_;
     };
 
     template<typename C, typename... Args>
@@ -9,21 +9,22 @@
 namespace runtime
 {
 
-    void process_node(const std::unique_ptr<mesh::armature_node>& node,
-                      const skin_bind_data&                       bind_data,
-                      runtime::entity&                            parent,
-                      std::vector<runtime::entity>&               entity_nodes,
-                      runtime::entity_component_system&           ecs)
+    void process_node(const std::unique_ptr<mesh::armature_node>&  node,
+                      const skin_bind_data&                        bind_data,
+                      command_buffer::pending_entity               parent,
+                      std::vector<command_buffer::pending_entity>& entity_nodes,
+                      command_buffer&                              commands)
     {
-        if (!parent.valid())
-            return;
-
-        auto entity_node = ecs.create();
-        entity_node.set_name(node->name);
-
-        auto transf_comp = entity_node.assign<transform_component>().lock();
-        transf_comp->set_parent(parent);
-        transf_comp->set_local_transform(node->local_transform);
+        auto entity_node = commands.create();
+        commands.assign<transform_component>(entity_node);
+        commands.run([entity_node, parent, name = node->name, local_transform = node->local_transform](command_buffer::context& ctx) {
+            auto e = ctx.get(entity_node);
+            e.set_name(name);
+
+            auto transf_comp = e.get_component<transform_component>().lock();
+            transf_comp->set_parent(ctx.get(parent));
+            transf_comp->set_local_transform(local_transform);
+        });
 
         auto bone = bind_data.find_bone_by_id(node->name);
         if (bone)
@@ -33,7 +34,7 @@ namespace runtime
 
         for (auto& child : node->children)
         {
-            process_node(child, bind_data, entity_node, entity_nodes, ecs);
+            process_node(child, bind_data, entity_node, entity_nodes, commands);
         }
     }
 
@@ -67,36 +68,84 @@ namespace runtime
         return result;
     }
 
+    static bool has_skin(const model_component& model_comp)
+    {
+        const auto& model = model_comp.get_model();
+        auto        mesh  = model.get_lod(0);
+
+        // If mesh isnt loaded yet skip it.
+        if (!mesh)
+            return false;
+
+        return mesh->get_skin_bind_data().has_bones();
+    }
+
     void bone_system::frame_update(float)
     {
         auto& ecs = core::get_subsystem<runtime::entity_component_system>();
-        ecs.for_each<model_component>([&ecs](runtime::entity e, model_component& model_comp) {
-            const auto& model = model_comp.get_model();
-            auto        mesh  = model.get_lod(0);
-
-            // If mesh isnt loaded yet skip it.
-            if (!mesh)
-                return;
 
-            const auto& skin_data = mesh->get_skin_bind_data();
+        // The bone hierarchies are recorded from the workers and created at the
+        // sync point below, keyed by the owner so the result does not depend on
+        // the scheduling.
+        ecs.parallel_for_each<const model_component>(
+            [&ecs](runtime::entity e, const model_component& model_comp) {
+                // Has skinning data?
+                if (!has_skin(model_comp))
+                    return;
+
+                if (model_comp.get_bone_entities().size() > 1)
+                    return;
+
+                auto&       commands     = ecs.get_command_buffer();
+                auto        mesh         = model_comp.get_model().get_lod(0);
+                const auto& skin_data    = mesh->get_skin_bind_data();
+                const auto& armature     = mesh->get_armature();
+                const auto  previous_key = commands.get_sort_key();
+                commands.set_sort_key(e.id().index());
+
+                auto                                        owner = commands.reference(e);
+                std::vector<command_buffer::pending_entity> nodes;
+                process_node(armature, skin_data, owner, nodes, commands);
+                commands.run([owner, nodes = std::move(nodes)](command_buffer::context& ctx) {
+                    auto owner_model = ctx.get(owner).get_component<model_component>().lock();
+                    if (!owner_model)
+                        return;
 
-            // Has skinning data?
-            if (skin_data.has_bones())
-            {
-                if (model_comp.get_bone_entities().size() <= 1)
-                {
-                    const auto&                  armature = mesh->get_armature();
                     std::vector<runtime::entity> be;
-                    process_node(armature, skin_data, e, be, ecs);
-                    model_comp.set_bone_entities(be);
-                    model_comp.set_static(false);
+                    be.reserve(nodes.size());
+                    for (const auto& node : nodes)
+                    {
+                        be.emplace_back(ctx.get(node));
+                    }
+                    owner_model->set_bone_entities(be);
+                    owner_model->set_static(false);
+                });
+                commands.set_sort_key(previous_key);
+            },
+            16);
+
+        ecs.playback_commands();
+
+        // Every bone resolves through the owner's chain, so settle it here and
+        // leave the parallel pass below writing only the bones it owns.
+        ecs.query<transform_component, const model_component>().each(
+            [](runtime::entity e, transform_component& transform_comp, const model_component& model_comp) {
+                if (has_skin(model_comp))
+                {
+                    transform_comp.resolve();
                 }
+            });
+
+        ecs.parallel_for_each<model_component>(
+            [](runtime::entity e, model_component& model_comp) {
+                if (!has_skin(model_comp))
+                    return;
 
                 const auto& bone_entities = model_comp.get_bone_entities();
                 auto        transforms    = get_transforms_for_bones(bone_entities);
                 model_comp.set_bone_transforms(std::move(transforms));
-            }
-        });
+            },
+            16);
     }
 
     bone_system::bone_system() { runtime::on_frame_update.connect(this, &bone_system::frame_update); }
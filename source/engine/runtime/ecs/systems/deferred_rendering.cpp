@@ -11,6 +11,7 @@
 #include "../components/model_component.h"
 #include "../components/reflection_probe_component.h"
 #include "../components/transform_component.h"
+#include "spatial_index.h"
 
 #include <core/graphics/index_buffer.h>
 #include <core/graphics/render_pass.h>
@@ -19,29 +20,357 @@
 #include <core/graphics/vertex_buffer.h>
 #include <core/system/subsystem.h>
 
+#include <limits>
+
 namespace runtime
 {
+    namespace
+    {
+        /// Uniforms and samplers of the deferred passes, resolved once by name.
+        struct pass_uniforms
+        {
+            gfx::uniform_id camera_wpos           = gfx::get_uniform_id("u_camera_wpos");
+            gfx::uniform_id camera_clip_planes    = gfx::get_uniform_id("u_camera_clip_planes");
+            gfx::uniform_id lod_params            = gfx::get_uniform_id("u_lod_params");
+            gfx::uniform_id camera_position       = gfx::get_uniform_id("u_camera_position");
+            gfx::uniform_id light_direction       = gfx::get_uniform_id("u_light_direction");
+            gfx::uniform_id light_position        = gfx::get_uniform_id("u_light_position");
+            gfx::uniform_id light_data            = gfx::get_uniform_id("u_light_data");
+            gfx::uniform_id light_color_intensity = gfx::get_uniform_id("u_light_color_intensity");
+            gfx::uniform_id inv_world             = gfx::get_uniform_id("u_inv_world");
+            gfx::uniform_id data0                 = gfx::get_uniform_id("u_data0");
+            gfx::uniform_id data1                 = gfx::get_uniform_id("u_data1");
+            gfx::uniform_id data2                 = gfx::get_uniform_id("u_data2");
+            gfx::uniform_id tex0                  = gfx::get_uniform_id("s_tex0");
+            gfx::uniform_id tex1                  = gfx::get_uniform_id("s_tex1");
+            gfx::uniform_id tex2                  = gfx::get_uniform_id("s_tex2");
+            gfx::uniform_id tex3                  = gfx::get_uniform_id("s_tex3");
+            gfx::uniform_id tex4                  = gfx::get_uniform_id("s_tex4");
+            gfx::uniform_id tex5                  = gfx::get_uniform_id("s_tex5");
+            gfx::uniform_id tex6                  = gfx::get_uniform_id("s_tex6");
+            gfx::uniform_id tex_cube              = gfx::get_uniform_id("s_tex_cube");
+            gfx::uniform_id input                 = gfx::get_uniform_id("s_input");
+            gfx::uniform_id cluster_grid          = gfx::get_uniform_id("u_cluster_grid");
+            gfx::uniform_id cluster_depth         = gfx::get_uniform_id("u_cluster_depth");
+            gfx::uniform_id cluster_texel         = gfx::get_uniform_id("u_cluster_texel");
+            gfx::uniform_id cluster_light_data    = gfx::get_uniform_id("s_light_data");
+            gfx::uniform_id cluster_light_grid    = gfx::get_uniform_id("s_light_grid");
+            gfx::uniform_id cluster_light_indices = gfx::get_uniform_id("s_light_indices");
+            gfx::uniform_id shadow_map            = gfx::get_uniform_id("s_shadow_map");
+            gfx::uniform_id shadow_matrix         = gfx::get_uniform_id("u_shadow_matrix");
+            gfx::uniform_id shadow_rect           = gfx::get_uniform_id("u_shadow_rect");
+            gfx::uniform_id shadow_params         = gfx::get_uniform_id("u_shadow_params");
+            gfx::uniform_id shadow_splits         = gfx::get_uniform_id("u_shadow_splits");
+        };
+
+        const pass_uniforms& get_pass_uniforms()
+        {
+            static const pass_uniforms uniforms;
+            return uniforms;
+        }
+
+        /// Uploads rows of float texels. The texture is only recreated when it
+        /// is too small, it grows to a power of two rows.
+        void update_data_texture(std::shared_ptr<gfx::texture>& tex,
+                                 std::uint16_t                  width,
+                                 std::uint16_t                  height,
+                                 gfx::texture_format            format,
+                                 const std::vector<float>&      data)
+        {
+            if (!tex || tex->info.width != width || tex->info.height < height)
+            {
+                std::uint16_t rows = 1;
+                while (rows < height)
+                {
+                    rows <<= 1;
+                }
+                tex = std::make_shared<gfx::texture>(width, rows, false, 1, format, BGFX_SAMPLER_POINT | BGFX_SAMPLER_UVW_CLAMP);
+            }
+
+            const auto mem = gfx::copy(data.data(), static_cast<std::uint32_t>(data.size() * sizeof(float)));
+            gfx::update_texture_2d(tex->native_handle(), 0, 0, 0, 0, width, height, mem);
+        }
+
+        /// Size in pixels of a shadow map face. Cascades and spot lights get one
+        /// face each, point lights six smaller ones.
+        constexpr std::uint16_t directional_shadow_size = 1024;
+        constexpr std::uint16_t spot_shadow_size        = 1024;
+        constexpr std::uint16_t point_shadow_size       = 512;
+        /// Cascades cover the view up to this distance at most.
+        constexpr float max_shadow_distance = 200.0f;
+        /// Distance behind a cascade still searched for casters of directional lights.
+        constexpr float directional_caster_distance = 100.0f;
+        /// Near clip of the spot and point light faces.
+        constexpr float shadow_near_clip = 0.1f;
+        /// Depth bias of orthographic and perspective faces, in normalized depth.
+        constexpr float directional_depth_bias = 0.0005f;
+        constexpr float perspective_depth_bias = 0.0001f;
+
+        bool are_shadows_supported()
+        {
+            static const bool supported = gfx::is_supported(BGFX_CAPS_TEXTURE_COMPARE_LEQUAL) &&
+                                          gfx::is_format_supported(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER, gfx::texture_format::D16);
+            return supported;
+        }
+
+        /// Up vector of a face looking along direction.
+        math::vec3 get_shadow_up(const math::vec3& direction)
+        {
+            return math::abs(direction.y) > 0.99f ? math::vec3(1.0f, 0.0f, 0.0f) : math::vec3(0.0f, 1.0f, 0.0f);
+        }
+
+        light_shadow::face make_shadow_face(const camera& cam, std::uint16_t x, std::uint16_t y, std::uint16_t size)
+        {
+            light_shadow::face face;
+            face.view    = cam.get_view();
+            face.proj    = cam.get_projection();
+            face.frustum = cam.get_frustum();
+            face.x       = x;
+            face.y       = y;
+            face.size    = size;
+            return face;
+        }
+
+        /// Cascades of a directional light seen from a camera, laid out two per
+        /// atlas row. The splits blend the uniform and the logarithmic schemes by
+        /// split_distribution. Each cascade is fitted to a sphere around its slice
+        /// of the view, so that its size does not change when the camera turns,
+        /// and stabilized lights move it by whole texels. Returns the splits.
+        math::vec4
+        fit_directional_faces(const camera& view_camera, const light& l, const math::vec3& direction, std::vector<light_shadow::face>& faces)
+        {
+            const auto&         view_proj   = view_camera.get_projection();
+            const auto          inv_view    = math::inverse(view_camera.get_view());
+            const bool          perspective = view_camera.get_projection_mode() == projection_mode::perspective;
+            const float         near_clip   = math::max(view_camera.get_near_clip(), 0.01f);
+            const float         far_clip    = math::max(math::min(view_camera.get_far_clip(), max_shadow_distance), near_clip * 1.001f);
+            const float         lambda      = math::clamp(l.directional_data.split_distribution, 0.0f, 1.0f);
+            const std::uint32_t count       = math::clamp<std::uint32_t>(l.directional_data.num_splits, 1, 4);
+
+            // Basis the cascade centers are snapped in.
+            const auto up     = get_shadow_up(direction);
+            const auto axis_x = math::normalize(math::cross(up, direction));
+            const auto axis_y = math::cross(direction, axis_x);
+
+            math::vec4 splits(std::numeric_limits<float>::max());
+            float      z0 = near_clip;
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                const float t  = float(i + 1) / float(count);
+                const float z1 = math::mix(near_clip + (far_clip - near_clip) * t, near_clip * std::pow(far_clip / near_clip, t), lambda);
+                splits[i]      = z1;
+
+                // Squared distance of the slice corners to the view axis at both
+                // ends, orthographic views have the same one everywhere.
+                const float s0 = perspective ? z0 : 1.0f;
+                const float s1 = perspective ? z1 : 1.0f;
+                const float a2 = math::length2(math::vec2(s0 / view_proj[0][0], s0 / view_proj[1][1]));
+                const float b2 = math::length2(math::vec2(s1 / view_proj[0][0], s1 / view_proj[1][1]));
+
+                // Center on the axis as far from the near corners as from the far ones.
+                const float center = math::clamp((z1 * z1 - z0 * z0 + b2 - a2) / (2.0f * (z1 - z0)), z0, z1);
+                float       radius = math::sqrt(math::max((center - z0) * (center - z0) + a2, (z1 - center) * (z1 - center) + b2));
+                radius             = std::ceil(radius * 16.0f) / 16.0f;
+
+                auto position = inv_view.transform_coord(math::vec3(0.0f, 0.0f, center));
+                if (l.directional_data.stabilize)
+                {
+                    const float texel = 2.0f * radius / float(directional_shadow_size);
+                    const float x     = math::dot(position, axis_x);
+                    const float y     = math::dot(position, axis_y);
+                    position += axis_x * (std::floor(x / texel) * texel - x) + axis_y * (std::floor(y / texel) * texel - y);
+                }
+
+                const float distance = radius + directional_caster_distance;
+                camera      cam;
+                cam.set_projection_mode(projection_mode::orthographic);
+                cam.set_viewport_size(usize32_t(directional_shadow_size, directional_shadow_size));
+                cam.set_orthographic_size(radius);
+                cam.set_far_clip(distance + radius);
+                cam.set_near_clip(0.0f);
+                cam.look_at(position - direction * distance, position, up);
+
+                const auto x = std::uint16_t((i & 1) * directional_shadow_size);
+                const auto y = std::uint16_t((i >> 1) * directional_shadow_size);
+                faces.emplace_back(make_shadow_face(cam, x, y, directional_shadow_size));
+                z0 = z1;
+            }
+
+            return splits;
+        }
+
+        void fit_spot_face(const light& l, const math::vec3& position, const math::vec3& direction, std::vector<light_shadow::face>& faces)
+        {
+            camera cam;
+            cam.set_fov(math::clamp(l.spot_data.get_outer_angle(), 1.0f, 170.0f));
+            cam.set_aspect_ratio(1.0f, true);
+            cam.set_far_clip(l.spot_data.get_range());
+            cam.set_near_clip(shadow_near_clip);
+            cam.look_at(position, position + direction, get_shadow_up(direction));
+            faces.emplace_back(make_shadow_face(cam, 0, 0, spot_shadow_size));
+        }
+
+        /// Cube sides of a point light, aligned with the world axes and laid out
+        /// three per atlas row in the order the shaders pick them: +x, -x, +y,
+        /// -y, +z, -z.
+        void fit_point_faces(const light& l, const math::vec3& position, std::vector<light_shadow::face>& faces)
+        {
+            math::transform transform;
+            transform.set_position(position);
+
+            faces.resize(6);
+            for (std::uint32_t i = 0; i < 6; ++i)
+            {
+                auto cam = camera::get_face_camera(i, transform);
+                cam.set_far_clip(l.point_data.range);
+                cam.set_near_clip(shadow_near_clip);
+
+                // The up and down faces swap with the texture origin, go by the
+                // direction they look at.
+                const auto    forward = cam.z_unit_axis();
+                const auto    axis    = math::abs(forward);
+                std::uint32_t slot    = axis.x >= axis.y && axis.x >= axis.z ? 0 : (axis.y >= axis.z ? 2 : 4);
+                slot += forward[slot / 2] < 0.0f ? 1 : 0;
+
+                const auto x = std::uint16_t((slot % 3) * point_shadow_size);
+                const auto y = std::uint16_t((slot / 3) * point_shadow_size);
+                faces[slot]  = make_shadow_face(cam, x, y, point_shadow_size);
+            }
+        }
+
+        /// Creates the static shadow map of a light, again when the atlas size
+        /// changed. Returns true if it was.
+        bool update_shadow_map(light_shadow& shadow, const std::vector<light_shadow::face>& faces)
+        {
+            std::uint16_t width  = 0;
+            std::uint16_t height = 0;
+            for (const auto& face : faces)
+            {
+                width  = std::max<std::uint16_t>(width, face.x + face.size);
+                height = std::max<std::uint16_t>(height, face.y + face.size);
+            }
+
+            if (shadow.static_fbo && shadow.static_fbo->get_size() == usize32_t(width, height))
+                return false;
+
+            auto depth = std::make_shared<gfx::texture>(width,
+                                                        height,
+                                                        false,
+                                                        1,
+                                                        gfx::texture_format::D16,
+                                                        BGFX_TEXTURE_RT | BGFX_SAMPLER_COMPARE_LEQUAL | BGFX_SAMPLER_UVW_CLAMP);
+            shadow.static_fbo = std::make_shared<gfx::frame_buffer>(std::vector<std::shared_ptr<gfx::texture>> {depth});
+            shadow.dynamic_fbo.reset();
+            return true;
+        }
+
+        /// The dynamic shadow map receives a copy of the static one each frame.
+        void update_dynamic_shadow_map(light_shadow& shadow)
+        {
+            if (shadow.dynamic_fbo)
+                return;
+
+            const auto& info  = shadow.static_fbo->get_texture()->info;
+            const auto  flags = BGFX_TEXTURE_RT | BGFX_TEXTURE_BLIT_DST | BGFX_SAMPLER_COMPARE_LEQUAL | BGFX_SAMPLER_UVW_CLAMP;
+            auto        depth = std::make_shared<gfx::texture>(info.width, info.height, false, 1, gfx::texture_format::D16, flags);
+            shadow.dynamic_fbo = std::make_shared<gfx::frame_buffer>(std::vector<std::shared_ptr<gfx::texture>> {depth});
+        }
+
+        /// True if the world bounds of one of the changed shadow casters touch
+        /// frustum, see gather_shadow_views.
+        bool touches_shadow_casters(const math::bbox_soa& caster_bounds, const math::frustum& frustum, std::vector<std::uint32_t>& visible)
+        {
+            if (caster_bounds.empty())
+                return false;
+
+            frustum.test_aabbs(caster_bounds, visible);
+            return std::any_of(visible.begin(), visible.end(), [](std::uint32_t word) { return word != 0; });
+        }
+
+        /// Face matrices from world space to face uv and depth, face rects in the
+        /// atlas and filtering parameters of a shadow map, see fs_pbr_lighting.sh.
+        void set_shadow_uniforms(gpu_program& program, const light_shadow& shadow, bool pcf, float depth_bias)
+        {
+            const auto& uniforms = get_pass_uniforms();
+            const auto& map      = shadow.has_dynamic ? shadow.dynamic_fbo->get_texture() : shadow.static_fbo->get_texture();
+            const float width    = float(map->info.width);
+            const float height   = float(map->info.height);
+
+            // Clip space to texture space, rows go down unless the origin is at
+            // the bottom left.
+            const bool       bottom_left = gfx::is_origin_bottom_left();
+            const bool       homogeneous = gfx::is_homogeneous_depth();
+            const float      sy          = bottom_left ? 0.5f : -0.5f;
+            const float      sz          = homogeneous ? 0.5f : 1.0f;
+            const float      tz          = homogeneous ? 0.5f : 0.0f;
+            const math::mat4 crop(0.5f, 0.0f, 0.0f, 0.0f, 0.0f, sy, 0.0f, 0.0f, 0.0f, 0.0f, sz, 0.0f, 0.5f, 0.5f, tz, 1.0f);
+
+            math::mat4 matrices[6];
+            math::vec4 rects[6];
+            const auto count = std::min<std::size_t>(shadow.faces.size(), 6);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const auto& face = shadow.faces[i];
+                const float top  = bottom_left ? height - float(face.y + face.size) : float(face.y);
+                matrices[i]      = crop * face.proj.get_matrix() * face.view.get_matrix();
+                rects[i]         = math::vec4(float(face.x) / width, top / height, float(face.size) / width, float(face.size) / height);
+            }
+
+            const float face_size = count > 0 ? float(shadow.faces[0].size) : 1.0f;
+            float       params[4] = {depth_bias, face_size, pcf ? 1.0f : 0.0f, float(count)};
+            program.set_texture(7, uniforms.shadow_map, map.get());
+            program.set_uniform(uniforms.shadow_matrix, matrices, std::uint16_t(count));
+            program.set_uniform(uniforms.shadow_rect, rects, std::uint16_t(count));
+            program.set_uniform(uniforms.shadow_params, params);
+            program.set_uniform(uniforms.shadow_splits, shadow.splits);
+        }
+    } // namespace
+
+    //-----------------------------------------------------------------------------
+    //  Name : compute_screen_coverage ()
+    /// <summary>
+    /// Percent of the viewport height covered by each world space sphere. Uses
+    /// the vertical projection scale and the view depth of the centers, one
+    /// dot product per sphere instead of projecting eight box corners.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void compute_screen_coverage(const camera& cam, const math::bsphere_soa& spheres, std::vector<float>& coverage)
+    {
+        const auto& view        = cam.get_view().get_matrix();
+        const float scale       = cam.get_projection()[1][1] * 100.0f;
+        const bool  perspective = cam.get_projection_mode() == projection_mode::perspective;
+
+        // Row of the view matrix giving the depth.
+        const float zx = view[0][2];
+        const float zy = view[1][2];
+        const float zz = view[2][2];
+        const float zw = view[3][2];
+
+        const auto count = spheres.size();
+        coverage.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            float percent = spheres.radius[i] * scale;
+            if (perspective)
+            {
+                // Spheres reaching the camera plane cover everything.
+                const float z = zx * spheres.x[i] + zy * spheres.y[i] + zz * spheres.z[i] + zw;
+                percent       = z > spheres.radius[i] ? percent / z : 100.0f;
+            }
+            coverage[i] = math::min(percent, 100.0f);
+        }
+    }
 
     bool update_lod_data(lod_data&                      data,
                          const std::vector<urange32_t>& lod_limits,
                          std::size_t                    total_lods,
                          float                          transition_time,
                          float                          dt,
-                         asset_handle<mesh>             mesh,
-                         const math::transform&         world,
-                         const camera&                  cam)
+                         float                          percent)
     {
-        if (!mesh)
-            return false;
-
         if (total_lods <= 1)
             return true;
 
-        const auto& viewport = cam.get_viewport_size();
-        irect32_t   rect     = mesh->calculate_screen_rect(world, cam);
-
-        float percent = math::clamp((float(rect.height()) / float(viewport.height)) * 100.0f, 0.0f, 100.0f);
-
         std::size_t lod = 0;
         for (size_t i = 0; i < lod_limits.size(); ++i)
         {
@@ -71,240 +400,843 @@ namespace runtime
         return true;
     }
 
-    bool should_rebuild_reflections(visibility_set_models_t& visibility_set, const reflection_probe& probe)
+    //-----------------------------------------------------------------------------
+    //  Name : get_probe_capture_range ()
+    /// <summary>
+    /// Far clip of the probe faces, they capture a cube of that half size
+    /// around the probe.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    float get_probe_capture_range(const reflection_probe& probe) { return probe.box_data.extents.r; }
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_probe_faces ()
+    /// <summary>
+    /// Faces of a probe that see part of a world space box. Each face sees the
+    /// pyramid from the probe through its side of the cube, the box is brought
+    /// into the probe's frame and tested against the six pyramids, which costs
+    /// a few compares instead of six frustum tests.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::uint8_t get_probe_faces(const math::transform& probe_transform, const math::bbox& bounds)
     {
-        if (probe.method == reflect_method::environment)
-            return false;
-
-        for (auto& element : visibility_set)
+        const math::vec3 axes[3] = {math::normalize(probe_transform.x_unit_axis()),
+                                    math::normalize(probe_transform.y_unit_axis()),
+                                    math::normalize(probe_transform.z_unit_axis())};
+        const auto       center  = bounds.get_center() - probe_transform.get_position();
+        const auto       extents = bounds.get_extents();
+
+        math::vec3 min;
+        math::vec3 max;
+        for (int i = 0; i < 3; ++i)
         {
-            auto& transform_comp_handle = std::get<1>(element);
-            auto& model_comp_handle     = std::get<2>(element);
-            auto  transform_comp_ptr    = transform_comp_handle.lock();
-            auto  model_comp_ptr        = model_comp_handle.lock();
-            if (!transform_comp_ptr || !model_comp_ptr)
-                continue;
+            const float c = math::dot(center, axes[i]);
+            const float e = math::dot(extents, math::abs(axes[i]));
+            min[i]        = c - e;
+            max[i]        = c + e;
+        }
 
-            auto& transform_comp_ref = *transform_comp_ptr.get();
-            auto& model_comp_ref     = *model_comp_ptr.get();
+        // Distance of the box to the plane through the probe across an axis.
+        const auto gap = [&min, &max](int axis) { return min[axis] > 0.0f ? min[axis] : (max[axis] < 0.0f ? -max[axis] : 0.0f); };
+        // The face looking along an axis sees the box if it reaches far enough
+        // along it to get past the box's gap on the two other axes.
+        const auto sees = [&gap](int axis, float reach) {
+            return std::uint8_t(reach >= 0.0f && reach >= gap((axis + 1) % 3) && reach >= gap((axis + 2) % 3) ? 1 : 0);
+        };
+
+        // Faces 2 and 3 look up and down, or down and up with the origin at the
+        // bottom left, see camera::get_face_camera.
+        const bool         bottom_left = gfx::is_origin_bottom_left();
+        const std::uint8_t up          = sees(1, max.y);
+        const std::uint8_t down        = sees(1, -min.y);
+
+        std::uint8_t faces = 0;
+        faces |= sees(0, max.x) << 0;
+        faces |= sees(0, -min.x) << 1;
+        faces |= (bottom_left ? down : up) << 2;
+        faces |= (bottom_left ? up : down) << 3;
+        faces |= sees(2, max.z) << 4;
+        faces |= sees(2, -min.z) << 5;
+        return faces;
+    }
 
-            const auto& model = model_comp_ref.get_model();
-            if (!model.is_valid())
-                continue;
+    camera get_probe_face_camera(std::uint32_t face, const math::transform& world_transform, reflection_probe_component& reflection_probe_comp)
+    {
+        auto camera = camera::get_face_camera(face, world_transform);
+        camera.set_far_clip(get_probe_capture_range(reflection_probe_comp.get_probe()));
+        camera.set_viewport_size(usize32_t(reflection_probe_comp.get_cubemap_fbo()->get_size()));
+        return camera;
+    }
 
-            const auto mesh = model.get_lod(0);
+    visibility_set_models_t deferred_rendering::gather_visible_models(entity_component_system& ecs,
+                                                                      camera*                  camera,
+                                                                      bool                     dirty_only /* = false*/,
+                                                                      bool                     static_only /*= true*/,
+                                                                      bool                     require_reflection_caster /*= false*/)
+    {
+        return gather_frustum_models(ecs, camera ? &camera->get_frustum() : nullptr, dirty_only, static_only, require_reflection_caster);
+    }
 
-            const auto& world_transform = transform_comp_ref.get_transform();
+    visibility_set_models_t deferred_rendering::gather_frustum_models(entity_component_system& ecs,
+                                                                      const math::frustum*     frustum,
+                                                                      bool                     dirty_only,
+                                                                      bool                     static_only,
+                                                                      bool                     require_reflection_caster)
+    {
+        if (frustum && core::has_subsystems<spatial_index>() && core::get_subsystem<spatial_index>().is_built())
+        {
+            // Only the entities whose world bounds reach the frustum are looked at.
+            std::vector<entity> visible;
+            core::get_subsystem<spatial_index>().cull(*frustum, visible);
 
-            const auto& bounds = mesh->get_bounds();
+            visibility_set_models_t result;
+            result.reserve(visible.size());
+            for (auto& e : visible)
+            {
+                ecs.visit<transform_component, const model_component>(
+                    e, [&](entity, transform_component& transform_comp, const model_component& model_comp) {
+                        if (static_only && !model_comp.is_static())
+                        {
+                            return;
+                        }
 
-            bool result = false;
+                        if (require_reflection_caster && !model_comp.casts_reflection())
+                        {
+                            return;
+                        }
 
-            for (std::uint32_t i = 0; i < 6; ++i)
-            {
-                const auto& frustum = camera::get_face_camera(i, world_transform).get_frustum();
-                result |= math::frustum::test_obb(frustum, bounds, world_transform);
-            }
+                        // Only dirty mesh components.
+                        if (dirty_only && !transform_comp.is_touched() && !model_comp.is_touched())
+                        {
+                            return;
+                        }
 
-            if (result)
-                return true;
+                        // If mesh isnt loaded yet skip it.
+                        if (!model_comp.get_model().get_lod(0))
+                        {
+                            return;
+                        }
+
+                        transform_comp.resolve();
+                        result.emplace_back(e, &transform_comp, &model_comp);
+                    });
+            }
+            return result;
         }
 
-        return false;
+        // World transforms and the frustum are resolved lazily, settle them here
+        // so the parallel pass below only reads them.
+        ecs.query<transform_component, const model_component>().each(
+            [](entity e, transform_component& transform_comp, const model_component& model_comp) { transform_comp.resolve(); });
+
+        return ecs.query<const transform_component, const model_component>().parallel_collect<visibility_set_models_t::value_type>(
+            [frustum, dirty_only, static_only, require_reflection_caster](
+                visibility_set_models_t& result, entity e, const transform_component& transform_comp, const model_component& model_comp) {
+                if (static_only && !model_comp.is_static())
+                {
+                    return;
+                }
+
+                if (require_reflection_caster && !model_comp.casts_reflection())
+                {
+                    return;
+                }
+
+                auto mesh = model_comp.get_model().get_lod(0);
+
+                // If mesh isnt loaded yet skip it.
+                if (!mesh)
+                    return;
+
+                if (frustum)
+                {
+                    const auto& world_transform = transform_comp.get_transform();
+
+                    const auto& bounds = mesh->get_bounds();
+
+                    // Test the bounding box of the mesh
+                    if (!math::frustum::test_obb(*frustum, bounds, world_transform))
+                    {
+                        return;
+                    }
+                }
+
+                // Only dirty mesh components.
+                if (dirty_only && !transform_comp.is_touched() && !model_comp.is_touched())
+                {
+                    return;
+                }
+
+                result.emplace_back(e, &transform_comp, &model_comp);
+            },
+            128);
     }
 
-    bool should_rebuild_shadows(visibility_set_models_t& visibility_set, const light&)
+    visibility_set_models_t deferred_rendering::gather_changed_models(entity_component_system& ecs)
     {
-        //	for(auto& element : visibility_set)
-        //	{
-        //		auto& transform_comp_handle = std::get<1>(element);
-        //		auto& model_comp_handle = std::get<2>(element);
-        //		auto transform_comp_ptr = transform_comp_handle.lock();
-        //		auto model_comp_ptr = model_comp_handle.lock();
-        //		if(!transform_comp_ptr || !model_comp_ptr)
-        //			continue;
+        stale_shadow_bounds_.clear();
+        stale_reflection_bounds_.clear();
+
+        // Finds whether an entity is a static caster now and where, and retires
+        // the bounds it was last seen at when it moved, stopped casting or went
+        // away, so the cached shadow maps and probes drop what they captured.
+        const auto track = [this](entity e) -> std::pair<transform_component*, model_component*> {
+            std::shared_ptr<transform_component> transform_comp_ptr;
+            std::shared_ptr<model_component>     model_comp_ptr;
+            if (e.valid())
+            {
+                transform_comp_ptr = e.get_component<transform_component>().lock();
+                model_comp_ptr     = e.get_component<model_component>().lock();
+            }
 
-        //		auto& transform_comp_ref = *transform_comp_ptr.get();
-        //		auto& model_comp_ref = *model_comp_ptr.get();
+            static_caster current;
+            // If mesh isnt loaded yet it is no caster either.
+            if (transform_comp_ptr && model_comp_ptr && model_comp_ptr->is_static() && model_comp_ptr->get_model().get_lod(0))
+            {
+                current.shadow     = model_comp_ptr->casts_shadow();
+                current.reflection = model_comp_ptr->casts_reflection();
+            }
 
-        //		const auto& model = model_comp_ref.get_model();
-        //		if(!model.is_valid())
-        //			continue;
+            if (current.shadow || current.reflection)
+            {
+                transform_comp_ptr->resolve();
+                current.bounds = math::bbox::mul(model_comp_ptr->get_model().get_lod(0)->get_bounds(), transform_comp_ptr->get_transform());
+            }
 
-        //		const auto mesh = model.get_lod(0);
+            auto it = static_casters_.find(e);
+            if (it != static_casters_.end())
+            {
+                const auto& previous = it->second;
+                const bool  moved    = !(previous.bounds == current.bounds);
+                if (previous.shadow && (moved || !current.shadow))
+                    stale_shadow_bounds_.push_back(previous.bounds);
+                if (previous.reflection && (moved || !current.reflection))
+                    stale_reflection_bounds_.push_back(previous.bounds);
+            }
 
-        //		const auto& world_transform = transform_comp_ref.get_transform();
-        //		const auto& bounds = mesh->get_bounds();
+            if (!current.shadow && !current.reflection)
+            {
+                if (it != static_casters_.end())
+                    static_casters_.erase(it);
+                return {nullptr, nullptr};
+            }
 
-        //		bool result = false;
+            static_casters_[e] = current;
+            return {transform_comp_ptr.get(), model_comp_ptr.get()};
+        };
 
-        //		// for(std::uint32_t i = 0; i < 6; ++i)
-        //		//{
-        //		//	const auto& frustum = camera::get_face_camera(i, world_transform).get_frustum();
-        //		//	result |= math::frustum::test_obb(frustum, bounds, world_transform);
-        //		//}
+        // Removals count too, a removed caster leaves its bounds behind.
+        std::vector<entity> changed;
+        auto                collect = [&changed](entity e, change_kind) { changed.emplace_back(e); };
 
-        //		if(result)
-        //			return true;
-        //	}
+        bool complete = ecs.for_each_change<transform_component>(transform_changes_, collect);
+        complete &= ecs.for_each_change<model_component>(model_changes_, collect);
+        if (!complete)
+        {
+            // Fell behind the journals, look at everything touched last frame,
+            // and at every caster seen before for the ones that went away.
+            auto result = gather_visible_models(ecs, nullptr, true, true, false);
+            for (const auto& entry : static_casters_)
+            {
+                changed.emplace_back(entry.first);
+            }
+            for (const auto& element : result)
+            {
+                changed.emplace_back(std::get<0>(element));
+            }
+            std::sort(changed.begin(), changed.end());
+            changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+            for (auto& e : changed)
+            {
+                track(e);
+            }
+            return result;
+        }
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
 
-        return false;
+        visibility_set_models_t result;
+        for (auto& e : changed)
+        {
+            const auto caster = track(e);
+            if (caster.first)
+                result.emplace_back(e, caster.first, caster.second);
+        }
+
+        return result;
     }
 
-    visibility_set_models_t deferred_rendering::gather_visible_models(entity_component_system& ecs,
-                                                                      camera*                  camera,
-                                                                      bool                     dirty_only /* = false*/,
-                                                                      bool                     static_only /*= true*/,
-                                                                      bool                     require_reflection_caster /*= false*/)
+    void deferred_rendering::gather_views(entity_component_system& ecs, visibility_set_models_t& dirty_models)
+    {
+        views_.clear();
+
+        gather_probe_views(ecs, dirty_models);
+
+        ecs.for_each<camera_component>([this](entity ce, camera_component& camera_comp) {
+            view_visibility view;
+            view.owner   = ce;
+            view.frustum = camera_comp.get_camera().get_frustum();
+            views_.emplace_back(std::move(view));
+        });
+
+        gather_shadow_views(ecs, dirty_models);
+    }
+
+    void deferred_rendering::gather_probe_views(entity_component_system& ecs, visibility_set_models_t& dirty_models)
     {
-        visibility_set_models_t      result;
-        chandle<transform_component> transform_comp_handle;
-        chandle<model_component>     model_comp_handle;
-        for (auto entity : ecs.entities_with_components(transform_comp_handle, model_comp_handle))
+        ++frame_index_;
+
+        struct candidate
         {
-            auto model_comp_ptr     = model_comp_handle.lock();
-            auto transform_comp_ptr = transform_comp_handle.lock();
+            entity                      owner;
+            transform_component*        transform_comp;
+            reflection_probe_component* probe_comp;
+            float                       priority;
+        };
+        std::vector<candidate> candidates;
+
+        std::vector<math::vec3> camera_positions;
+        ecs.for_each<camera_component>([&camera_positions](entity ce, camera_component& camera_comp) {
+            camera_positions.emplace_back(camera_comp.get_camera().get_position());
+        });
 
-            if (static_only && !model_comp_ptr->is_static())
-            {
-                continue;
-            }
+        // Capture volumes of the probes that look at models, kept in a tree so
+        // that each changed model is looked up once instead of being tested
+        // against every probe.
+        ecs.for_each<transform_component, reflection_probe_component>(
+            [this](entity ce, transform_component& transform_comp, reflection_probe_component& reflection_probe_comp) {
+                const auto& probe  = reflection_probe_comp.get_probe();
+                auto&       update = probe_updates_[ce];
+                update.transform   = transform_comp.get_transform();
+                update.seen_frame  = frame_index_;
 
-            if (require_reflection_caster && !model_comp_ptr->casts_reflection())
+                if (probe.method == reflect_method::environment)
+                {
+                    if (update.leaf != math::aabb_tree::null_node)
+                    {
+                        probe_index_.remove(update.leaf);
+                        update.leaf = math::aabb_tree::null_node;
+                    }
+                    return;
+                }
+
+                const auto range  = math::vec3(get_probe_capture_range(probe));
+                const auto center = update.transform.get_position();
+                const auto bounds = math::bbox(center - range, center + range);
+                if (update.leaf == math::aabb_tree::null_node)
+                {
+                    const auto slot = ce.id().index();
+                    if (slot >= probe_index_owners_.size())
+                    {
+                        probe_index_owners_.resize(slot + 1);
+                    }
+                    probe_index_owners_[slot] = ce;
+                    update.leaf               = probe_index_.insert(bounds, math::vec3(0.0f), slot);
+                }
+                else if (transform_comp.is_touched() || reflection_probe_comp.is_touched())
+                {
+                    probe_index_.move(update.leaf, bounds, math::vec3(0.0f));
+                }
+            });
+
+        // Probes whose component was removed, their capture volume must not
+        // answer the queries below and their staging cubemap is released.
+        for (auto it = probe_updates_.begin(); it != probe_updates_.end();)
+        {
+            if (it->second.seen_frame == frame_index_)
             {
+                ++it;
                 continue;
             }
 
-            auto mesh = model_comp_ptr->get_model().get_lod(0);
+            if (it->second.leaf != math::aabb_tree::null_node)
+                probe_index_.remove(it->second.leaf);
+            it = probe_updates_.erase(it);
+        }
 
-            // If mesh isnt loaded yet skip it.
+        const auto invalidate_faces = [this](const math::bbox& bounds) {
+            probe_index_.query(bounds, [this, &bounds](std::uint32_t slot) {
+                auto& update = probe_updates_[probe_index_owners_[slot]];
+                update.invalid_faces |= get_probe_faces(update.transform, bounds);
+            });
+        };
+
+        for (const auto& element : dirty_models)
+        {
+            // Changed shadow casters are in the set as well.
+            const auto& model_comp_ref = *std::get<2>(element);
+            if (!model_comp_ref.casts_reflection())
+                continue;
+
+            const auto mesh = model_comp_ref.get_model().get_lod(0);
             if (!mesh)
                 continue;
 
-            if (camera)
-            {
-                const auto& frustum = camera->get_frustum();
+            invalidate_faces(math::bbox::mul(mesh->get_bounds(), std::get<1>(element)->get_transform()));
+        }
 
-                const auto& world_transform = transform_comp_ptr->get_transform();
+        // Where moved and removed casters were before.
+        for (const auto& bounds : stale_reflection_bounds_)
+        {
+            invalidate_faces(bounds);
+        }
 
-                const auto& bounds = mesh->get_bounds();
+        ecs.for_each<transform_component, reflection_probe_component>(
+            [this, &candidates, &camera_positions](
+                entity ce, transform_component& transform_comp, reflection_probe_component& reflection_probe_comp) {
+                auto&        update = probe_updates_[ce];
+                std::uint8_t faces  = update.invalid_faces;
+                if (transform_comp.is_touched() || reflection_probe_comp.is_touched())
+                {
+                    faces = 0x3f;
+                }
+                update.invalid_faces = 0;
 
-                // Test the bounding box of the mesh
-                if (math::frustum::test_obb(frustum, bounds, world_transform))
+                if (faces != 0)
                 {
-                    // Only dirty mesh components.
-                    if (dirty_only)
+                    // A running update finishes first, so that the probe keeps
+                    // getting complete cubemaps while its surroundings change.
+                    if (update.pending_faces != 0)
                     {
-                        if (transform_comp_ptr->is_touched() || model_comp_ptr->is_touched())
-                        {
-                            result.emplace_back(entity, transform_comp_handle, model_comp_handle);
-                        }
-                    } // End if dirty_only
+                        update.restart_faces |= faces;
+                    }
                     else
                     {
-                        result.emplace_back(std::make_tuple(entity, transform_comp_handle, model_comp_handle));
+                        update.pending_faces = faces;
+                        update.update_faces  = faces;
+                        update.request_frame = frame_index_;
+                    }
+                }
+
+                if (update.pending_faces == 0)
+                    return;
+
+                float distance = 0.0f;
+                if (!camera_positions.empty())
+                {
+                    distance = std::numeric_limits<float>::max();
+                    for (const auto& position : camera_positions)
+                    {
+                        distance = math::min(distance, math::distance(position, transform_comp.get_transform().get_position()));
                     }
+                }
+
+                // Near probes go first, waiting ones catch up frame after frame.
+                const float staleness = float(frame_index_ - update.request_frame);
+                candidates.push_back({ce, &transform_comp, &reflection_probe_comp, distance / (1.0f + staleness)});
+            });
+
+        std::sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) { return a.priority < b.priority; });
 
-                } // Enf if visble
+        // Faces of a probe are taken together, so that fewer updates are in
+        // flight and each one completes sooner.
+        std::uint32_t budget = probe_face_budget_;
+        for (const auto& c : candidates)
+        {
+            const auto& update = probe_updates_[c.owner];
+            const auto& probe  = c.probe_comp->get_probe();
+            for (std::uint32_t i = 0; i < 6 && budget > 0; ++i)
+            {
+                if ((update.pending_faces & (1u << i)) == 0)
+                    continue;
+
+                view_visibility view;
+                view.owner                     = c.owner;
+                view.face                      = i;
+                view.frustum                   = get_probe_face_camera(i, c.transform_comp->get_transform(), *c.probe_comp).get_frustum();
+                view.static_only               = true;
+                view.require_reflection_caster = true;
+                view.gather_models             = probe.method != reflect_method::environment;
+                views_.emplace_back(std::move(view));
+                --budget;
             }
-            else
+
+            if (budget == 0)
+                break;
+        }
+    }
+
+    void deferred_rendering::gather_shadow_views(entity_component_system& ecs, visibility_set_models_t& dirty_models)
+    {
+        for (auto& light_shadows : shadows_)
+        {
+            for (auto& entry : light_shadows.second)
             {
-                // Only dirty mesh components.
-                if (dirty_only)
+                entry.second.active = false;
+            }
+        }
+
+        // Without blits the dynamic casters can not be drawn over a copy of the
+        // cached maps, all casters are drawn every frame then.
+        const bool supported = are_shadows_supported() && shadow_program_ && shadow_skinned_program_;
+        const bool cache     = gfx::is_supported(BGFX_CAPS_TEXTURE_BLIT);
+
+        std::vector<std::pair<entity, const camera*>> cameras;
+        ecs.for_each<camera_component>([&cameras](entity ce, camera_component& camera_comp) { cameras.emplace_back(ce, &camera_comp.get_camera()); });
+
+        // World bounds of the changed casters, and of where moved and removed
+        // ones were, found once and tested against every cached face at once.
+        shadow_caster_bounds_.clear();
+        for (const auto& element : dirty_models)
+        {
+            const auto& model_comp_ref = *std::get<2>(element);
+            if (!model_comp_ref.casts_shadow())
+                continue;
+
+            const auto mesh = model_comp_ref.get_model().get_lod(0);
+            if (!mesh)
+                continue;
+
+            shadow_caster_bounds_.push_back(math::bbox::mul(mesh->get_bounds(), std::get<1>(element)->get_transform()));
+        }
+        for (const auto& bounds : stale_shadow_bounds_)
+        {
+            shadow_caster_bounds_.push_back(bounds);
+        }
+
+        std::vector<light_shadow::face> faces;
+        auto add_views = [this, &faces, cache](entity owner, light_shadow& shadow, bool touched) {
+            const bool recreated = update_shadow_map(shadow, faces);
+            for (std::size_t i = 0; i < faces.size(); ++i)
+            {
+                auto& face = faces[i];
+                if (cache && !touched && !recreated && i < shadow.faces.size())
                 {
-                    if (transform_comp_ptr->is_touched() || model_comp_ptr->is_touched())
+                    const auto& previous = shadow.faces[i];
+                    face.cached          = previous.cached && previous.view.is_equal(face.view) && previous.proj.is_equal(face.proj) &&
+                                  !touches_shadow_casters(shadow_caster_bounds_, face.frustum, shadow_caster_mask_);
+                }
+
+                view_visibility view;
+                view.owner                 = owner;
+                view.face                  = std::uint32_t(i);
+                view.frustum               = face.frustum;
+                view.require_shadow_caster = true;
+                view.dynamic_only          = face.cached;
+                face.visibility            = std::int32_t(views_.size());
+                views_.emplace_back(std::move(view));
+            }
+
+            shadow.faces.swap(faces);
+            shadow.active = true;
+        };
+
+        ecs.for_each<transform_component, light_component>(
+            [this, &cameras, &faces, &add_views, supported](entity e, transform_component& transform_comp, light_component& light_comp) {
+                const auto& light = light_comp.get_light();
+                if (!supported || !light.casts_shadows)
+                    return;
+
+                const auto& world_transform = transform_comp.get_transform();
+                const auto  position        = world_transform.get_position();
+                const auto  direction       = world_transform.z_unit_axis();
+                const bool  touched         = transform_comp.is_touched() || light_comp.is_touched();
+
+                if (light.type == light_type::directional)
+                {
+                    for (const auto& camera_entry : cameras)
                     {
-                        result.emplace_back(std::make_tuple(entity, transform_comp_handle, model_comp_handle));
+                        auto& shadow = shadows_[e][camera_entry.first];
+                        faces.clear();
+                        shadow.splits = fit_directional_faces(*camera_entry.second, light, direction, faces);
+                        add_views(e, shadow, touched);
                     }
-                } // End if dirty_only
+                    return;
+                }
+
+                faces.clear();
+                if (light.type == light_type::spot)
+                    fit_spot_face(light, position, direction, faces);
                 else
+                    fit_point_faces(light, position, faces);
+
+                add_views(e, shadows_[e][entity()], touched);
+            });
+
+        // Lights that stopped casting shadows and cameras that went away.
+        for (auto it = shadows_.begin(); it != shadows_.end();)
+        {
+            auto& light_shadows = it->second;
+            for (auto shadow = light_shadows.begin(); shadow != light_shadows.end();)
+            {
+                shadow = shadow->second.active ? std::next(shadow) : light_shadows.erase(shadow);
+            }
+            it = light_shadows.empty() ? shadows_.erase(it) : std::next(it);
+        }
+    }
+
+    void deferred_rendering::cull_views(entity_component_system& ecs)
+    {
+        if (!core::has_subsystems<spatial_index>() || !core::get_subsystem<spatial_index>().is_built())
+        {
+            for (auto& view : views_)
+            {
+                if (view.gather_models)
                 {
-                    result.emplace_back(std::make_tuple(entity, transform_comp_handle, model_comp_handle));
+                    view.visible = gather_frustum_models(ecs, &view.frustum, false, view.static_only, view.require_reflection_caster);
+                }
+
+                if (view.require_shadow_caster || view.dynamic_only)
+                {
+                    auto& visible = view.visible;
+                    visible.erase(std::remove_if(visible.begin(),
+                                                 visible.end(),
+                                                 [&view](const visibility_set_models_t::value_type& element) {
+                                                     const auto& model_comp = *std::get<2>(element);
+                                                     return (view.require_shadow_caster && !model_comp.casts_shadow()) ||
+                                                            (view.dynamic_only && model_comp.is_static());
+                                                 }),
+                                  visible.end());
                 }
             }
+            return;
         }
-        return result;
+
+        // Every view walks the shared index on its own worker. Nothing is
+        // written to the components there, the few transforms that still need
+        // resolving are collected and resolved afterwards.
+        const auto&                                    index = core::get_subsystem<spatial_index>();
+        std::vector<std::vector<transform_component*>> unresolved(views_.size());
+        runtime::ecs::parallel_for(views_.size(), 1, [this, &ecs, &index, &unresolved](std::size_t begin, std::size_t end) {
+            std::vector<entity> candidates;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                auto& view = views_[i];
+                view.visible.clear();
+                if (!view.gather_models)
+                    continue;
+
+                candidates.clear();
+                index.cull(view.frustum, candidates);
+
+                view.visible.reserve(candidates.size());
+                for (auto& e : candidates)
+                {
+                    ecs.visit<transform_component, const model_component>(
+                        e, [&view, &unresolved, &e, i](entity, transform_component& transform_comp, const model_component& model_comp) {
+                            if (view.static_only && !model_comp.is_static())
+                                return;
+
+                            if (view.require_reflection_caster && !model_comp.casts_reflection())
+                                return;
+
+                            if (view.require_shadow_caster && !model_comp.casts_shadow())
+                                return;
+
+                            if (view.dynamic_only && model_comp.is_static())
+                                return;
+
+                            // If mesh isnt loaded yet skip it.
+                            if (!model_comp.get_model().get_lod(0))
+                                return;
+
+                            if (transform_comp.is_dirty())
+                                unresolved[i].push_back(&transform_comp);
+
+                            view.visible.emplace_back(e, &transform_comp, &model_comp);
+                        });
+                }
+            }
+        });
+
+        for (auto& transforms : unresolved)
+        {
+            for (auto transform_comp : transforms)
+            {
+                transform_comp->resolve();
+            }
+        }
+    }
+
+    view_visibility* deferred_rendering::find_view(entity owner, std::uint32_t face)
+    {
+        auto it = std::find_if(
+            views_.begin(), views_.end(), [&owner, face](const view_visibility& view) { return view.owner == owner && view.face == face; });
+        return it == views_.end() ? nullptr : &*it;
     }
 
     void deferred_rendering::frame_render(float dt)
     {
         auto& ecs = core::get_subsystem<entity_component_system>();
 
-        build_reflections_pass(ecs, dt);
+        // Transient targets no view took last frame are gone for good.
+        frame_graph_pool_.release_unused();
+
+        auto dirty_models = gather_changed_models(ecs);
+        gather_views(ecs, dirty_models);
+        cull_views(ecs);
+
+        // Shadow maps first, the reflection probes are lit with them.
         build_shadows_pass(ecs, dt);
+        build_reflections_pass(ecs, dt);
         camera_pass(ecs, dt);
     }
 
     void deferred_rendering::build_reflections_pass(entity_component_system& ecs, float dt)
     {
-        auto dirty_models = gather_visible_models(ecs, nullptr, true, true, true);
         ecs.for_each<transform_component, reflection_probe_component>(
-            [this, &ecs, dt, &dirty_models](entity ce, transform_component& transform_comp, reflection_probe_component& reflection_probe_comp) {
+            [this, &ecs, dt](entity ce, transform_component& transform_comp, reflection_probe_component& reflection_probe_comp) {
+                auto it = probe_updates_.find(ce);
+                if (it == probe_updates_.end() || it->second.pending_faces == 0)
+                    return;
+
+                auto&       update         = it->second;
                 const auto& world_tranform = transform_comp.get_transform();
-                const auto& probe          = reflection_probe_comp.get_probe();
+                update.staging             = reflection_probe_comp.get_staging_cubemap();
 
-                auto cubemap_fbo    = reflection_probe_comp.get_cubemap_fbo();
-                bool should_rebuild = true;
+                auto& probe_lods = lod_data_[ce];
+                probe_lods.resize(6);
 
-                if (!transform_comp.is_touched() && !reflection_probe_comp.is_touched())
+                // Only the faces scheduled for this frame got views.
+                for (std::uint32_t i = 0; i < 6; ++i)
                 {
-                    // If reflections shouldn't be rebuilt - continue.
-                    should_rebuild = should_rebuild_reflections(dirty_models, probe);
+                    auto view = find_view(ce, i);
+                    if (!view)
+                        continue;
+
+                    auto  camera      = get_probe_face_camera(i, world_tranform, reflection_probe_comp);
+                    auto& render_view = reflection_probe_comp.get_render_view(i);
+
+                    deferred_render_full(camera, render_view, ecs, ce, view->visible, probe_lods[i], dt, update.staging.get(), std::uint16_t(i));
+                    update.pending_faces &= std::uint8_t(~(1u << i));
                 }
 
-                if (!should_rebuild)
+                if (update.pending_faces != 0)
                     return;
 
-                // iterate trough each cube face
-                for (std::uint32_t i = 0; i < 6; ++i)
+                // All faces are in, replace them in the cubemap and rebuild its mips.
+                auto             cubemap_fbo = reflection_probe_comp.get_cubemap_fbo();
+                gfx::render_pass copy_pass("cubemap_copy");
+                copy_pass.touch();
+                for (std::uint16_t i = 0; i < 6; ++i)
                 {
-                    auto camera = camera::get_face_camera(i, world_tranform);
-                    camera.set_far_clip(reflection_probe_comp.get_probe().box_data.extents.r);
-                    auto& render_view = reflection_probe_comp.get_render_view(i);
-                    camera.set_viewport_size(usize32_t(cubemap_fbo->get_size()));
-                    auto&                   camera_lods = lod_data_[ce];
-                    visibility_set_models_t visibility_set;
-
-                    if (probe.method != reflect_method::environment)
-                        visibility_set = gather_visible_models(ecs, &camera, !should_rebuild, true, true);
-
-                    std::shared_ptr<gfx::frame_buffer> output = nullptr;
-                    output                                    = g_buffer_pass(output, camera, render_view, visibility_set, camera_lods, dt);
-                    output                                    = lighting_pass(output, camera, render_view, ecs, dt);
-                    output                                    = atmospherics_pass(output, camera, render_view, ecs, dt);
-                    output                                    = tonemapping_pass(output, camera, render_view);
-
-                    gfx::render_pass pass("cubemap_fill");
-                    pass.touch();
-                    gfx::blit(
-                        pass.id, cubemap_fbo->get_texture()->native_handle(), 0, 0, 0, std::uint16_t(i), output->get_texture()->native_handle());
+                    if ((update.update_faces & (1u << i)) == 0)
+                        continue;
+
+                    gfx::blit(copy_pass.id, cubemap_fbo->get_texture()->native_handle(), 0, 0, 0, i, update.staging->native_handle(), 0, 0, 0, i);
                 }
 
                 gfx::render_pass pass("cubemap_generate_mips");
                 pass.bind(cubemap_fbo.get());
                 pass.touch();
+
+                update.staging.reset();
+                if (update.restart_faces != 0)
+                {
+                    update.pending_faces = update.restart_faces;
+                    update.update_faces  = update.restart_faces;
+                    update.request_frame = frame_index_;
+                    update.restart_faces = 0;
+                }
             });
     }
 
     void deferred_rendering::build_shadows_pass(entity_component_system& ecs, float dt)
     {
-        auto dirty_models = gather_visible_models(ecs, nullptr, true, true, true);
-        ecs.for_each<transform_component, light_component>(
-            [this, &ecs, dt, &dirty_models](entity ce, transform_component& transform_comp, light_component& light_comp) {
-                // const auto& world_tranform = transform_comp.get_transform();
-                const auto& light = light_comp.get_light();
+        const bool cache = gfx::is_supported(BGFX_CAPS_TEXTURE_BLIT);
+        for (auto& light_shadows : shadows_)
+        {
+            for (auto& entry : light_shadows.second)
+            {
+                auto& shadow       = entry.second;
+                shadow.has_dynamic = false;
+
+                // Faces that moved or that a changed static caster reaches. When
+                // nothing is cached the dynamic casters are drawn along.
+                for (auto& face : shadow.faces)
+                {
+                    if (face.cached)
+                        continue;
+
+                    render_shadow_casters(face, shadow.static_fbo.get(), true, !cache);
+                    face.cached = cache;
+                }
 
-                bool should_rebuild = true;
+                if (!cache)
+                    continue;
 
-                if (!transform_comp.is_touched() && !light_comp.is_touched())
+                const bool has_dynamic = std::any_of(shadow.faces.begin(), shadow.faces.end(), [this](const light_shadow::face& face) {
+                    const auto& visible = views_[std::size_t(face.visibility)].visible;
+                    return std::any_of(visible.begin(), visible.end(), [](const visibility_set_models_t::value_type& element) {
+                        return !std::get<2>(element)->is_static();
+                    });
+                });
+                if (!has_dynamic)
+                    continue;
+
+                update_dynamic_shadow_map(shadow);
+
+                gfx::render_pass pass("shadow_copy");
+                pass.touch();
+                gfx::blit(pass.id, shadow.dynamic_fbo->get_texture()->native_handle(), 0, 0, shadow.static_fbo->get_texture()->native_handle());
+
+                for (const auto& face : shadow.faces)
                 {
-                    // If shadows shouldn't be rebuilt - continue.
-                    should_rebuild = should_rebuild_shadows(dirty_models, light);
+                    render_shadow_casters(face, shadow.dynamic_fbo.get(), false, true);
                 }
+                shadow.has_dynamic = true;
+            }
+        }
+    }
 
-                if (!should_rebuild)
-                    return;
-            });
+    void deferred_rendering::render_shadow_casters(const light_shadow::face& face, const gfx::frame_buffer* fbo, bool draw_static, bool draw_dynamic)
+    {
+        const auto& visible = views_[std::size_t(face.visibility)].visible;
+
+        shadow_queue_.clear();
+        for (const auto& element : visible)
+        {
+            const auto& transform_comp_ref = *std::get<1>(element);
+            const auto& model_comp_ref     = *std::get<2>(element);
+            if (model_comp_ref.is_static() ? !draw_static : !draw_dynamic)
+                continue;
+
+            const auto& model = model_comp_ref.get_model();
+            if (!model.is_valid())
+                continue;
+
+            // Front to back in the face.
+            const auto& world_transform = transform_comp_ref.get_transform();
+            const auto  clip            = face.proj * math::vec4(face.view.transform_coord(world_transform.get_position()), 1.0f);
+            const auto  depth           = clip.w > 0.0f ? clip.z / clip.w : 0.0f;
+            model.enqueue(shadow_queue_,
+                          world_transform,
+                          model_comp_ref.get_bone_transforms(),
+                          true,
+                          true,
+                          true,
+                          0,
+                          0,
+                          depth,
+                          0,
+                          shadow_program_.get(),
+                          shadow_skinned_program_.get());
+        }
+
+        if (shadow_queue_.empty() && !draw_static)
+            return;
+
+        gfx::render_pass pass("shadow_fill");
+        pass.bind(fbo);
+        gfx::set_view_rect(pass.id, face.x, face.y, face.size, face.size);
+        gfx::set_view_scissor(pass.id, face.x, face.y, face.size, face.size);
+        pass.set_view_proj(face.view, face.proj);
+        if (draw_static)
+            pass.clear(BGFX_CLEAR_DEPTH, 0, 1.0f, 0);
+
+        shadow_queue_.sort();
+        shadow_queue_.submit(pass.id, [](gpu_program&, const render_queue::packet&) {});
+    }
+
+    const light_shadow* deferred_rendering::find_shadow(entity light, light_type type, entity view_owner) const
+    {
+        auto it = shadows_.find(light);
+        if (it == shadows_.end())
+            return nullptr;
+
+        auto shadow = it->second.find(type == light_type::directional ? view_owner : entity());
+        return shadow == it->second.end() ? nullptr : &shadow->second;
     }
 
     void deferred_rendering::camera_pass(entity_component_system& ecs, float dt)
@@ -313,71 +1245,200 @@ namespace runtime
             auto& camera_lods = lod_data_[ce];
             auto& camera      = camera_comp.get_camera();
             auto& render_view = camera_comp.get_render_view();
+            camera_lods.resize(1);
+
+            // Cameras added after the views were gathered are culled on their own.
+            visibility_set_models_t visibility_set;
+            auto                    view = find_view(ce);
+            if (view)
+                visibility_set = std::move(view->visible);
+            else
+                visibility_set = gather_visible_models(ecs, &camera, false, false, false);
 
-            auto output = deferred_render_full(camera, render_view, ecs, camera_lods, dt);
+            deferred_render_full(camera, render_view, ecs, ce, visibility_set, camera_lods[0], dt);
         });
     }
 
-    std::shared_ptr<gfx::frame_buffer> deferred_rendering::deferred_render_full(camera&                               camera,
-                                                                                gfx::render_view&                     render_view,
-                                                                                entity_component_system&              ecs,
-                                                                                std::unordered_map<entity, lod_data>& camera_lods,
-                                                                                float                                 dt)
+    void deferred_rendering::deferred_render_full(camera&                  camera,
+                                                  gfx::render_view&        render_view,
+                                                  entity_component_system& ecs,
+                                                  entity                   view_owner,
+                                                  visibility_set_models_t& visibility_set,
+                                                  view_lods&               camera_lods,
+                                                  float                    dt,
+                                                  gfx::texture*            probe_cubemap,
+                                                  std::uint16_t            probe_face)
     {
-        std::shared_ptr<gfx::frame_buffer> output = nullptr;
-
-        auto visibility_set = gather_visible_models(ecs, &camera, false, false, false);
-
-        output = g_buffer_pass(output, camera, render_view, visibility_set, camera_lods, dt);
-
-        output = reflection_probe_pass(output, camera, render_view, ecs, dt);
-
-        output = lighting_pass(output, camera, render_view, ecs, dt);
+        const bool is_probe = probe_cubemap != nullptr;
+
+        static auto color_format = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER,
+                                                        gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha);
+        static auto hdr_format   = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER,
+                                                      gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha |
+                                                          gfx::format_search_flags::half_precision_float);
+        static auto depth_format = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER, gfx::format_search_flags::requires_depth);
+
+        const auto&                     viewport_size = camera.get_viewport_size();
+        const auto                      width         = std::uint16_t(viewport_size.width);
+        const auto                      height        = std::uint16_t(viewport_size.height);
+        const frame_graph::texture_desc color_desc {width, height, color_format};
+        const frame_graph::texture_desc hdr_desc {width, height, hdr_format};
+        const frame_graph::texture_desc depth_desc {width, height, depth_format};
+
+        auto& graph = frame_graph_;
+        graph.clear();
+
+        deferred_resources resources;
+        if (!is_probe)
+        {
+            resources.output = graph.import_texture("OUTPUT", render_view.get_output_buffer(viewport_size));
 
-        output = atmospherics_pass(output, camera, render_view, ecs, dt);
+            // The editor shows the g-buffer and draws over the depth after the frame.
+            static const char* names[] = {"GBUFFER0", "GBUFFER1", "GBUFFER2", "GBUFFER3", "DEPTH"};
+            auto               g_buffer_fbo = render_view.get_g_buffer_fbo(viewport_size);
+            for (std::uint32_t i = 0; i < resources.g_buffer.size(); ++i)
+            {
+                resources.g_buffer[i] = graph.import_texture(names[i], g_buffer_fbo->get_texture(i));
+            }
+        }
 
-        output = tonemapping_pass(output, camera, render_view);
+        graph.add_pass("g_buffer_fill",
+                       [&](frame_graph::builder& builder) {
+                           if (is_probe)
+                           {
+                               resources.g_buffer[0] = builder.create("GBUFFER0", color_desc);
+                               resources.g_buffer[1] = builder.create("GBUFFER1", hdr_desc);
+                               resources.g_buffer[2] = builder.create("GBUFFER2", color_desc);
+                               resources.g_buffer[3] = builder.create("GBUFFER3", color_desc);
+                               resources.g_buffer[4] = builder.create("DEPTH", depth_desc);
+                           }
+                           for (const auto target : resources.g_buffer)
+                           {
+                               builder.write(target);
+                           }
+                       },
+                       [&](frame_graph::context& ctx) { g_buffer_pass(ctx, camera, visibility_set, camera_lods, dt); });
+
+        graph.add_pass("refl_buffer_fill",
+                       [&](frame_graph::builder& builder) {
+                           for (const auto target : resources.g_buffer)
+                           {
+                               builder.read(target);
+                           }
+                           resources.reflection = builder.write(builder.create("RBUFFER", hdr_desc));
+                       },
+                       [&](frame_graph::context& ctx) { reflection_probe_pass(ctx, resources, camera, ecs, !is_probe, dt); });
+
+        graph.add_pass("light_buffer_fill",
+                       [&](frame_graph::builder& builder) {
+                           for (const auto target : resources.g_buffer)
+                           {
+                               builder.read(target);
+                           }
+                           builder.read(resources.reflection);
+                           resources.light = builder.write(builder.create("LBUFFER", hdr_desc));
+                       },
+                       [&](frame_graph::context& ctx) { lighting_pass(ctx, resources, camera, ecs, view_owner, dt); });
+
+        // Blends over the lit scene, depth tested against the g-buffer depth.
+        graph.add_pass("atmospherics_fill",
+                       [&](frame_graph::builder& builder) {
+                           builder.read(resources.light);
+                           builder.read(resources.g_buffer[4]);
+                           builder.write(resources.light);
+                           builder.write(resources.g_buffer[4]);
+                       },
+                       [&](frame_graph::context& ctx) { atmospherics_pass(ctx, camera, ecs, dt); });
+
+        // The g-buffer of probe faces is done by now, their output takes the
+        // place of one of its targets.
+        graph.add_pass("output_buffer_fill",
+                       [&](frame_graph::builder& builder) {
+                           builder.read(resources.light);
+                           if (is_probe)
+                               resources.output = builder.create("OUTPUT", color_desc);
+                           builder.write(resources.output);
+                       },
+                       [&](frame_graph::context& ctx) { tonemapping_pass(ctx, resources, camera); });
+
+        if (is_probe)
+        {
+            graph.add_pass("cubemap_fill",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(resources.output);
+                               builder.side_effect();
+                           },
+                           [&](frame_graph::context& ctx) {
+                               auto& pass   = ctx.get_pass();
+                               auto  output = ctx.get_texture(resources.output);
+                               pass.touch();
+                               gfx::blit(pass.id, probe_cubemap->native_handle(), 0, 0, 0, probe_face, output->native_handle());
+                           });
+        }
 
-        return output;
+        graph.compile();
+        graph.execute(frame_graph_pool_);
     }
 
-    std::shared_ptr<gfx::frame_buffer> deferred_rendering::g_buffer_pass(std::shared_ptr<gfx::frame_buffer>    input,
-                                                                         camera&                               camera,
-                                                                         gfx::render_view&                     render_view,
-                                                                         visibility_set_models_t&              visibility_set,
-                                                                         std::unordered_map<entity, lod_data>& camera_lods,
-                                                                         float                                 dt)
+    void deferred_rendering::g_buffer_pass(frame_graph::context&    ctx,
+                                           camera&                  camera,
+                                           visibility_set_models_t& visibility_set,
+                                           view_lods&               camera_lods,
+                                           float                    dt)
     {
-        const auto&      view          = camera.get_view();
-        const auto&      proj          = camera.get_projection();
-        const auto&      viewport_size = camera.get_viewport_size();
-        auto             g_buffer_fbo  = render_view.get_g_buffer_fbo(viewport_size);
-        gfx::render_pass pass("g_buffer_fill");
+        const auto& view = camera.get_view();
+        const auto& proj = camera.get_projection();
+        auto&       pass = ctx.get_pass();
         pass.clear();
         pass.set_view_proj(view, proj);
-        pass.bind(g_buffer_fbo.get());
-
-        for (auto& element : visibility_set)
+        camera_lods.begin_frame();
+
+        const auto clip_planes = math::vec2(camera.get_near_clip(), camera.get_far_clip());
+        const auto camera_pos  = camera.get_position();
+
+        // Draws are sorted front to back within each program and material,
+        // lod_params_ holds the blend parameters of each of them. Models not
+        // blending between lods share the first entry so they can be instanced.
+        g_buffer_queue_.clear();
+        lod_params_.clear();
+        lod_params_.emplace_back(0.0f, -1.0f, 1.0f);
+
+        // Bounding spheres of the lods being drawn, their screen coverage picks
+        // the next lod. Models without a loaded mesh get an empty sphere.
+        lod_spheres_.resize(visibility_set.size());
+        for (std::size_t i = 0; i < visibility_set.size(); ++i)
         {
-            auto& e                     = std::get<0>(element);
-            auto& transform_comp_handle = std::get<1>(element);
-            auto& model_comp_handle     = std::get<2>(element);
-            auto  transform_comp_ptr    = transform_comp_handle.lock();
-            auto  model_comp_ptr        = model_comp_handle.lock();
-            if (!transform_comp_ptr || !model_comp_ptr)
-                continue;
+            const auto& element         = visibility_set[i];
+            const auto& world_transform = std::get<1>(element)->get_transform();
+            const auto& model           = std::get<2>(element)->get_model();
+            const auto  mesh            = model.get_lod(camera_lods.get(std::get<0>(element)).current_lod_index);
 
-            auto& transform_comp_ref = *transform_comp_ptr.get();
-            auto& model_comp_ref     = *model_comp_ptr.get();
+            math::bsphere sphere;
+            if (mesh)
+            {
+                const auto& bounds = mesh->get_bounds();
+                const auto  scale  = math::abs(world_transform.get_scale());
+                sphere.position    = world_transform.transform_coord(bounds.get_center());
+                sphere.radius      = math::length(bounds.get_extents()) * math::max(scale.x, math::max(scale.y, scale.z));
+            }
+            lod_spheres_.set(i, sphere);
+        }
+        compute_screen_coverage(camera, lod_spheres_, lod_coverage_);
+
+        for (std::size_t i = 0; i < visibility_set.size(); ++i)
+        {
+            const auto& element            = visibility_set[i];
+            const auto& e                  = std::get<0>(element);
+            const auto& transform_comp_ref = *std::get<1>(element);
+            const auto& model_comp_ref     = *std::get<2>(element);
 
             const auto& model = model_comp_ref.get_model();
             if (!model.is_valid())
                 continue;
 
             const auto& world_transform = transform_comp_ref.get_transform();
-            const auto  clip_planes     = math::vec2(camera.get_near_clip(), camera.get_far_clip());
 
-            auto&       lod_data          = camera_lods[e];
+            auto&       lod_data          = camera_lods.get(e);
             const auto  transition_time   = model.get_lod_transition_time();
             const auto  lod_count         = model.get_lods().size();
             const auto& lod_limits        = model.get_lod_limits();
@@ -389,7 +1450,7 @@ namespace runtime
             if (!current_mesh)
                 continue;
 
-            if (false == update_lod_data(lod_data, lod_limits, lod_count, transition_time, dt, current_mesh, world_transform, camera))
+            if (false == update_lod_data(lod_data, lod_limits, lod_count, transition_time, dt, lod_coverage_[i]))
                 continue;
             const auto params = math::vec3 {0.0f, -1.0f, (transition_time - current_time) / transition_time};
 
@@ -397,156 +1458,231 @@ namespace runtime
 
             const auto& bone_transforms = model_comp_ref.get_bone_transforms();
 
-            model.render(pass.id,
-                         world_transform,
-                         bone_transforms,
-                         true,
-                         true,
-                         true,
-                         0,
-                         current_lod_index,
-                         nullptr,
-                         [&camera, &clip_planes, &params](auto& p) {
-                             auto camera_pos = camera.get_position();
-                             p.set_uniform("u_camera_wpos", camera_pos);
-                             p.set_uniform("u_camera_clip_planes", clip_planes);
-                             p.set_uniform("u_lod_params", params);
-                         });
-
-            if (current_time != 0.0f)
-            {
-                model.render(pass.id, world_transform, bone_transforms, true, true, true, 0, target_lod_index, nullptr, [&params_inv](auto& p) {
-                    p.set_uniform("u_lod_params", params_inv);
-                });
+            const auto depth = math::max(view.transform_coord(world_transform.get_position()).z, 0.0f) / clip_planes.y;
+
+            if (current_time == 0.0f)
+            {
+                model.enqueue(g_buffer_queue_, world_transform, bone_transforms, true, true, true, 0, current_lod_index, depth, 0);
+            }
+            else
+            {
+                const auto index = std::uint32_t(lod_params_.size());
+                lod_params_.emplace_back(params);
+                lod_params_.emplace_back(params_inv);
+                model.enqueue(g_buffer_queue_, world_transform, bone_transforms, true, true, true, 0, current_lod_index, depth, index);
+                model.enqueue(g_buffer_queue_, world_transform, bone_transforms, true, true, true, 0, target_lod_index, depth, index + 1);
             }
         }
 
-        return g_buffer_fbo;
+        const auto& uniforms = get_pass_uniforms();
+        g_buffer_queue_.sort();
+        g_buffer_queue_.submit(pass.id, [this, &uniforms, &camera_pos, &clip_planes](gpu_program& p, const render_queue::packet& packet) {
+            p.set_uniform(uniforms.camera_wpos, camera_pos);
+            p.set_uniform(uniforms.camera_clip_planes, clip_planes);
+            p.set_uniform(uniforms.lod_params, lod_params_[packet.user_index]);
+        });
     }
 
-    std::shared_ptr<gfx::frame_buffer> deferred_rendering::lighting_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                                         camera&                            camera,
-                                                                         gfx::render_view&                  render_view,
-                                                                         entity_component_system&           ecs,
-                                                                         float                              dt)
+    void deferred_rendering::lighting_pass(frame_graph::context&     ctx,
+                                           const deferred_resources& resources,
+                                           camera&                   camera,
+                                           entity_component_system&  ecs,
+                                           entity                    view_owner,
+                                           float                     dt)
     {
         const auto& view = camera.get_view();
         const auto& proj = camera.get_projection();
 
-        const auto& viewport_size = camera.get_viewport_size();
-        auto        g_buffer_fbo  = render_view.get_g_buffer_fbo(viewport_size).get();
+        const auto buffer_size = ctx.get_frame_buffer()->get_size();
+        auto&      pass        = ctx.get_pass();
+        pass.set_view_proj(view, proj);
+        pass.clear(BGFX_CLEAR_COLOR, 0, 0.0f, 0);
 
-        static auto light_buffer_format = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER,
-                                                               gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha |
-                                                                   gfx::format_search_flags::half_precision_float);
+        gfx::texture* g_buffer[5];
+        for (std::uint32_t i = 0; i < 5; ++i)
+        {
+            g_buffer[i] = ctx.get_texture(resources.g_buffer[i]);
+        }
+        auto refl_buffer = ctx.get_texture(resources.reflection);
 
-        auto       light_buffer = render_view.get_texture("LBUFFER", viewport_size.width, viewport_size.height, false, 1, light_buffer_format);
-        auto       l_buffer_fbo = render_view.get_fbo("LBUFFER", {light_buffer});
-        const auto buffer_size  = l_buffer_fbo->get_size();
+        // Point and spot lights are binned into clusters and shaded by a single
+        // draw when float data textures can be sampled, the rest get a quad each.
+        static const bool float_textures = gfx::is_format_supported(BGFX_CAPS_FORMAT_TEXTURE_2D, gfx::texture_format::RGBA32F) &&
+                                           gfx::is_format_supported(BGFX_CAPS_FORMAT_TEXTURE_2D, gfx::texture_format::RG32F) &&
+                                           gfx::is_format_supported(BGFX_CAPS_FORMAT_TEXTURE_2D, gfx::texture_format::R32F);
+        const bool clustered = float_textures && clustered_light_program_ != nullptr;
+        light_clusters_.clear();
 
-        gfx::render_pass pass("light_buffer_fill");
-        pass.bind(l_buffer_fbo.get());
-        pass.set_view_proj(view, proj);
-        pass.clear(BGFX_CLEAR_COLOR, 0, 0.0f, 0);
-        auto refl_buffer = render_view.get_texture("RBUFFER", viewport_size.width, viewport_size.height, false, 1, light_buffer_format).get();
+        const auto& uniforms = get_pass_uniforms();
+        ecs.for_each<transform_component, light_component>(
+            [this, &uniforms, &camera, &pass, &buffer_size, &view, &proj, &g_buffer, refl_buffer, clustered, view_owner](
+                entity e, transform_component& transform_comp_ref, light_component& light_comp_ref) {
+                const auto& light           = light_comp_ref.get_light();
+                const auto& world_transform = transform_comp_ref.get_transform();
+                const auto& light_position  = world_transform.get_position();
+                const auto& light_direction = world_transform.z_unit_axis();
+
+                irect32_t rect(0, 0, irect32_t::value_type(buffer_size.width), irect32_t::value_type(buffer_size.height));
+                if (light_comp_ref.compute_projected_sphere_rect(rect, light_position, light_direction, view, proj) == 0)
+                    return;
 
-        ecs.for_each<transform_component, light_component>([this, &camera, &pass, &buffer_size, &view, &proj, g_buffer_fbo, refl_buffer](
-                                                               entity e, transform_component& transform_comp_ref, light_component& light_comp_ref) {
-            const auto& light           = light_comp_ref.get_light();
-            const auto& world_transform = transform_comp_ref.get_transform();
-            const auto& light_position  = world_transform.get_position();
-            const auto& light_direction = world_transform.z_unit_axis();
+                // Lights with a shadow map get a quad of their own, drawn by the
+                // program that samples it.
+                const light_shadow* shadow         = find_shadow(e, light.type, view_owner);
+                gpu_program*        shadow_program = nullptr;
+                if (light.type == light_type::directional)
+                    shadow_program = directional_light_shadow_program_.get();
+                else if (light.type == light_type::point)
+                    shadow_program = point_light_shadow_program_.get();
+                else if (light.type == light_type::spot)
+                    shadow_program = spot_light_shadow_program_.get();
+                if (!shadow_program)
+                    shadow = nullptr;
+
+                if (clustered && light.type != light_type::directional && !shadow)
+                {
+                    light_clusters_.add_light(light, light_position, light_direction);
+                    return;
+                }
 
-            irect32_t rect(0, 0, irect32_t::value_type(buffer_size.width), irect32_t::value_type(buffer_size.height));
-            if (light_comp_ref.compute_projected_sphere_rect(rect, light_position, light_direction, view, proj) == 0)
-                return;
+                gpu_program* program = nullptr;
+                if (light.type == light_type::directional && directional_light_program_)
+                {
+                    // Draw light.
+                    program = shadow ? shadow_program : directional_light_program_.get();
+                    program->begin();
+                    program->set_uniform(uniforms.light_direction, light_direction);
+                }
+                if (light.type == light_type::point && point_light_program_)
+                {
+                    float light_data[4] = {light.point_data.range, light.point_data.exponent_falloff, 0.0f, 0.0f};
 
-            gpu_program* program = nullptr;
-            if (light.type == light_type::directional && directional_light_program_)
-            {
-                // Draw light.
-                program = directional_light_program_.get();
-                program->begin();
-                program->set_uniform("u_light_direction", light_direction);
-            }
-            if (light.type == light_type::point && point_light_program_)
-            {
-                float light_data[4] = {light.point_data.range, light.point_data.exponent_falloff, 0.0f, 0.0f};
+                    // Draw light.
+                    program = shadow ? shadow_program : point_light_program_.get();
+                    program->begin();
+                    program->set_uniform(uniforms.light_position, light_position);
+                    program->set_uniform(uniforms.light_data, light_data);
+                }
 
-                // Draw light.
-                program = point_light_program_.get();
-                program->begin();
-                program->set_uniform("u_light_position", light_position);
-                program->set_uniform("u_light_data", light_data);
-            }
+                if (light.type == light_type::spot && spot_light_program_)
+                {
+                    float light_data[4] = {light.spot_data.get_range(),
+                                           math::cos(math::radians(light.spot_data.get_inner_angle() * 0.5f)),
+                                           math::cos(math::radians(light.spot_data.get_outer_angle() * 0.5f)),
+                                           0.0f};
+
+                    // Draw light.
+                    program = shadow ? shadow_program : spot_light_program_.get();
+                    program->begin();
+                    program->set_uniform(uniforms.light_position, light_position);
+                    program->set_uniform(uniforms.light_direction, light_direction);
+                    program->set_uniform(uniforms.light_data, light_data);
+                }
 
-            if (light.type == light_type::spot && spot_light_program_)
-            {
-                float light_data[4] = {light.spot_data.get_range(),
-                                       math::cos(math::radians(light.spot_data.get_inner_angle() * 0.5f)),
-                                       math::cos(math::radians(light.spot_data.get_outer_angle() * 0.5f)),
-                                       0.0f};
+                if (program)
+                {
+                    float light_color_intensity[4] = {light.color.value.r, light.color.value.g, light.color.value.b, light.intensity};
+                    auto  camera_pos               = camera.get_position();
+                    program->set_uniform(uniforms.light_color_intensity, light_color_intensity);
+                    program->set_uniform(uniforms.camera_position, camera_pos);
+                    program->set_texture(0, uniforms.tex0, g_buffer[0]);
+                    program->set_texture(1, uniforms.tex1, g_buffer[1]);
+                    program->set_texture(2, uniforms.tex2, g_buffer[2]);
+                    program->set_texture(3, uniforms.tex3, g_buffer[3]);
+                    program->set_texture(4, uniforms.tex4, g_buffer[4]);
+                    program->set_texture(5, uniforms.tex5, refl_buffer);
+                    program->set_texture(6, uniforms.tex6, ibl_brdf_lut_.get());
+                    if (shadow)
+                    {
+                        const float depth_bias = light.type == light_type::directional ? directional_depth_bias : perspective_depth_bias;
+                        set_shadow_uniforms(*program, *shadow, light.shadow != shadow_type::hard, depth_bias);
+                    }
 
-                // Draw light.
-                program = spot_light_program_.get();
-                program->begin();
-                program->set_uniform("u_light_position", light_position);
-                program->set_uniform("u_light_direction", light_direction);
-                program->set_uniform("u_light_data", light_data);
-            }
+                    gfx::set_scissor(rect.left, rect.top, rect.width(), rect.height());
+                    auto topology = gfx::clip_quad(1.0f);
+                    gfx::set_state(topology | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ADD);
+                    gfx::submit(pass.id, program->native_handle());
+                    gfx::set_state(BGFX_STATE_DEFAULT);
 
-            if (program)
-            {
-                float light_color_intensity[4] = {light.color.value.r, light.color.value.g, light.color.value.b, light.intensity};
-                auto  camera_pos               = camera.get_position();
-                program->set_uniform("u_light_color_intensity", light_color_intensity);
-                program->set_uniform("u_camera_position", camera_pos);
-                program->set_texture(0, "s_tex0", g_buffer_fbo->get_texture(0).get());
-                program->set_texture(1, "s_tex1", g_buffer_fbo->get_texture(1).get());
-                program->set_texture(2, "s_tex2", g_buffer_fbo->get_texture(2).get());
-                program->set_texture(3, "s_tex3", g_buffer_fbo->get_texture(3).get());
-                program->set_texture(4, "s_tex4", g_buffer_fbo->get_texture(4).get());
-                program->set_texture(5, "s_tex5", refl_buffer);
-                program->set_texture(6, "s_tex6", ibl_brdf_lut_.get());
+                    program->end();
+                }
+            });
 
-                gfx::set_scissor(rect.left, rect.top, rect.width(), rect.height());
-                auto topology = gfx::clip_quad(1.0f);
-                gfx::set_state(topology | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ADD);
-                gfx::submit(pass.id, program->native_handle());
-                gfx::set_state(BGFX_STATE_DEFAULT);
+        if (clustered && !light_clusters_.empty())
+        {
+            light_clusters_.build(view, proj, camera.get_near_clip(), camera.get_far_clip());
+
+            const auto& light_data  = light_clusters_.get_light_data();
+            const auto& light_grid  = light_clusters_.get_grid();
+            const auto& indices     = light_clusters_.get_indices();
+            const auto  row_width   = std::uint16_t(light_clusters::row_width);
+            const auto  light_rows  = std::uint16_t(light_data.size() / (row_width * 4));
+            const auto  index_rows  = std::uint16_t(indices.size() / row_width);
+            const auto  grid_width  = std::uint16_t(light_clusters_.get_tiles_x() * light_clusters_.get_tiles_y());
+            const auto  grid_height = std::uint16_t(light_clusters_.get_slices());
+            update_data_texture(cluster_light_data_, row_width, light_rows, gfx::texture_format::RGBA32F, light_data);
+            update_data_texture(cluster_light_grid_, grid_width, grid_height, gfx::texture_format::RG32F, light_grid);
+            update_data_texture(cluster_light_indices_, row_width, index_rows, gfx::texture_format::R32F, indices);
+
+            float cluster_grid[4]  = {float(light_clusters_.get_tiles_x()), float(light_clusters_.get_tiles_y()), float(grid_height), 0.0f};
+            float cluster_depth[4] = {light_clusters_.get_depth_scale(), light_clusters_.get_depth_bias(), 0.0f, 0.0f};
+            float cluster_texel[4] = {1.0f / float(row_width),
+                                      1.0f / float(cluster_light_data_->info.height),
+                                      1.0f / float(row_width),
+                                      1.0f / float(cluster_light_indices_->info.height)};
+            auto  camera_pos       = camera.get_position();
+
+            auto program = clustered_light_program_.get();
+            program->begin();
+            program->set_uniform(uniforms.cluster_grid, cluster_grid);
+            program->set_uniform(uniforms.cluster_depth, cluster_depth);
+            program->set_uniform(uniforms.cluster_texel, cluster_texel);
+            program->set_uniform(uniforms.camera_position, camera_pos);
+            program->set_texture(0, uniforms.tex0, g_buffer[0]);
+            program->set_texture(1, uniforms.tex1, g_buffer[1]);
+            program->set_texture(2, uniforms.tex2, g_buffer[2]);
+            program->set_texture(3, uniforms.tex3, g_buffer[3]);
+            program->set_texture(4, uniforms.tex4, g_buffer[4]);
+            program->set_texture(5, uniforms.tex5, refl_buffer);
+            program->set_texture(6, uniforms.tex6, ibl_brdf_lut_.get());
+            program->set_texture(7, uniforms.cluster_light_data, cluster_light_data_.get());
+            program->set_texture(8, uniforms.cluster_light_grid, cluster_light_grid_.get());
+            program->set_texture(9, uniforms.cluster_light_indices, cluster_light_indices_.get());
 
-                program->end();
-            }
-        });
+            auto topology = gfx::clip_quad(1.0f);
+            gfx::set_state(topology | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ADD);
+            gfx::submit(pass.id, program->native_handle());
+            gfx::set_state(BGFX_STATE_DEFAULT);
 
-        return l_buffer_fbo;
+            program->end();
+        }
     }
 
-    std::shared_ptr<gfx::frame_buffer> deferred_rendering::reflection_probe_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                                                 camera&                            camera,
-                                                                                 gfx::render_view&                  render_view,
-                                                                                 entity_component_system&           ecs,
-                                                                                 float                              dt)
+    void deferred_rendering::reflection_probe_pass(frame_graph::context&     ctx,
+                                                   const deferred_resources& resources,
+                                                   camera&                   camera,
+                                                   entity_component_system&  ecs,
+                                                   bool                      draw_probes,
+                                                   float                     dt)
     {
         const auto& view = camera.get_view();
         const auto& proj = camera.get_projection();
 
-        const auto& viewport_size = camera.get_viewport_size();
-        auto        g_buffer_fbo  = render_view.get_g_buffer_fbo(viewport_size).get();
-
-        static auto refl_buffer_format = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER,
-                                                              gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha |
-                                                                  gfx::format_search_flags::half_precision_float);
-
-        auto       refl_buffer  = render_view.get_texture("RBUFFER", viewport_size.width, viewport_size.height, false, 1, refl_buffer_format);
-        auto       r_buffer_fbo = render_view.get_fbo("RBUFFER", {refl_buffer});
-        const auto buffer_size  = refl_buffer->get_size();
-
-        gfx::render_pass pass("refl_buffer_fill");
-        pass.bind(r_buffer_fbo.get());
+        const auto buffer_size = ctx.get_frame_buffer()->get_size();
+        auto&      pass        = ctx.get_pass();
         pass.set_view_proj(view, proj);
         pass.clear(BGFX_CLEAR_COLOR, 0, 0.0f, 0);
-        ecs.for_each<transform_component, reflection_probe_component>([this, &camera, &pass, &buffer_size, &view, &proj, g_buffer_fbo](
+        if (!draw_probes)
+            return;
+
+        gfx::texture* g_buffer[5];
+        for (std::uint32_t i = 0; i < 5; ++i)
+        {
+            g_buffer[i] = ctx.get_texture(resources.g_buffer[i]);
+        }
+
+        const auto& uniforms = get_pass_uniforms();
+        ecs.for_each<transform_component, reflection_probe_component>([this, &uniforms, &camera, &pass, &buffer_size, &view, &proj, &g_buffer](
                                                                           entity                      e,
                                                                           transform_component&        transform_comp_ref,
                                                                           reflection_probe_component& probe_comp_ref) {
@@ -579,8 +1715,8 @@ namespace runtime
 
                 program = box_ref_probe_program_.get();
                 program->begin();
-                program->set_uniform("u_inv_world", math::value_ptr(u_inv_world));
-                program->set_uniform("u_data2", data2);
+                program->set_uniform(uniforms.inv_world, math::value_ptr(u_inv_world));
+                program->set_uniform(uniforms.data2, data2);
 
                 influence_radius = math::length(t.get_scale() + probe.box_data.transition_distance);
             }
@@ -597,15 +1733,15 @@ namespace runtime
 
                 float data1[4] = {mips, 0.0f, 0.0f, 0.0f};
 
-                program->set_uniform("u_data0", data0);
-                program->set_uniform("u_data1", data1);
+                program->set_uniform(uniforms.data0, data0);
+                program->set_uniform(uniforms.data1, data1);
 
-                program->set_texture(0, "s_tex0", g_buffer_fbo->get_texture(0).get());
-                program->set_texture(1, "s_tex1", g_buffer_fbo->get_texture(1).get());
-                program->set_texture(2, "s_tex2", g_buffer_fbo->get_texture(2).get());
-                program->set_texture(3, "s_tex3", g_buffer_fbo->get_texture(3).get());
-                program->set_texture(4, "s_tex4", g_buffer_fbo->get_texture(4).get());
-                program->set_texture(5, "s_tex_cube", cubemap.get());
+                program->set_texture(0, uniforms.tex0, g_buffer[0]);
+                program->set_texture(1, uniforms.tex1, g_buffer[1]);
+                program->set_texture(2, uniforms.tex2, g_buffer[2]);
+                program->set_texture(3, uniforms.tex3, g_buffer[3]);
+                program->set_texture(4, uniforms.tex4, g_buffer[4]);
+                program->set_texture(5, uniforms.tex_cube, cubemap.get());
                 gfx::set_scissor(rect.left, rect.top, rect.width(), rect.height());
                 auto topology = gfx::clip_quad(1.0f);
                 gfx::set_state(topology | BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A | BGFX_STATE_BLEND_ALPHA);
@@ -614,36 +1750,20 @@ namespace runtime
                 program->end();
             }
         });
-
-        return r_buffer_fbo;
     }
 
-    std::shared_ptr<gfx::frame_buffer> deferred_rendering::atmospherics_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                                             camera&                            camera,
-                                                                             gfx::render_view&                  render_view,
-                                                                             entity_component_system&           ecs,
-                                                                             float                              dt)
+    void deferred_rendering::atmospherics_pass(frame_graph::context& ctx, camera& camera, entity_component_system& ecs, float dt)
     {
         auto far_clip_cache = camera.get_far_clip();
         camera.set_far_clip(10000.0f);
         const auto& view = camera.get_view();
         const auto& proj = camera.get_projection();
         camera.set_far_clip(far_clip_cache);
-        const auto& viewport_size = camera.get_viewport_size();
-
-        static auto light_buffer_format = gfx::get_best_format(BGFX_CAPS_FORMAT_TEXTURE_FRAMEBUFFER,
-                                                               gfx::format_search_flags::four_channels | gfx::format_search_flags::requires_alpha |
-                                                                   gfx::format_search_flags::half_precision_float);
-
-        auto light_buffer = render_view.get_texture(
-            "LBUFFER", viewport_size.width, viewport_size.height, false, 1, light_buffer_format, gfx::get_default_rt_sampler_flags());
-        input = render_view.get_fbo("LBUFFER", {light_buffer, render_view.get_depth_buffer(viewport_size)});
 
-        const auto       surface     = input.get();
-        const auto       output_size = surface->get_size();
-        gfx::render_pass pass("atmospherics_fill");
+        const auto surface     = ctx.get_frame_buffer();
+        const auto output_size = surface->get_size();
+        auto&      pass        = ctx.get_pass();
         pass.set_view_proj(view, proj);
-        pass.bind(surface);
 
         if ((surface != nullptr) && atmospherics_program_)
         {
@@ -666,8 +1786,9 @@ namespace runtime
                     }
                 });
 
+            const auto& uniforms = get_pass_uniforms();
             atmospherics_program_->begin();
-            atmospherics_program_->set_uniform("u_light_direction", light_direction);
+            atmospherics_program_->set_uniform(uniforms.light_direction, light_direction);
 
             irect32_t rect(0, 0, irect32_t::value_type(output_size.width), irect32_t::value_type(output_size.height));
             gfx::set_scissor(rect.left, rect.top, rect.width(), rect.height());
@@ -677,29 +1798,22 @@ namespace runtime
             gfx::set_state(BGFX_STATE_DEFAULT);
             atmospherics_program_->end();
         }
-
-        return input;
     }
 
-    std::shared_ptr<gfx::frame_buffer>
-    deferred_rendering::tonemapping_pass(std::shared_ptr<gfx::frame_buffer> input, camera& camera, gfx::render_view& render_view)
+    void deferred_rendering::tonemapping_pass(frame_graph::context& ctx, const deferred_resources& resources, camera& camera)
     {
-        if (!input)
-            return nullptr;
-
-        const auto&      viewport_size = camera.get_viewport_size();
-        auto             surface       = render_view.get_output_fbo(viewport_size);
-        const auto       output_size   = surface->get_size();
-        const auto&      view          = camera.get_view();
-        const auto&      proj          = camera.get_projection();
-        gfx::render_pass pass("output_buffer_fill");
+        const auto  surface     = ctx.get_frame_buffer();
+        const auto  output_size = surface->get_size();
+        const auto& view        = camera.get_view();
+        const auto& proj        = camera.get_projection();
+        auto&       pass        = ctx.get_pass();
         pass.set_view_proj(view, proj);
-        pass.bind(surface.get());
 
         if (surface && gamma_correction_program_)
         {
+            const auto& uniforms = get_pass_uniforms();
             gamma_correction_program_->begin();
-            gamma_correction_program_->set_texture(0, "s_input", input->get_texture().get());
+            gamma_correction_program_->set_texture(0, uniforms.input, ctx.get_texture(resources.light));
             irect32_t rect(0, 0, irect32_t::value_type(output_size.width), irect32_t::value_type(output_size.height));
             gfx::set_scissor(rect.left, rect.top, rect.width(), rect.height());
             auto topology = gfx::clip_quad(1.0f);
@@ -708,18 +1822,73 @@ namespace runtime
             gfx::set_state(BGFX_STATE_DEFAULT);
             gamma_correction_program_->end();
         }
+    }
+
+    void view_lods::begin_frame()
+    {
+        ++frame;
+
+        // Swap remove, patching the position of the state moved into the gap.
+        for (std::size_t i = 0; i < lods.size();)
+        {
+            if (frame - lods[i].last_seen <= max_unseen)
+            {
+                ++i;
+                continue;
+            }
+
+            slots.erase(lods[i].owner.id().index());
+            if (i + 1 != lods.size())
+            {
+                lods[i]                           = lods.back();
+                slots[lods[i].owner.id().index()] = std::uint32_t(i);
+            }
+            lods.pop_back();
+        }
+    }
 
-        return surface;
+    lod_data& view_lods::get(entity e)
+    {
+        const auto slot = e.id().index();
+        auto       it   = slots.find(slot);
+        if (it == slots.end())
+        {
+            it = slots.emplace(slot, std::uint32_t(lods.size())).first;
+            lods.emplace_back();
+            lods.back().owner = e;
+        }
+
+        auto& data = lods[it->second];
+        if (data.owner != e)
+        {
+            data       = lod_data();
+            data.owner = e;
+        }
+        data.last_seen = frame;
+        return data;
     }
 
+    void deferred_rendering::set_probe_face_budget(std::uint32_t faces) { probe_face_budget_ = std::max(faces, 1u); }
+
     void deferred_rendering::receive(entity e)
     {
         lod_data_.erase(e);
-        for (auto& pair : lod_data_)
+
+        auto update = probe_updates_.find(e);
+        if (update != probe_updates_.end())
+        {
+            if (update->second.leaf != math::aabb_tree::null_node)
+                probe_index_.remove(update->second.leaf);
+            probe_updates_.erase(update);
+        }
+
+        shadows_.erase(e);
+        for (auto& light_shadows : shadows_)
         {
-            pair.second.erase(e);
+            light_shadows.second.erase(e);
         }
     }
+
     deferred_rendering::deferred_rendering()
     {
         on_entity_destroyed.connect(this, &deferred_rendering::receive);
@@ -743,8 +1912,22 @@ namespace runtime
         fs_sphere_reflection_probe.wait();
         auto fs_box_reflection_probe = am.load<gfx::shader>("engine:/data/shaders/fs_box_reflection_probe.sc");
         fs_box_reflection_probe.wait();
+        auto fs_deferred_clustered_light = am.load<gfx::shader>("engine:/data/shaders/fs_deferred_clustered_light.sc");
+        fs_deferred_clustered_light.wait();
         auto fs_atmospherics = am.load<gfx::shader>("engine:/data/shaders/fs_atmospherics.sc");
         fs_atmospherics.wait();
+        auto vs_shadow = am.load<gfx::shader>("engine:/data/shaders/vs_shadow.sc");
+        vs_shadow.wait();
+        auto vs_shadow_skinned = am.load<gfx::shader>("engine:/data/shaders/vs_shadow_skinned.sc");
+        vs_shadow_skinned.wait();
+        auto fs_shadow = am.load<gfx::shader>("engine:/data/shaders/fs_shadow.sc");
+        fs_shadow.wait();
+        auto fs_deferred_directional_light_shadow = am.load<gfx::shader>("engine:/data/shaders/fs_deferred_directional_light_shadow.sc");
+        fs_deferred_directional_light_shadow.wait();
+        auto fs_deferred_point_light_shadow = am.load<gfx::shader>("engine:/data/shaders/fs_deferred_point_light_shadow.sc");
+        fs_deferred_point_light_shadow.wait();
+        auto fs_deferred_spot_light_shadow = am.load<gfx::shader>("engine:/data/shaders/fs_deferred_spot_light_shadow.sc");
+        fs_deferred_spot_light_shadow.wait();
         ibl_brdf_lut_ = am.load<gfx::texture>("engine:/data/textures/ibl_brdf_lut.png").get();
         ts.push_or_execute_on_owner_thread(
             [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) { point_light_program_ = std::make_unique<gpu_program>(vs, fs); },
@@ -763,6 +1946,44 @@ namespace runtime
             vs_clip_quad,
             fs_deferred_directional_light);
 
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) {
+                clustered_light_program_ = std::make_unique<gpu_program>(vs, fs);
+            },
+            vs_clip_quad,
+            fs_deferred_clustered_light);
+
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) {
+                directional_light_shadow_program_ = std::make_unique<gpu_program>(vs, fs);
+            },
+            vs_clip_quad,
+            fs_deferred_directional_light_shadow);
+
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) {
+                point_light_shadow_program_ = std::make_unique<gpu_program>(vs, fs);
+            },
+            vs_clip_quad,
+            fs_deferred_point_light_shadow);
+
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) {
+                spot_light_shadow_program_ = std::make_unique<gpu_program>(vs, fs);
+            },
+            vs_clip_quad,
+            fs_deferred_spot_light_shadow);
+
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) { shadow_program_ = std::make_unique<gpu_program>(vs, fs); },
+            vs_shadow,
+            fs_shadow);
+
+        ts.push_or_execute_on_owner_thread(
+            [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) { shadow_skinned_program_ = std::make_unique<gpu_program>(vs, fs); },
+            vs_shadow_skinned,
+            fs_shadow);
+
         ts.push_or_execute_on_owner_thread(
             [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) { gamma_correction_program_ = std::make_unique<gpu_program>(vs, fs); },
             vs_clip_quad,
@@ -1,15 +1,22 @@
 #pragma once
 
+#include "../../rendering/frame_graph.h"
 #include "../../rendering/gpu_program.h"
+#include "../../rendering/light_clusters.h"
+#include "../../rendering/render_queue.h"
 #include "../components/model_component.h"
 #include "../components/transform_component.h"
 #include "../ecs.h"
 
 #include <core/common_lib/basetypes.hpp>
+#include <core/math/aabb_tree.h>
+#include <core/math/bbox_soa.h>
 
+#include <array>
 #include <chrono>
 #include <memory>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 class camera;
@@ -25,12 +32,172 @@ namespace runtime
 {
     struct lod_data
     {
+        /// Entity the state belongs to, a destroyed entity's slot is reused.
+        entity        owner;
         std::uint32_t current_lod_index = 0;
         std::uint32_t target_lod_index  = 0;
         float         current_time      = 0.0f;
+        /// Render of the view the state was last looked up in.
+        std::uint32_t last_seen = 0;
     };
 
-    using visibility_set_models_t = std::vector<std::tuple<entity, chandle<transform_component>, chandle<model_component>>>;
+    //-----------------------------------------------------------------------------
+    //  Name : view_lods (Struct)
+    /// <summary>
+    /// Lod state of the models seen from one view, packed, with the position of
+    /// each entity slot's state. States of models the view has not drawn for a
+    /// while are dropped, so the size follows what the view sees.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct view_lods
+    {
+        /// Renders of the view a model may go unseen before its state is dropped.
+        static constexpr std::uint32_t max_unseen = 60;
+
+        //-----------------------------------------------------------------------------
+        //  Name : begin_frame ()
+        /// <summary>
+        /// Starts a render of the view, dropping the states not looked up in the
+        /// last max_unseen renders.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void begin_frame();
+
+        //-----------------------------------------------------------------------------
+        //  Name : get ()
+        /// <summary>
+        /// State of e, fresh when e was not seen from this view lately.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        lod_data& get(entity e);
+
+        std::vector<lod_data>                            lods;
+        std::unordered_map<std::uint32_t, std::uint32_t> slots;
+        std::uint32_t                                    frame = 0;
+    };
+
+    // Raw component pointers, only valid for the frame the set was gathered in.
+    using visibility_set_models_t = std::vector<std::tuple<entity, const transform_component*, const model_component*>>;
+
+    //-----------------------------------------------------------------------------
+    //  Name : view_visibility (Struct)
+    /// <summary>
+    /// One view rendered this frame, a camera or a reflection probe face, and
+    /// the models found visible from it.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct view_visibility
+    {
+        /// Camera or reflection probe entity the view belongs to.
+        entity owner;
+        /// Cube face for reflection probes, 0 for cameras.
+        std::uint32_t face = 0;
+        /// Copied on the main thread, camera frustums are computed lazily.
+        math::frustum frustum;
+        bool          static_only               = false;
+        bool          require_reflection_caster = false;
+        bool          require_shadow_caster     = false;
+        /// Skips static models, for shadow maps whose static casters are cached.
+        bool dynamic_only = false;
+        /// Environment probes only draw the sky and need no models.
+        bool gather_models = true;
+        /// Filled by cull_views.
+        visibility_set_models_t visible;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : light_shadow (Struct)
+    /// <summary>
+    /// Shadow map of a light, for a single camera in the case of directional
+    /// lights. Its faces, a cascade or a cube side each, share one depth atlas.
+    /// Static casters are only rendered into a face when it moved or one of
+    /// them changed, dynamic casters every frame into a copy of the atlas.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct light_shadow
+    {
+        struct face
+        {
+            math::transform view;
+            math::transform proj;
+            math::frustum   frustum;
+            /// Top left corner and size in the atlas, in pixels.
+            std::uint16_t x    = 0;
+            std::uint16_t y    = 0;
+            std::uint16_t size = 0;
+            /// The static casters in the atlas were rendered with view and proj.
+            bool cached = false;
+            /// Index in the frame's views of the casters to draw, -1 for none.
+            std::int32_t visibility = -1;
+        };
+
+        std::vector<face> faces;
+        /// Far view depth of each cascade, directional lights only.
+        math::vec4 splits = math::vec4(0.0f);
+        /// Static casters, and static plus dynamic ones.
+        std::shared_ptr<gfx::frame_buffer> static_fbo;
+        std::shared_ptr<gfx::frame_buffer> dynamic_fbo;
+        /// Dynamic casters were drawn this frame, dynamic_fbo holds the shadows.
+        bool has_dynamic = false;
+        /// Gathered for the current frame.
+        bool active = false;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : probe_update (Struct)
+    /// <summary>
+    /// Rebuild of a reflection probe spread over several frames. The faces are
+    /// rendered into a staging cubemap and copied to the probe's cubemap once
+    /// all of them are done, the previous cubemap is sampled until then.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct probe_update
+    {
+        /// Faces of the running update and those left to render, a bit per face.
+        std::uint8_t update_faces  = 0;
+        std::uint8_t pending_faces = 0;
+        /// Faces that changed again while the update was running.
+        std::uint8_t restart_faces = 0;
+        /// Faces changed models were found in this frame.
+        std::uint8_t invalid_faces = 0;
+        /// Frame the update was requested in, older ones go first.
+        std::uint64_t                 request_frame = 0;
+        std::shared_ptr<gfx::texture> staging;
+        /// Probe transform of the current frame.
+        math::transform transform;
+        /// Capture volume in the probe index, null_node for environment probes.
+        std::uint32_t leaf = math::aabb_tree::null_node;
+        /// Frame the probe was last seen in, entries of removed probes are dropped.
+        std::uint64_t seen_frame = 0;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : static_caster (Struct)
+    /// <summary>
+    /// Where a static caster was captured by the cached shadow maps and probes.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct static_caster
+    {
+        math::bbox bounds;
+        bool       shadow     = false;
+        bool       reflection = false;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : deferred_resources (Struct)
+    /// <summary>
+    /// Frame graph textures of the deferred passes of a view.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct deferred_resources
+    {
+        /// Albedo, normal, material and emissive targets, then the depth.
+        std::array<frame_graph::resource, 5> g_buffer;
+        frame_graph::resource                reflection = frame_graph::invalid_resource;
+        frame_graph::resource                light      = frame_graph::invalid_resource;
+        frame_graph::resource                output     = frame_graph::invalid_resource;
+    };
 
     class deferred_rendering
     {
@@ -51,6 +218,71 @@ namespace runtime
                                                       bool                     static_only               = true,
                                                       bool                     require_reflection_caster = false);
         //-----------------------------------------------------------------------------
+        //  Name : gather_frustum_models ()
+        /// <summary>
+        /// Same as gather_visible_models for a frustum, nullptr takes every model.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        visibility_set_models_t gather_frustum_models(entity_component_system& ecs,
+                                                      const math::frustum*     frustum,
+                                                      bool                     dirty_only,
+                                                      bool                     static_only,
+                                                      bool                     require_reflection_caster);
+        //-----------------------------------------------------------------------------
+        //  Name : gather_changed_models ()
+        /// <summary>
+        /// Static reflection or shadow casting models whose transform or model
+        /// changed since the previous call, read from the ecs change journals
+        /// instead of scanning every model. The previous bounds of casters that
+        /// moved, were removed or stopped being static casters are kept for
+        /// gather_probe_views and gather_shadow_views.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        visibility_set_models_t gather_changed_models(entity_component_system& ecs);
+        //-----------------------------------------------------------------------------
+        //  Name : gather_views ()
+        /// <summary>
+        /// Lists every view rendered this frame: each camera and each face of the
+        /// reflection probes that have to be rebuilt.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void gather_views(entity_component_system& ecs, visibility_set_models_t& dirty_models);
+        //-----------------------------------------------------------------------------
+        //  Name : gather_probe_views ()
+        /// <summary>
+        /// Starts an update for the probes that changed, and for the faces of the
+        /// probes a changed model is seen from, found through the probe index.
+        /// Adds views for the faces rendered this frame, at most the face budget.
+        /// Probes close to a camera and updates waiting the longest go first.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void gather_probe_views(entity_component_system& ecs, visibility_set_models_t& dirty_models);
+        //-----------------------------------------------------------------------------
+        //  Name : gather_shadow_views ()
+        /// <summary>
+        /// Fits the shadow map faces of every shadow casting light, drops the
+        /// cached ones a changed static caster touches and adds a view per face
+        /// for the casters to draw: all of them for faces that are not cached,
+        /// the dynamic ones otherwise.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void gather_shadow_views(entity_component_system& ecs, visibility_set_models_t& dirty_models);
+        //-----------------------------------------------------------------------------
+        //  Name : cull_views ()
+        /// <summary>
+        /// Culls all the gathered views at once, one task_system job per view,
+        /// and stores their visibility sets for the render passes.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void cull_views(entity_component_system& ecs);
+        //-----------------------------------------------------------------------------
+        //  Name : find_view ()
+        /// <summary>
+        /// The view gathered this frame for owner and face, nullptr if none.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        view_visibility* find_view(entity owner, std::uint32_t face = 0);
+        //-----------------------------------------------------------------------------
         //  Name : frame_render (virtual )
         /// <summary>
         ///
@@ -60,6 +292,15 @@ namespace runtime
         //-----------------------------------------------------------------------------
         void frame_render(float dt);
 
+        //-----------------------------------------------------------------------------
+        //  Name : set_probe_face_budget ()
+        /// <summary>
+        /// Reflection probe faces rendered per frame, at least one.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void set_probe_face_budget(std::uint32_t faces);
+        inline std::uint32_t get_probe_face_budget() const { return probe_face_budget_; }
+
         //-----------------------------------------------------------------------------
         //  Name : receive ()
         /// <summary>
@@ -83,9 +324,8 @@ namespace runtime
         //-----------------------------------------------------------------------------
         //  Name : build_shadows ()
         /// <summary>
-        ///
-        ///
-        ///
+        /// Renders the static casters of the shadow map faces that are not
+        /// cached, then the dynamic casters over a copy of the cached maps.
         /// </summary>
         //-----------------------------------------------------------------------------
         void build_shadows_pass(entity_component_system& ecs, float dt);
@@ -101,18 +341,27 @@ namespace runtime
         void camera_pass(entity_component_system& ecs, float dt);
 
         //-----------------------------------------------------------------------------
-        //  Name : scene_pass ()
+        //  Name : deferred_render_full ()
         /// <summary>
-        ///
-        ///
-        ///
+        /// Builds the frame graph of a view out of the deferred passes, compiles
+        /// and executes it. The output, and for cameras the g-buffer and depth,
+        /// are imported from the render view since the editor reads them after
+        /// the frame. The other targets are transient and shared with the graphs
+        /// of the other views; in a camera graph their lifetimes all overlap, so
+        /// the pool is the only saving there. Probe faces render to a transient
+        /// output, which reuses a g-buffer target, and blit it to their face of
+        /// probe_cubemap. They do not sample the reflection probes.
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> deferred_render_full(camera&                               camera,
-                                                                gfx::render_view&                     render_view,
-                                                                entity_component_system&              ecs,
-                                                                std::unordered_map<entity, lod_data>& camera_lods,
-                                                                float                                 dt);
+        void deferred_render_full(camera&                  camera,
+                                  gfx::render_view&        render_view,
+                                  entity_component_system& ecs,
+                                  entity                   view_owner,
+                                  visibility_set_models_t& visibility_set,
+                                  view_lods&               camera_lods,
+                                  float                    dt,
+                                  gfx::texture*            probe_cubemap = nullptr,
+                                  std::uint16_t            probe_face    = 0);
 
         //-----------------------------------------------------------------------------
         //  Name : g_buffer_pass ()
@@ -122,12 +371,7 @@ namespace runtime
         ///
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> g_buffer_pass(std::shared_ptr<gfx::frame_buffer>    input,
-                                                         camera&                               camera,
-                                                         gfx::render_view&                     render_view,
-                                                         visibility_set_models_t&              visibility_set,
-                                                         std::unordered_map<entity, lod_data>& camera_lods,
-                                                         float                                 dt);
+        void g_buffer_pass(frame_graph::context& ctx, camera& camera, visibility_set_models_t& visibility_set, view_lods& camera_lods, float dt);
 
         //-----------------------------------------------------------------------------
         //  Name : lighting_pass ()
@@ -137,25 +381,25 @@ namespace runtime
         ///
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> lighting_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                         camera&                            camera,
-                                                         gfx::render_view&                  render_view,
-                                                         entity_component_system&           ecs,
-                                                         float                              dt);
+        void lighting_pass(frame_graph::context&     ctx,
+                           const deferred_resources& resources,
+                           camera&                   camera,
+                           entity_component_system&  ecs,
+                           entity                    view_owner,
+                           float                     dt);
 
         //-----------------------------------------------------------------------------
         //  Name : reflection_probe ()
         /// <summary>
-        ///
-        ///
-        ///
+        /// Only clears the reflection buffer when draw_probes is false.
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> reflection_probe_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                                 camera&                            camera,
-                                                                 gfx::render_view&                  render_view,
-                                                                 entity_component_system&           ecs,
-                                                                 float                              dt);
+        void reflection_probe_pass(frame_graph::context&     ctx,
+                                   const deferred_resources& resources,
+                                   camera&                   camera,
+                                   entity_component_system&  ecs,
+                                   bool                      draw_probes,
+                                   float                     dt);
 
         //-----------------------------------------------------------------------------
         //  Name : atmospherics_pass ()
@@ -165,11 +409,7 @@ namespace runtime
         ///
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> atmospherics_pass(std::shared_ptr<gfx::frame_buffer> input,
-                                                             camera&                            camera,
-                                                             gfx::render_view&                  render_view,
-                                                             entity_component_system&           ecs,
-                                                             float                              dt);
+        void atmospherics_pass(frame_graph::context& ctx, camera& camera, entity_component_system& ecs, float dt);
 
         //-----------------------------------------------------------------------------
         //  Name : tonemapping_pass ()
@@ -179,16 +419,89 @@ namespace runtime
         ///
         /// </summary>
         //-----------------------------------------------------------------------------
-        std::shared_ptr<gfx::frame_buffer> tonemapping_pass(std::shared_ptr<gfx::frame_buffer> input, camera& camera, gfx::render_view& render_view);
+        void tonemapping_pass(frame_graph::context& ctx, const deferred_resources& resources, camera& camera);
 
     private:
-        std::unordered_map<entity, std::unordered_map<entity, lod_data>> lod_data_;
+        //-----------------------------------------------------------------------------
+        //  Name : find_shadow ()
+        /// <summary>
+        /// Shadow map of a light rendered this frame, directional ones are looked
+        /// up for the camera owning the view. nullptr if none.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        const light_shadow* find_shadow(entity light, light_type type, entity view_owner) const;
+
+        //-----------------------------------------------------------------------------
+        //  Name : render_shadow_casters ()
+        /// <summary>
+        /// Draws the static and / or dynamic casters culled for a shadow map face
+        /// into its rect of fbo, clearing the rect first when static ones are drawn.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void render_shadow_casters(const light_shadow::face& face, const gfx::frame_buffer* fbo, bool draw_static, bool draw_dynamic);
+
+        /// Lod state per camera, and per cube face for reflection probes.
+        std::unordered_map<entity, std::vector<view_lods>> lod_data_;
+        /// World bounding spheres and screen coverage of the models drawn by
+        /// g_buffer_pass, reused between passes.
+        math::bsphere_soa  lod_spheres_;
+        std::vector<float> lod_coverage_;
+        /// Views of the current frame, see gather_views.
+        std::vector<view_visibility> views_;
+        /// Draws of the g-buffer pass, reused between passes and frames.
+        render_queue g_buffer_queue_;
+        /// Lod blend parameters of each g-buffer draw.
+        std::vector<math::vec3> lod_params_;
+        /// Point and spot lights of the lighting pass, binned per cluster.
+        light_clusters light_clusters_;
+        /// Cluster data sampled by the clustered light program.
+        std::shared_ptr<gfx::texture> cluster_light_data_;
+        std::shared_ptr<gfx::texture> cluster_light_grid_;
+        std::shared_ptr<gfx::texture> cluster_light_indices_;
+        /// Shadow maps per light and view owner, cameras for directional lights
+        /// and an invalid entity for the others.
+        std::unordered_map<entity, std::unordered_map<entity, light_shadow>> shadows_;
+        /// Casters of the shadow map face being rendered.
+        render_queue shadow_queue_;
+        /// World bounds of the shadow casters changed this frame, and the
+        /// culling result of testing them against a face.
+        math::bbox_soa             shadow_caster_bounds_;
+        std::vector<std::uint32_t> shadow_caster_mask_;
+        /// World bounds and caster flags of the static casters, as last seen.
+        std::unordered_map<entity, static_caster> static_casters_;
+        /// Previous bounds of the casters that moved, were removed or stopped
+        /// casting this frame.
+        std::vector<math::bbox> stale_shadow_bounds_;
+        std::vector<math::bbox> stale_reflection_bounds_;
+        /// Passes of the view being rendered, rebuilt for every view.
+        frame_graph frame_graph_;
+        /// Transient targets shared by the frame graphs of all views.
+        frame_graph_pool frame_graph_pool_;
+        /// Reflection probe updates in progress.
+        std::unordered_map<entity, probe_update> probe_updates_;
+        /// Capture volumes of the reflection probes, leaves hold entity slots.
+        math::aabb_tree     probe_index_;
+        std::vector<entity> probe_index_owners_;
+        std::uint64_t       frame_index_       = 0;
+        std::uint32_t       probe_face_budget_ = 2;
+        /// Read positions in the transform and model change journals.
+        std::uint64_t transform_changes_ = 0;
+        std::uint64_t model_changes_     = 0;
         /// Program that is responsible for rendering.
         std::unique_ptr<gpu_program> directional_light_program_;
         /// Program that is responsible for rendering.
         std::unique_ptr<gpu_program> point_light_program_;
         /// Program that is responsible for rendering.
         std::unique_ptr<gpu_program> spot_light_program_;
+        /// Programs that render shadow casters, depth only.
+        std::unique_ptr<gpu_program> shadow_program_;
+        std::unique_ptr<gpu_program> shadow_skinned_program_;
+        /// Light programs sampling a shadow map.
+        std::unique_ptr<gpu_program> directional_light_shadow_program_;
+        std::unique_ptr<gpu_program> point_light_shadow_program_;
+        std::unique_ptr<gpu_program> spot_light_shadow_program_;
+        /// Program that shades all the clustered lights in one draw.
+        std::unique_ptr<gpu_program> clustered_light_program_;
         /// Program that is responsible for rendering.
         std::unique_ptr<gpu_program> box_ref_probe_program_;
         /// Program that is responsible for rendering.
@@ -1,5 +1,4 @@
 #include "scene_graph.h"
-#include "../../system/events.h"
 #include "../components/transform_component.h"
 
 #include <core/system/subsystem.h>
@@ -7,35 +6,107 @@
 namespace runtime
 {
 
-    void scene_graph::frame_update(float dt)
+    const std::vector<entity>& scene_graph::get_roots() const
     {
-        auto& ecs = core::get_subsystem<runtime::entity_component_system>();
-        roots_.clear();
-        auto all_entities = ecs.all_entities();
-        for (const auto entity : all_entities)
+        if (removed_ > 0)
         {
-            auto transform_comp = entity.get_component<transform_component>().lock();
-            if (transform_comp)
+            std::size_t count = 0;
+            for (const auto& root : roots_)
             {
-                auto parent = transform_comp->get_parent();
-                if (parent.valid() == false)
+                if (root != entity())
                 {
-                    roots_.push_back(entity);
+                    positions_[root.id().index()] = static_cast<std::uint32_t>(count);
+                    roots_[count++]               = root;
                 }
             }
-            else
-            {
-                roots_.push_back(entity);
-            }
+            roots_.resize(count);
+            removed_ = 0;
         }
+
+        return roots_;
     }
 
-    scene_graph::scene_graph()
+    void scene_graph::set_root(entity e, bool root)
+    {
+        const auto index = e.id().index();
+        if (positions_.size() <= index)
+        {
+            positions_.resize(index + 1, npos);
+        }
+
+        auto& position = positions_[index];
+        if (root && position == npos)
+        {
+            position = static_cast<std::uint32_t>(roots_.size());
+            roots_.push_back(e);
+        }
+        else if (!root && position != npos)
+        {
+            roots_[position] = entity();
+            position         = npos;
+            ++removed_;
+        }
+    }
+
+    void scene_graph::entity_created(entity e) { set_root(e, true); }
+
+    void scene_graph::entity_destroyed(entity e) { set_root(e, false); }
+
+    void scene_graph::component_added(entity e, chandle<component> component)
+    {
+        auto transform_comp = std::dynamic_pointer_cast<transform_component>(component.lock());
+        if (transform_comp)
+        {
+            set_root(e, !transform_comp->get_parent().valid());
+        }
+    }
+
+    void scene_graph::component_removed(entity e, chandle<component> component)
+    {
+        if (std::dynamic_pointer_cast<transform_component>(component.lock()))
+        {
+            set_root(e, true);
+        }
+    }
+
+    void scene_graph::parent_changed(entity e)
     {
-        runtime::on_frame_update.connect(this, &scene_graph::frame_update);
+        if (!e.valid())
+        {
+            return;
+        }
+
+        auto transform_comp = e.get_component<transform_component>().lock();
+        if (transform_comp)
+        {
+            set_root(e, !transform_comp->get_parent().valid());
+        }
+    }
 
+    scene_graph::scene_graph()
+    {
         transform_component::static_id();
+
+        auto& ecs = core::get_subsystem<runtime::entity_component_system>();
+        for (const auto entity : ecs.all_entities())
+        {
+            auto transform_comp = entity.get_component<transform_component>().lock();
+            set_root(entity, !transform_comp || !transform_comp->get_parent().valid());
+        }
+
+        runtime::on_entity_created.connect(this, &scene_graph::entity_created);
+        runtime::on_entity_destroyed.connect(this, &scene_graph::entity_destroyed);
+        runtime::on_component_added.connect(this, &scene_graph::component_added);
+        runtime::on_component_removed.connect(this, &scene_graph::component_removed);
+        runtime::on_parent_changed.connect(this, &scene_graph::parent_changed);
     }
 
-    scene_graph::~scene_graph() { runtime::on_frame_update.disconnect(this, &scene_graph::frame_update); }
+    scene_graph::~scene_graph()
+    {
+        runtime::on_entity_created.disconnect(this, &scene_graph::entity_created);
+        runtime::on_entity_destroyed.disconnect(this, &scene_graph::entity_destroyed);
+        runtime::on_component_added.disconnect(this, &scene_graph::component_added);
+        runtime::on_component_removed.disconnect(this, &scene_graph::component_removed);
+        runtime::on_parent_changed.disconnect(this, &scene_graph::parent_changed);
+    }
 } // namespace runtime
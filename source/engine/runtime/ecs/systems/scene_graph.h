@@ -4,6 +4,7 @@
 
 #include <core/common_lib/basetypes.hpp>
 
+#include <cstdint>
 #include <vector>
 
 namespace runtime
@@ -13,28 +14,38 @@ namespace runtime
     public:
         scene_graph();
         ~scene_graph();
+
         //-----------------------------------------------------------------------------
-        //  Name : frame_update (virtual )
+        //  Name : getRoots ()
         /// <summary>
-        ///
-        ///
-        ///
+        /// Entities without a parent, in the order they became roots. Kept up to
+        /// date from the ecs and hierarchy events, so this does not scan.
         /// </summary>
         //-----------------------------------------------------------------------------
-        void frame_update(float dt);
+        const std::vector<entity>& get_roots() const;
 
+    private:
+        void entity_created(entity e);
+        void entity_destroyed(entity e);
+        void component_added(entity e, chandle<component> component);
+        void component_removed(entity e, chandle<component> component);
+        void parent_changed(entity e);
         //-----------------------------------------------------------------------------
-        //  Name : getRoots ()
+        //  Name : set_root ()
         /// <summary>
-        ///
-        ///
-        ///
+        /// Adds the entity to the roots or takes it out.
         /// </summary>
         //-----------------------------------------------------------------------------
-        const std::vector<entity>& get_roots() const { return roots_; }
+        void set_root(entity e, bool root);
 
-    private:
-        /// scene roots
-        std::vector<entity> roots_;
+        static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+        /// scene roots, removed ones are left as invalid entries until the next
+        /// get_roots() so that the order of the others does not change.
+        mutable std::vector<entity> roots_;
+        /// Position of every entity slot in roots_, npos when not a root.
+        mutable std::vector<std::uint32_t> positions_;
+        /// Number of invalid entries in roots_.
+        mutable std::size_t removed_ = 0;
     };
 } // namespace runtime
@@ -0,0 +1,206 @@
+#include "spatial_index.h"
+#include "../../rendering/mesh.h"
+#include "../../rendering/model.h"
+#include "../../system/events.h"
+#include "../components/model_component.h"
+#include "../components/transform_component.h"
+
+#include <core/system/subsystem.h>
+
+#include <algorithm>
+
+namespace runtime
+{
+    namespace
+    {
+        /// World bounds of the first lod, false while the mesh is not loaded.
+        bool get_world_bounds(const transform_component& transform_comp, const model_component& model_comp, math::bbox& bounds)
+        {
+            const auto mesh = model_comp.get_model().get_lod(0);
+            if (!mesh)
+            {
+                return false;
+            }
+
+            bounds = math::bbox::mul(mesh->get_bounds(), transform_comp.get_transform());
+            return true;
+        }
+
+        /// Leaves are fattened by a tenth of their size so that small motions
+        /// stay inside them.
+        math::vec3 get_margin(const math::bbox& bounds) { return (bounds.max - bounds.min) * 0.1f + math::vec3(0.05f); }
+    } // namespace
+
+    void spatial_index::remove(std::uint32_t slot)
+    {
+        if (leaves_[slot] != npos)
+        {
+            tree_.remove(leaves_[slot]);
+            leaves_[slot] = npos;
+        }
+        entities_[slot] = entity();
+    }
+
+    void spatial_index::grow(std::size_t size)
+    {
+        if (size > leaves_.size())
+        {
+            leaves_.resize(size, npos);
+            entities_.resize(size);
+            bounds_.resize(size);
+        }
+    }
+
+    void spatial_index::update(entity_component_system& ecs, entity e)
+    {
+        const auto slot = e.id().index();
+        grow(slot + 1);
+
+        // The slot may still hold the leaf of e, or of the entity it was recycled
+        // from, after they were destroyed.
+        if (leaves_[slot] != npos && !entities_[slot].valid())
+        {
+            remove(slot);
+        }
+
+        if (!e.valid())
+        {
+            return;
+        }
+
+        const bool found = ecs.visit<const transform_component, const model_component>(
+            e, [this, slot](entity owner, const transform_component& transform_comp, const model_component& model_comp) {
+                math::bbox bounds;
+                if (!get_world_bounds(transform_comp, model_comp, bounds))
+                {
+                    remove(slot);
+                    pending_.emplace_back(owner);
+                    return;
+                }
+
+                if (leaves_[slot] == npos)
+                {
+                    leaves_[slot] = tree_.insert(bounds, get_margin(bounds), slot);
+                }
+                else
+                {
+                    tree_.move(leaves_[slot], bounds, get_margin(bounds));
+                }
+                entities_[slot] = owner;
+                bounds_.set(slot, bounds);
+            });
+
+        if (!found)
+        {
+            remove(slot);
+        }
+    }
+
+    void spatial_index::rebuild(entity_component_system& ecs)
+    {
+        tree_.clear();
+        leaves_.clear();
+        entities_.clear();
+        bounds_.clear();
+        pending_.clear();
+        grow(ecs.capacity());
+
+        ecs.query<const transform_component, const model_component>().each(
+            [this](entity e, const transform_component& transform_comp, const model_component& model_comp) {
+                const auto slot = e.id().index();
+                grow(slot + 1);
+
+                math::bbox bounds;
+                if (!get_world_bounds(transform_comp, model_comp, bounds))
+                {
+                    pending_.emplace_back(e);
+                    return;
+                }
+
+                leaves_[slot]   = tree_.insert(bounds, get_margin(bounds), slot);
+                entities_[slot] = e;
+                bounds_.set(slot, bounds);
+            });
+
+        built_ = true;
+    }
+
+    void spatial_index::cull(const math::frustum& frustum, std::vector<entity>& visible) const
+    {
+        std::vector<std::uint32_t> undecided;
+        tree_.query(frustum, [this, &visible, &undecided](std::uint32_t slot, bool inside) {
+            if (inside)
+            {
+                visible.emplace_back(entities_[slot]);
+            }
+            else
+            {
+                undecided.emplace_back(slot);
+            }
+        });
+
+        math::bbox_soa bounds;
+        bounds.resize(undecided.size());
+        for (std::size_t i = 0; i < undecided.size(); ++i)
+        {
+            const auto slot = undecided[i];
+            bounds.min_x[i] = bounds_.min_x[slot];
+            bounds.min_y[i] = bounds_.min_y[slot];
+            bounds.min_z[i] = bounds_.min_z[slot];
+            bounds.max_x[i] = bounds_.max_x[slot];
+            bounds.max_y[i] = bounds_.max_y[slot];
+            bounds.max_z[i] = bounds_.max_z[slot];
+        }
+
+        std::vector<std::uint32_t> bits;
+        frustum.test_aabbs(bounds, bits);
+        for (std::size_t i = 0; i < undecided.size(); ++i)
+        {
+            if ((bits[i >> 5] >> (i & 31)) & 1u)
+            {
+                visible.emplace_back(entities_[undecided[i]]);
+            }
+        }
+    }
+
+    void spatial_index::frame_render(float dt)
+    {
+        auto& ecs = core::get_subsystem<entity_component_system>();
+
+        std::vector<entity> changed;
+        auto                collect = [&changed](entity e, change_kind kind) { changed.emplace_back(e); };
+
+        bool complete = ecs.for_each_change<transform_component>(transform_changes_, collect);
+        complete &= ecs.for_each_change<model_component>(model_changes_, collect);
+
+        std::sort(changed.begin(), changed.end());
+        changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+        if (!built_ || !complete)
+        {
+            rebuild(ecs);
+        }
+        else
+        {
+            std::vector<entity> work;
+            work.reserve(changed.size() + recheck_.size() + pending_.size());
+            work.insert(work.end(), changed.begin(), changed.end());
+            work.insert(work.end(), recheck_.begin(), recheck_.end());
+            work.insert(work.end(), pending_.begin(), pending_.end());
+            pending_.clear();
+
+            std::sort(work.begin(), work.end());
+            work.erase(std::unique(work.begin(), work.end()), work.end());
+            for (auto& e : work)
+            {
+                update(ecs, e);
+            }
+        }
+
+        recheck_ = std::move(changed);
+    }
+
+    spatial_index::spatial_index() { runtime::on_frame_render.connect(this, &spatial_index::frame_render); }
+
+    spatial_index::~spatial_index() { runtime::on_frame_render.disconnect(this, &spatial_index::frame_render); }
+} // namespace runtime
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "../ecs.h"
+
+#include <core/common_lib/basetypes.hpp>
+#include <core/math/aabb_tree.h>
+#include <core/math/bbox_soa.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace runtime
+{
+    //-----------------------------------------------------------------------------
+    //  Name : spatial_index (Class)
+    /// <summary>
+    /// World space bounding volume hierarchy over every entity with a transform
+    /// and a loaded model. It follows the transform and model change journals
+    /// right after the transforms are resolved each frame, so visibility and
+    /// proximity queries only walk the part of the scene they touch.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    class spatial_index
+    {
+    public:
+        spatial_index();
+        ~spatial_index();
+        //-----------------------------------------------------------------------------
+        //  Name : frame_render ()
+        /// <summary>
+        /// Brings the tree up to date with the entities changed since last frame.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void frame_render(float dt);
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(entity, fully_inside) for the entities whose bounds may be
+        /// visible in the frustum. When fully_inside is true the bounds are known
+        /// to be inside and need no further test.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const math::frustum& frustum, F&& f) const
+        {
+            tree_.query(frustum, [this, &f](std::uint32_t slot, bool inside) { f(entities_[slot], inside); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : cull ()
+        /// <summary>
+        /// Appends the entities whose world bounds are not outside the frustum.
+        /// The tree drops whole subtrees, the leaves it can not decide on are
+        /// tested in batches against their tight bounds. Safe to call from
+        /// several threads at once.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void cull(const math::frustum& frustum, std::vector<entity>& visible) const;
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(entity) for the entities whose bounds may touch the sphere.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const math::vec3& center, float radius, F&& f) const
+        {
+            tree_.query(center, radius, [this, &f](std::uint32_t slot) { f(entities_[slot]); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : query ()
+        /// <summary>
+        /// Calls f(entity) for the entities whose bounds may overlap bounds.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void query(const math::bbox& bounds, F&& f) const
+        {
+            tree_.query(bounds, [this, &f](std::uint32_t slot) { f(entities_[slot]); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : raycast ()
+        /// <summary>
+        /// Calls f(entity, t) for the entities whose bounds may be hit by the
+        /// segment origin + velocity * t, t in [0, 1], in no particular order.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void raycast(const math::vec3& origin, const math::vec3& velocity, F&& f) const
+        {
+            tree_.raycast(origin, velocity, [this, &f](std::uint32_t slot, float t) { f(entities_[slot], t); });
+        }
+
+        //-----------------------------------------------------------------------------
+        //  Name : is_built ()
+        /// <summary>
+        /// False until the first frame_render, queries find nothing before that.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        inline bool is_built() const { return built_; }
+
+    private:
+        //-----------------------------------------------------------------------------
+        //  Name : rebuild ()
+        /// <summary>
+        /// Drops the tree and inserts every entity with a transform and a model.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void rebuild(entity_component_system& ecs);
+
+        //-----------------------------------------------------------------------------
+        //  Name : update ()
+        /// <summary>
+        /// Inserts, moves or removes the leaf of a single entity.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void update(entity_component_system& ecs, entity e);
+
+        void remove(std::uint32_t slot);
+        void grow(std::size_t size);
+
+        static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+        math::aabb_tree tree_;
+        /// Tree leaf of each entity slot, npos when not in the tree.
+        std::vector<std::uint32_t> leaves_;
+        /// Entity owning each slot's leaf, to notice recycled slots.
+        std::vector<entity> entities_;
+        /// Tight world bounds of each slot, the leaves only keep fattened ones.
+        math::bbox_soa bounds_;
+        /// Entities waiting for their mesh to load.
+        std::vector<entity> pending_;
+        /// Entities changed last frame. A second touch within a frame is not
+        /// journaled, so they are looked at once more.
+        std::vector<entity> recheck_;
+        /// Read positions in the transform and model change journals.
+        std::uint64_t transform_changes_ = 0;
+        std::uint64_t model_changes_     = 0;
+        bool          built_             = false;
+    };
+} // namespace runtime
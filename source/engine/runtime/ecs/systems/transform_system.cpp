@@ -0,0 +1,183 @@
+#include "transform_system.h"
+#include "../../system/events.h"
+#include "../components/transform_component.h"
+
+#include <core/system/subsystem.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace runtime
+{
+
+    void transform_system::rebuild(entity_component_system& ecs)
+    {
+        std::vector<transform_component*> found;
+        std::vector<std::uint32_t>        node_of_slot(ecs.capacity(), npos);
+        ecs.query<transform_component>().each([&found, &node_of_slot](entity e, transform_component& transform_comp) {
+            node_of_slot[e.id().index()] = static_cast<std::uint32_t>(found.size());
+            found.push_back(&transform_comp);
+        });
+
+        const auto                 count = found.size();
+        std::vector<std::uint32_t> parent(count, npos);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const auto& parent_entity = found[i]->get_parent();
+            if (parent_entity.valid() && parent_entity.id().index() < node_of_slot.size())
+            {
+                parent[i] = node_of_slot[parent_entity.id().index()];
+            }
+        }
+
+        // Depth of every node, walking up until a node with a known depth.
+        std::vector<std::uint32_t> depth(count, npos);
+        std::vector<std::uint32_t> chain;
+        std::uint32_t              max_depth = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto node = static_cast<std::uint32_t>(i);
+            while (node != npos && depth[node] == npos)
+            {
+                chain.push_back(node);
+                node = parent[node];
+            }
+
+            auto d = node == npos ? 0 : depth[node] + 1;
+            while (!chain.empty())
+            {
+                depth[chain.back()] = d++;
+                chain.pop_back();
+            }
+            max_depth = std::max(max_depth, depth[i]);
+        }
+
+        // Counting sort by depth.
+        levels_.assign(count > 0 ? max_depth + 2 : 1, 0);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ++levels_[depth[i] + 1];
+        }
+        for (std::size_t level = 1; level < levels_.size(); ++level)
+        {
+            levels_[level] += levels_[level - 1];
+        }
+
+        std::vector<std::uint32_t> position(count);
+        auto                       next = levels_;
+        nodes_.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            position[i]         = static_cast<std::uint32_t>(next[depth[i]]++);
+            nodes_[position[i]] = found[i];
+        }
+
+        parents_.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            parents_[position[i]] = parent[i] == npos ? npos : position[parent[i]];
+        }
+
+        for (auto& node : node_of_slot)
+        {
+            if (node != npos)
+            {
+                node = position[node];
+            }
+        }
+        node_of_slot_ = std::move(node_of_slot);
+
+        built_ = true;
+    }
+
+    template<typename F>
+    void transform_system::resolve_levels(std::size_t first, std::size_t last, const F& node_at)
+    {
+        std::size_t level = 0;
+        while (first < last)
+        {
+            // Nodes up to the end of the level of the first one.
+            while (levels_[level + 1] <= node_at(first))
+            {
+                ++level;
+            }
+
+            auto level_end = first + 1;
+            while (level_end < last && node_at(level_end) < levels_[level + 1])
+            {
+                ++level_end;
+            }
+
+            runtime::ecs::parallel_for(level_end - first, 256, [this, first, &node_at](std::size_t begin, std::size_t end) {
+                for (std::size_t i = first + begin; i < first + end; ++i)
+                {
+                    const auto index = node_at(i);
+                    auto       node  = nodes_[index];
+                    if (!node->is_dirty())
+                    {
+                        continue;
+                    }
+
+                    const auto parent = parents_[index];
+                    node->resolve_from(parent == npos ? nullptr : &std::as_const(*nodes_[parent]).get_transform());
+                }
+            });
+            first = level_end;
+        }
+    }
+
+    void transform_system::frame_render(float dt)
+    {
+        auto& ecs = core::get_subsystem<entity_component_system>();
+
+        // Reparenting bumps the hierarchy version, adding or removing a component
+        // shows up in the journal. Making a node dirty touches it and its whole
+        // subtree, so the modified entries are every node needing a resolve.
+        const auto version  = transform_component::get_hierarchy_version();
+        bool       changed  = !built_ || version != hierarchy_version_;
+        bool       complete = ecs.for_each_change<transform_component>(changes_, [this, &changed](entity e, change_kind kind) {
+            if (kind != change_kind::modified)
+            {
+                changed = true;
+            }
+            else if (!changed)
+            {
+                dirty_.push_back(e.id().index());
+            }
+        });
+
+        if (changed || !complete)
+        {
+            dirty_.clear();
+            hierarchy_version_ = version;
+            rebuild(ecs);
+            resolve_levels(0, nodes_.size(), [](std::size_t i) { return i; });
+            return;
+        }
+
+        if (dirty_.empty())
+        {
+            return;
+        }
+
+        // Node positions are sorted by depth, so the sorted dirty positions
+        // form the same levels.
+        for (auto& slot : dirty_)
+        {
+            slot = slot < node_of_slot_.size() ? node_of_slot_[slot] : npos;
+        }
+        std::sort(dirty_.begin(), dirty_.end());
+        dirty_.erase(std::unique(dirty_.begin(), dirty_.end()), dirty_.end());
+        while (!dirty_.empty() && dirty_.back() == npos)
+        {
+            dirty_.pop_back();
+        }
+
+        resolve_levels(0, dirty_.size(), [this](std::size_t i) { return std::size_t(dirty_[i]); });
+        dirty_.clear();
+    }
+
+    transform_system::transform_system() { runtime::on_frame_render.connect(this, &transform_system::frame_render); }
+
+    transform_system::~transform_system() { runtime::on_frame_render.disconnect(this, &transform_system::frame_render); }
+} // namespace runtime
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../ecs.h"
+
+#include <core/common_lib/basetypes.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class transform_component;
+
+namespace runtime
+{
+    //-----------------------------------------------------------------------------
+    //  Name : transform_system (Class)
+    /// <summary>
+    /// Resolves the world transforms of the whole hierarchy once per frame before
+    /// rendering. The hierarchy is kept as a flat array sorted by depth, so every
+    /// level only reads the already resolved level above it and is split across
+    /// the task_system workers. Only the nodes the transform journal reports as
+    /// modified are visited, frames without changes do no work.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    class transform_system
+    {
+    public:
+        transform_system();
+        ~transform_system();
+        //-----------------------------------------------------------------------------
+        //  Name : frame_render ()
+        /// <summary>
+        /// Rebuilds the flat hierarchy if it changed and resolves it level by level.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void frame_render(float dt);
+
+    private:
+        //-----------------------------------------------------------------------------
+        //  Name : rebuild ()
+        /// <summary>
+        /// Collects every transform_component and sorts them by depth.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        void rebuild(entity_component_system& ecs);
+
+        //-----------------------------------------------------------------------------
+        //  Name : resolve_levels ()
+        /// <summary>
+        /// Resolves the dirty nodes among node_at(first) .. node_at(last - 1),
+        /// positions in nodes_ in ascending order, one level at a time.
+        /// </summary>
+        //-----------------------------------------------------------------------------
+        template<typename F>
+        void resolve_levels(std::size_t first, std::size_t last, const F& node_at);
+
+        static constexpr std::uint32_t npos = ~std::uint32_t(0);
+
+        /// Components sorted by depth, roots first.
+        std::vector<transform_component*> nodes_;
+        /// Position of the parent of each node in nodes_, npos for roots.
+        std::vector<std::uint32_t> parents_;
+        /// Offsets of every depth in nodes_, one past the last level at the end.
+        std::vector<std::size_t> levels_;
+        /// Position in nodes_ of each entity slot, npos for slots without a transform.
+        std::vector<std::uint32_t> node_of_slot_;
+        /// Nodes the journal reported modified this frame.
+        std::vector<std::uint32_t> dirty_;
+        /// transform_component::get_hierarchy_version() nodes_ was built for.
+        std::uint64_t hierarchy_version_ = 0;
+        /// Read position in the transform change journal.
+        std::uint64_t changes_ = 0;
+        bool          built_   = false;
+    };
+} // namespace runtime
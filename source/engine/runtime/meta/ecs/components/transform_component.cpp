@@ -16,7 +16,9 @@ REFLECT(transform_component)
             rttr::metadata("tooltip",
                            "This is the local transformation.\n"
                            "It is relative to the parent."))
-        .property("world", &transform_component::get_transform, &transform_component::set_transform)(
+        .property("world",
+                  static_cast<const math::transform& (transform_component::*)()>(&transform_component::get_transform),
+                  &transform_component::set_transform)(
             rttr::metadata("pretty_name", "World"),
             rttr::metadata("tooltip",
                            "This is the world transformation.\n"
@@ -46,6 +48,7 @@ LOAD(transform_component)
             if (child_transform)
             {
                 child_transform->parent_ = obj.get_entity();
+                runtime::on_parent_changed(child);
             }
         }
     }
@@ -16,9 +16,9 @@ namespace runtime
 
     SAVE(entity)
     {
-        // TODO check for validity
-
-        auto id = obj.id().id();
+        // A dangling reference is written as invalid, the loader would otherwise
+        // expect the name and components that follow a live one.
+        auto id = obj.valid() ? obj.id().id() : entity::INVALID.id();
         try_save(ar, cereal::make_nvp("entity_id", id));
 
         if (obj.valid())
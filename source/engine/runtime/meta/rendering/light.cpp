@@ -46,6 +46,7 @@ REFLECT(light)
         .property("intensity",
                   &light::intensity)(rttr::metadata("pretty_name", "Intensity"), rttr::metadata("min", 0.0f), rttr::metadata("max", 20.0f))
         .property("type", &light::type)(rttr::metadata("pretty_name", "Type"))
+        .property("casts_shadows", &light::casts_shadows)(rttr::metadata("pretty_name", "Casts Shadows"))
         .property("shadow", &light::shadow)(rttr::metadata("pretty_name", "Shadow"))
         .property("depth", &light::depth)(rttr::metadata("pretty_name", "Depth"));
 }
@@ -55,6 +56,7 @@ SAVE(light)
     try_save(ar, cereal::make_nvp("type", obj.type));
     try_save(ar, cereal::make_nvp("depth", obj.depth));
     try_save(ar, cereal::make_nvp("shadow", obj.shadow));
+    try_save(ar, cereal::make_nvp("casts_shadows", obj.casts_shadows));
     try_save(ar, cereal::make_nvp("spot_range", obj.spot_data.range));
     try_save(ar, cereal::make_nvp("spot_inner_angle", obj.spot_data.inner_angle));
     try_save(ar, cereal::make_nvp("spot_outer_angle", obj.spot_data.outer_angle));
@@ -77,6 +79,7 @@ LOAD(light)
     try_load(ar, cereal::make_nvp("type", obj.type));
     try_load(ar, cereal::make_nvp("depth", obj.depth));
     try_load(ar, cereal::make_nvp("shadow", obj.shadow));
+    try_load(ar, cereal::make_nvp("casts_shadows", obj.casts_shadows));
     try_load(ar, cereal::make_nvp("spot_range", obj.spot_data.range));
     try_load(ar, cereal::make_nvp("spot_inner_angle", obj.spot_data.inner_angle));
     try_load(ar, cereal::make_nvp("spot_outer_angle", obj.spot_data.outer_angle));
@@ -0,0 +1,308 @@
+#include "frame_graph.h"
+
+#include <algorithm>
+
+bool frame_graph::texture_desc::operator==(const texture_desc& other) const
+{
+    return width == other.width && height == other.height && format == other.format && flags == other.flags;
+}
+
+frame_graph::builder::builder(frame_graph& graph, std::uint32_t pass)
+    : graph_(graph)
+    , pass_(pass)
+{
+}
+
+frame_graph::resource frame_graph::builder::create(const std::string& name, const texture_desc& desc)
+{
+    resource_node node;
+    node.name = name;
+    node.desc = desc;
+    graph_.resources_.emplace_back(std::move(node));
+    return resource(graph_.resources_.size() - 1);
+}
+
+frame_graph::resource frame_graph::builder::read(resource r)
+{
+    graph_.passes_[pass_].reads.emplace_back(r);
+    return r;
+}
+
+frame_graph::resource frame_graph::builder::write(resource r)
+{
+    graph_.passes_[pass_].writes.emplace_back(r);
+    graph_.resources_[r].writers.emplace_back(pass_);
+    return r;
+}
+
+void frame_graph::builder::side_effect() { graph_.passes_[pass_].side_effect = true; }
+
+frame_graph::context::context(const frame_graph& graph, gfx::render_pass& pass, const gfx::frame_buffer* fbo)
+    : graph_(graph)
+    , pass_(pass)
+    , fbo_(fbo)
+{
+}
+
+gfx::texture* frame_graph::context::get_texture(resource r) const
+{
+    const auto& node = graph_.resources_[r];
+    if (node.imported)
+    {
+        return node.texture.get();
+    }
+    return node.physical == invalid_index ? nullptr : graph_.textures_[node.physical].get();
+}
+
+void frame_graph::clear()
+{
+    resources_.clear();
+    passes_.clear();
+    physicals_.clear();
+    textures_.clear();
+}
+
+frame_graph::resource frame_graph::import_texture(const std::string& name, std::shared_ptr<gfx::texture> texture)
+{
+    resource_node node;
+    node.name     = name;
+    node.texture  = std::move(texture);
+    node.imported = true;
+    resources_.emplace_back(std::move(node));
+    return resource(resources_.size() - 1);
+}
+
+std::uint32_t frame_graph::add_pass(const std::string& name, const setup_fn& setup, execute_fn execute)
+{
+    const auto index = std::uint32_t(passes_.size());
+    pass_node  node;
+    node.name    = name;
+    node.execute = std::move(execute);
+    passes_.emplace_back(std::move(node));
+
+    builder b(*this, index);
+    setup(b);
+    return index;
+}
+
+void frame_graph::compile()
+{
+    for (auto& node : resources_)
+    {
+        node.readers   = node.imported ? 1 : 0;
+        node.first_use = invalid_index;
+        node.last_use  = invalid_index;
+        node.physical  = invalid_index;
+    }
+
+    // A pass is referenced by every texture it writes, a texture by every
+    // pass reading it. Passes referenced by nothing are culled right away.
+    for (auto& pass : passes_)
+    {
+        pass.refs   = std::uint32_t(pass.writes.size()) + (pass.side_effect ? 1 : 0);
+        pass.culled = pass.refs == 0;
+        if (pass.culled)
+            continue;
+
+        for (const auto r : pass.reads)
+        {
+            ++resources_[r].readers;
+        }
+    }
+
+    // Unread textures release their writers, culled writers release what
+    // they read in turn.
+    stack_.clear();
+    for (resource r = 0; r < resources_.size(); ++r)
+    {
+        if (resources_[r].readers == 0)
+            stack_.emplace_back(r);
+    }
+    while (!stack_.empty())
+    {
+        const auto r = stack_.back();
+        stack_.pop_back();
+        for (const auto writer : resources_[r].writers)
+        {
+            auto& pass = passes_[writer];
+            if (pass.culled || --pass.refs != 0)
+                continue;
+
+            pass.culled = true;
+            for (const auto read : pass.reads)
+            {
+                if (--resources_[read].readers == 0)
+                    stack_.emplace_back(read);
+            }
+        }
+    }
+
+    for (std::uint32_t i = 0; i < passes_.size(); ++i)
+    {
+        const auto& pass = passes_[i];
+        if (pass.culled)
+            continue;
+
+        for (const auto& list : {&pass.reads, &pass.writes})
+        {
+            for (const auto r : *list)
+            {
+                auto& node = resources_[r];
+                if (node.first_use == invalid_index)
+                    node.first_use = i;
+                node.last_use = i;
+            }
+        }
+    }
+
+    // Transient textures take a physical texture of the same description
+    // when they are first used, one whose last user ran before this pass
+    // when there is one.
+    physicals_.clear();
+    for (std::uint32_t i = 0; i < passes_.size(); ++i)
+    {
+        const auto& pass = passes_[i];
+        if (pass.culled)
+            continue;
+
+        for (const auto& list : {&pass.reads, &pass.writes})
+        {
+            for (const auto r : *list)
+            {
+                auto& node = resources_[r];
+                if (node.imported || node.first_use != i || node.physical != invalid_index)
+                    continue;
+
+                std::uint32_t pool_index = 0;
+                for (std::uint32_t p = 0; p < physicals_.size(); ++p)
+                {
+                    auto& physical = physicals_[p];
+                    if (physical.desc != node.desc)
+                        continue;
+
+                    if (physical.last_use < i)
+                    {
+                        node.physical     = p;
+                        physical.last_use = node.last_use;
+                        break;
+                    }
+                    ++pool_index;
+                }
+
+                if (node.physical == invalid_index)
+                {
+                    node.physical = std::uint32_t(physicals_.size());
+                    physicals_.emplace_back(physical_texture{node.desc, node.last_use, pool_index});
+                }
+            }
+        }
+    }
+}
+
+void frame_graph::execute(frame_graph_pool& pool)
+{
+    textures_.resize(physicals_.size());
+    for (std::size_t i = 0; i < physicals_.size(); ++i)
+    {
+        textures_[i] = pool.get_texture(physicals_[i].desc, physicals_[i].pool_index);
+    }
+
+    for (const auto& pass : passes_)
+    {
+        if (pass.culled)
+            continue;
+
+        attachments_.clear();
+        for (const auto r : pass.writes)
+        {
+            const auto& node = resources_[r];
+            attachments_.emplace_back(node.imported ? node.texture : textures_[node.physical]);
+        }
+
+        std::shared_ptr<gfx::frame_buffer> fbo;
+        gfx::render_pass                   render_pass(pass.name);
+        if (!attachments_.empty())
+        {
+            fbo = pool.get_frame_buffer(attachments_);
+            render_pass.bind(fbo.get());
+        }
+
+        context ctx(*this, render_pass, fbo.get());
+        if (pass.execute)
+            pass.execute(ctx);
+    }
+
+    attachments_.clear();
+    textures_.clear();
+}
+
+std::shared_ptr<gfx::texture> frame_graph_pool::get_texture(const frame_graph::texture_desc& desc, std::uint32_t index)
+{
+    auto it = std::find_if(textures_.begin(), textures_.end(), [&desc, index](const texture_entry& entry) {
+        return entry.index == index && entry.desc == desc;
+    });
+    if (it != textures_.end())
+    {
+        it->used = true;
+        return it->texture;
+    }
+
+    const auto    flags = desc.flags != 0 ? desc.flags : gfx::get_default_rt_sampler_flags();
+    texture_entry entry;
+    entry.desc    = desc;
+    entry.index   = index;
+    entry.texture = std::make_shared<gfx::texture>(desc.width, desc.height, false, 1, desc.format, flags);
+    textures_.emplace_back(entry);
+    return entry.texture;
+}
+
+std::shared_ptr<gfx::frame_buffer> frame_graph_pool::get_frame_buffer(const std::vector<std::shared_ptr<gfx::texture>>& attachments)
+{
+    const auto matches = [&attachments](const frame_buffer_entry& entry) {
+        if (entry.attachments.size() != attachments.size())
+            return false;
+
+        for (std::size_t i = 0; i < attachments.size(); ++i)
+        {
+            if (entry.attachments[i] != attachments[i].get())
+                return false;
+        }
+        return true;
+    };
+
+    auto it = std::find_if(frame_buffers_.begin(), frame_buffers_.end(), matches);
+    if (it != frame_buffers_.end())
+    {
+        it->used = true;
+        return it->fbo;
+    }
+
+    // The frame buffer keeps its textures alive, so their addresses stay
+    // unique while the entry exists.
+    frame_buffer_entry entry;
+    for (const auto& texture : attachments)
+    {
+        entry.attachments.emplace_back(texture.get());
+    }
+    entry.fbo = std::make_shared<gfx::frame_buffer>(attachments);
+    frame_buffers_.emplace_back(entry);
+    return entry.fbo;
+}
+
+void frame_graph_pool::release_unused()
+{
+    // Frame buffers first, they hold on to their textures.
+    frame_buffers_.erase(
+        std::remove_if(frame_buffers_.begin(), frame_buffers_.end(), [](const frame_buffer_entry& entry) { return !entry.used; }),
+        frame_buffers_.end());
+    textures_.erase(std::remove_if(textures_.begin(), textures_.end(), [](const texture_entry& entry) { return !entry.used; }), textures_.end());
+
+    for (auto& entry : frame_buffers_)
+    {
+        entry.used = false;
+    }
+    for (auto& entry : textures_)
+    {
+        entry.used = false;
+    }
+}
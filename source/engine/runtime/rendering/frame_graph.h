@@ -0,0 +1,259 @@
+#pragma once
+
+#include <core/graphics/graphics.h>
+#include <core/graphics/render_pass.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class frame_graph_pool;
+
+//-----------------------------------------------------------------------------
+//  Name : frame_graph (Class)
+/// <summary>
+/// The render passes of a view, declared up front with the textures each of
+/// them reads and writes. Textures are either imported, when they outlive the
+/// graph, or transient, described by their size and format and only alive
+/// between the first and the last pass using them. compile culls the passes
+/// whose results reach neither an imported texture nor a pass with side
+/// effects, and packs transient textures whose lifetimes do not overlap onto
+/// the same physical texture. execute runs the remaining passes in the order
+/// they were added, each with a view id of its own and a frame buffer over
+/// the textures it writes, taking the physical textures from a pool shared by
+/// every graph of the frame. Building and compiling need no renderer.
+/// </summary>
+//-----------------------------------------------------------------------------
+class frame_graph
+{
+public:
+    using resource = std::uint32_t;
+    static constexpr resource      invalid_resource = ~resource(0);
+    static constexpr std::uint32_t invalid_index    = ~std::uint32_t(0);
+
+    struct texture_desc
+    {
+        std::uint16_t       width  = 0;
+        std::uint16_t       height = 0;
+        gfx::texture_format format = gfx::texture_format::Unknown;
+        /// Texture and sampler flags, 0 takes the default render target ones.
+        std::uint64_t flags = 0;
+
+        bool operator==(const texture_desc& other) const;
+        bool operator!=(const texture_desc& other) const { return !(*this == other); }
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : builder (Class)
+    /// <summary>
+    /// Handed to the setup function of a pass to declare its textures.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    class builder
+    {
+    public:
+        builder(frame_graph& graph, std::uint32_t pass);
+
+        /// A transient texture, it still has to be written by this or a later pass.
+        resource create(const std::string& name, const texture_desc& desc);
+        /// The pass samples the texture.
+        resource read(resource r);
+        /// The texture becomes an attachment of the pass frame buffer, in call order.
+        resource write(resource r);
+        /// Keeps the pass even when nothing uses what it writes.
+        void side_effect();
+
+    private:
+        frame_graph&  graph_;
+        std::uint32_t pass_ = 0;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : context (Class)
+    /// <summary>
+    /// Handed to the execute function of a pass. The render pass is already
+    /// bound to the frame buffer of the written textures, when there are any.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    class context
+    {
+    public:
+        context(const frame_graph& graph, gfx::render_pass& pass, const gfx::frame_buffer* fbo);
+
+        inline gfx::render_pass&        get_pass() const { return pass_; }
+        inline const gfx::frame_buffer* get_frame_buffer() const { return fbo_; }
+        gfx::texture*                   get_texture(resource r) const;
+
+    private:
+        const frame_graph&       graph_;
+        gfx::render_pass&        pass_;
+        const gfx::frame_buffer* fbo_ = nullptr;
+    };
+
+    using setup_fn   = std::function<void(builder&)>;
+    using execute_fn = std::function<void(context&)>;
+
+    //-----------------------------------------------------------------------------
+    //  Name : clear ()
+    /// <summary>
+    /// Drops the passes and the textures, keeping the memory for the next graph.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void clear();
+
+    //-----------------------------------------------------------------------------
+    //  Name : import_texture ()
+    /// <summary>
+    /// A texture owned outside the graph. Passes writing it are never culled
+    /// and it is never shared with other textures.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    resource import_texture(const std::string& name, std::shared_ptr<gfx::texture> texture);
+
+    //-----------------------------------------------------------------------------
+    //  Name : add_pass ()
+    /// <summary>
+    /// Adds a pass and runs its setup right away, so the resources it declares
+    /// can be handed to the passes added after it. Returns the pass index.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::uint32_t add_pass(const std::string& name, const setup_fn& setup, execute_fn execute);
+
+    //-----------------------------------------------------------------------------
+    //  Name : compile ()
+    /// <summary>
+    /// Culls the unused passes, finds the lifetime of each transient texture
+    /// and assigns the physical textures. Called once after the passes were
+    /// added.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void compile();
+
+    //-----------------------------------------------------------------------------
+    //  Name : execute ()
+    /// <summary>
+    /// Runs the passes kept by compile, in the order they were added.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void execute(frame_graph_pool& pool);
+
+    inline std::size_t get_pass_count() const { return passes_.size(); }
+    inline std::size_t get_resource_count() const { return resources_.size(); }
+    inline bool        is_pass_culled(std::uint32_t pass) const { return passes_[pass].culled; }
+    inline bool        is_imported(resource r) const { return resources_[r].imported; }
+
+    /// First and last kept pass using a texture, invalid_index when none does.
+    inline std::uint32_t get_first_use(resource r) const { return resources_[r].first_use; }
+    inline std::uint32_t get_last_use(resource r) const { return resources_[r].last_use; }
+
+    /// Physical texture of a transient texture, invalid_index for imported and unused ones.
+    inline std::uint32_t get_physical_index(resource r) const { return resources_[r].physical; }
+    inline std::size_t   get_physical_count() const { return physicals_.size(); }
+
+private:
+    struct resource_node
+    {
+        std::string                   name;
+        texture_desc                  desc;
+        /// Texture of imported ones.
+        std::shared_ptr<gfx::texture> texture;
+        bool                          imported = false;
+        /// Passes writing the texture.
+        std::vector<std::uint32_t> writers;
+        /// Kept passes reading the texture, imported ones count one more.
+        std::uint32_t readers   = 0;
+        std::uint32_t first_use = invalid_index;
+        std::uint32_t last_use  = invalid_index;
+        std::uint32_t physical  = invalid_index;
+    };
+
+    struct pass_node
+    {
+        std::string           name;
+        execute_fn            execute;
+        std::vector<resource> reads;
+        std::vector<resource> writes;
+        bool                  side_effect = false;
+        /// Written textures still used by kept passes.
+        std::uint32_t refs   = 0;
+        bool          culled = false;
+    };
+
+    struct physical_texture
+    {
+        texture_desc desc;
+        /// Last pass using the texture so far.
+        std::uint32_t last_use = 0;
+        /// Textures of the same description before this one, their index in the pool.
+        std::uint32_t pool_index = 0;
+    };
+
+    std::vector<resource_node>    resources_;
+    std::vector<pass_node>        passes_;
+    std::vector<physical_texture> physicals_;
+    /// Physical textures taken from the pool by execute.
+    std::vector<std::shared_ptr<gfx::texture>> textures_;
+    std::vector<std::shared_ptr<gfx::texture>> attachments_;
+    std::vector<resource>                      stack_;
+};
+
+//-----------------------------------------------------------------------------
+//  Name : frame_graph_pool (Class)
+/// <summary>
+/// Transient textures and the frame buffers built over them, shared by the
+/// frame graphs of all views. Graphs execute one after the other, so each of
+/// them can take every texture of the pool. Textures no graph took since the
+/// previous release_unused are destroyed by the next one.
+/// </summary>
+//-----------------------------------------------------------------------------
+class frame_graph_pool
+{
+public:
+    //-----------------------------------------------------------------------------
+    //  Name : get_texture ()
+    /// <summary>
+    /// The index-th texture of a description, created on first use.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::shared_ptr<gfx::texture> get_texture(const frame_graph::texture_desc& desc, std::uint32_t index);
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_frame_buffer ()
+    /// <summary>
+    /// Frame buffer over the attachments, in order, created on first use.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::shared_ptr<gfx::frame_buffer> get_frame_buffer(const std::vector<std::shared_ptr<gfx::texture>>& attachments);
+
+    //-----------------------------------------------------------------------------
+    //  Name : release_unused ()
+    /// <summary>
+    /// Destroys the textures and frame buffers not used since the previous
+    /// call. Called once per frame.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void release_unused();
+
+    inline std::size_t get_texture_count() const { return textures_.size(); }
+
+private:
+    struct texture_entry
+    {
+        frame_graph::texture_desc     desc;
+        std::uint32_t                 index = 0;
+        std::shared_ptr<gfx::texture> texture;
+        bool                          used = true;
+    };
+
+    struct frame_buffer_entry
+    {
+        std::vector<const gfx::texture*>   attachments;
+        std::shared_ptr<gfx::frame_buffer> fbo;
+        bool                               used = true;
+    };
+
+    std::vector<texture_entry>      textures_;
+    std::vector<frame_buffer_entry> frame_buffers_;
+};
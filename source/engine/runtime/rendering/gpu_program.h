@@ -85,6 +85,34 @@ public:
     void set_uniform(const std::string& _name, const math::vec3& _value, std::uint16_t _num = 1);
     void set_uniform(const std::string& _name, const math::vec2& _value, std::uint16_t _num = 1);
 
+    //-----------------------------------------------------------------------------
+    //  Name : set_texture ()
+    /// <summary>
+    /// Binds a texture to a sampler resolved with gfx::get_uniform_id.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void set_texture(std::uint8_t       _stage,
+                     gfx::uniform_id    _sampler,
+                     gfx::frame_buffer* _handle,
+                     uint8_t            _attachment = 0,
+                     std::uint32_t      _flags      = std::numeric_limits<std::uint32_t>::max());
+    void set_texture(std::uint8_t    _stage,
+                     gfx::uniform_id _sampler,
+                     gfx::texture*   _texture,
+                     std::uint32_t   _flags = std::numeric_limits<std::uint32_t>::max());
+
+    //-----------------------------------------------------------------------------
+    //  Name : set_uniform ()
+    /// <summary>
+    /// Sets a uniform resolved with gfx::get_uniform_id, an array index instead
+    /// of a lookup by name.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void set_uniform(gfx::uniform_id _id, const void* _value, std::uint16_t _num = 1);
+    void set_uniform(gfx::uniform_id _id, const math::vec4& _value, std::uint16_t _num = 1);
+    void set_uniform(gfx::uniform_id _id, const math::vec3& _value, std::uint16_t _num = 1);
+    void set_uniform(gfx::uniform_id _id, const math::vec2& _value, std::uint16_t _num = 1);
+
     //-----------------------------------------------------------------------------
     //  Name : get_uniform ()
     /// <summary>
@@ -58,6 +58,8 @@ struct light
     light_type  type   = light_type::directional;
     depth_type  depth  = depth_type::invz;
     shadow_type shadow = shadow_type::hard;
+    /// Renders a shadow map, cached while the static casters stay unchanged.
+    bool casts_shadows = false;
 
     struct spot
     {
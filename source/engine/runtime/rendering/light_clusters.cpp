@@ -0,0 +1,234 @@
+#include "light_clusters.h"
+#include "../ecs/ecs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    /// Sphere around the lit volume of a light, spot lights are a cone capped
+    /// by their range.
+    math::vec4 get_bounding_sphere(const light& l, const math::vec3& position, const math::vec3& direction)
+    {
+        if (l.type != light_type::spot)
+        {
+            return math::vec4(position, l.point_data.range);
+        }
+
+        const float range      = l.spot_data.get_range();
+        const float half_angle = math::radians(l.spot_data.get_outer_angle() * 0.5f);
+        if (half_angle >= math::half_pi<float>())
+        {
+            return math::vec4(position, range);
+        }
+
+        // Narrow cones fit in the sphere through the apex and the rim, wide
+        // ones in the sphere around the rim.
+        const float cos_angle = math::cos(half_angle);
+        if (half_angle < math::quarter_pi<float>())
+        {
+            const float radius = range / (2.0f * cos_angle);
+            return math::vec4(position + direction * radius, radius);
+        }
+
+        return math::vec4(position + direction * (range * cos_angle), range * math::sin(half_angle));
+    }
+
+    bool intersects(const math::vec4& sphere, const math::vec3& min, const math::vec3& max)
+    {
+        const math::vec3 center(sphere);
+        const math::vec3 closest = math::clamp(center, min, max);
+        return math::length2(center - closest) <= sphere.w * sphere.w;
+    }
+} // namespace
+
+light_clusters::light_clusters(std::uint32_t tiles_x, std::uint32_t tiles_y, std::uint32_t slices)
+    : tiles_x_(std::max(tiles_x, 1u))
+    , tiles_y_(std::max(tiles_y, 1u))
+    , slices_(std::max(slices, 1u))
+{
+}
+
+void light_clusters::clear()
+{
+    bounds_.clear();
+    light_data_.clear();
+    grid_.clear();
+    indices_.clear();
+    light_count_ = 0;
+    index_count_ = 0;
+}
+
+std::int32_t light_clusters::add_light(const light& l, const math::vec3& position, const math::vec3& direction)
+{
+    if (l.type != light_type::point && l.type != light_type::spot)
+    {
+        return -1;
+    }
+
+    const bool spot = l.type == light_type::spot;
+
+    // Kept in world space until build knows the view.
+    bounds_.emplace_back(get_bounding_sphere(l, position, direction));
+
+    const float data[texels_per_light * 4] = {
+        position.x,
+        position.y,
+        position.z,
+        spot ? 1.0f : 0.0f,
+        direction.x,
+        direction.y,
+        direction.z,
+        0.0f,
+        l.color.value.r,
+        l.color.value.g,
+        l.color.value.b,
+        l.intensity,
+        spot ? l.spot_data.get_range() : l.point_data.range,
+        spot ? math::cos(math::radians(l.spot_data.get_inner_angle() * 0.5f)) : l.point_data.exponent_falloff,
+        spot ? math::cos(math::radians(l.spot_data.get_outer_angle() * 0.5f)) : 0.0f,
+        0.0f,
+    };
+    light_data_.insert(light_data_.end(), std::begin(data), std::end(data));
+
+    return std::int32_t(light_count_++);
+}
+
+std::uint32_t light_clusters::get_slice(float view_depth) const
+{
+    if (view_depth <= near_clip_)
+    {
+        return 0;
+    }
+
+    const float slice = std::floor(std::log(view_depth) * depth_scale_ + depth_bias_);
+    return std::uint32_t(math::clamp(slice, 0.0f, float(slices_ - 1)));
+}
+
+void light_clusters::build(const math::transform& view, const math::transform& proj, float near_clip, float far_clip)
+{
+    near_clip_ = math::max(near_clip, 0.0001f);
+    far_clip_  = math::max(far_clip, near_clip_ * 1.001f);
+
+    const float log_range = std::log(far_clip_ / near_clip_);
+    depth_scale_          = float(slices_) / log_range;
+    depth_bias_           = -float(slices_) * std::log(near_clip_) / log_range;
+
+    // Bring the light bounds into view space, the world positions stay in the
+    // light data for the shaders.
+    for (auto& sphere : bounds_)
+    {
+        sphere = math::vec4(view.transform_coord(math::vec3(sphere)), sphere.w);
+    }
+
+    // Rays through the corners of the tiles. Two points of each ray are found
+    // by unprojecting, which works for perspective and orthographic
+    // projections alike.
+    const auto inv_proj = math::inverse(proj);
+    corners_.resize(std::size_t(tiles_x_ + 1) * (tiles_y_ + 1));
+    for (std::uint32_t y = 0; y <= tiles_y_; ++y)
+    {
+        for (std::uint32_t x = 0; x <= tiles_x_; ++x)
+        {
+            const float ndc_x = float(x) / float(tiles_x_) * 2.0f - 1.0f;
+            const float ndc_y = float(y) / float(tiles_y_) * 2.0f - 1.0f;
+            auto        p0    = inv_proj * math::vec4(ndc_x, ndc_y, 0.0f, 1.0f);
+            auto        p1    = inv_proj * math::vec4(ndc_x, ndc_y, 0.5f, 1.0f);
+            p0 /= p0.w;
+            p1 /= p1.w;
+
+            auto& ray  = corners_[y * (tiles_x_ + 1) + x];
+            ray.step   = (math::vec2(p1) - math::vec2(p0)) / (p1.z - p0.z);
+            ray.origin = math::vec2(p0) - ray.step * p0.z;
+        }
+    }
+
+    grid_.assign(get_cluster_count() * 2, 0.0f);
+    slice_indices_.resize(slices_);
+    slice_lights_.resize(slices_);
+    runtime::ecs::parallel_for(slices_, 1, [this](std::size_t begin, std::size_t end) {
+        for (auto slice = begin; slice < end; ++slice)
+        {
+            build_slice(std::uint32_t(slice));
+        }
+    });
+
+    // Slices wrote offsets relative to their own lists, append them in order.
+    const std::size_t clusters_per_slice = std::size_t(tiles_x_) * tiles_y_;
+    indices_.clear();
+    for (std::uint32_t slice = 0; slice < slices_; ++slice)
+    {
+        const float base  = float(indices_.size());
+        const auto  first = slice * clusters_per_slice;
+        for (std::size_t i = 0; i < clusters_per_slice; ++i)
+        {
+            grid_[(first + i) * 2] += base;
+        }
+        indices_.insert(indices_.end(), slice_indices_[slice].begin(), slice_indices_[slice].end());
+    }
+    index_count_ = indices_.size();
+
+    // Whole rows, at least one, so that the arrays can be uploaded as is.
+    const auto pad = [](std::vector<float>& data, std::size_t row_size) {
+        const auto rows = std::max<std::size_t>((data.size() + row_size - 1) / row_size, 1);
+        data.resize(rows * row_size, 0.0f);
+    };
+    pad(indices_, row_width);
+    pad(light_data_, std::size_t(row_width) * 4);
+}
+
+void light_clusters::build_slice(std::uint32_t slice)
+{
+    const float ratio = far_clip_ / near_clip_;
+    const float z0    = near_clip_ * std::pow(ratio, float(slice) / float(slices_));
+    const float z1    = slice + 1 == slices_ ? far_clip_ : near_clip_ * std::pow(ratio, float(slice + 1) / float(slices_));
+
+    auto& lights = slice_lights_[slice];
+    lights.clear();
+    for (std::size_t i = 0; i < bounds_.size(); ++i)
+    {
+        const auto& sphere = bounds_[i];
+        if (sphere.z + sphere.w >= z0 && sphere.z - sphere.w <= z1)
+        {
+            lights.emplace_back(std::uint32_t(i));
+        }
+    }
+
+    auto& indices = slice_indices_[slice];
+    indices.clear();
+    for (std::uint32_t y = 0; y < tiles_y_; ++y)
+    {
+        for (std::uint32_t x = 0; x < tiles_x_; ++x)
+        {
+            // Box around the part of the tile's frustum between the slice planes.
+            math::vec3 min(std::numeric_limits<float>::max());
+            math::vec3 max(std::numeric_limits<float>::lowest());
+            for (std::uint32_t corner = 0; corner < 4; ++corner)
+            {
+                const auto& ray = corners_[(y + (corner >> 1)) * (tiles_x_ + 1) + x + (corner & 1)];
+                for (const float z : {z0, z1})
+                {
+                    const auto point = ray.origin + ray.step * z;
+                    min              = math::min(min, math::vec3(point, z0));
+                    max              = math::max(max, math::vec3(point, z1));
+                }
+            }
+
+            const auto    first = indices.size();
+            std::uint32_t count = 0;
+            for (const auto light : lights)
+            {
+                if (count < max_lights_per_cluster && intersects(bounds_[light], min, max))
+                {
+                    indices.emplace_back(light);
+                    ++count;
+                }
+            }
+
+            const auto cluster     = get_cluster(x, y, slice);
+            grid_[cluster * 2]     = float(first);
+            grid_[cluster * 2 + 1] = float(count);
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "light.h"
+
+#include <core/math/math_includes.h>
+
+#include <cstdint>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+//  Name : light_clusters (Class)
+/// <summary>
+/// Bins point and spot lights into a grid of view space clusters: screen tiles
+/// split into slices along the view depth, with slices growing logarithmically
+/// from the near to the far clip. Each cluster gets the list of lights whose
+/// bounding sphere touches it, so that a single full screen draw can shade
+/// every light while only looking at the lights of its pixel's cluster.
+/// The results are packed as float arrays laid out for upload into textures,
+/// building them needs no renderer.
+/// </summary>
+//-----------------------------------------------------------------------------
+class light_clusters
+{
+public:
+    /// Texels of the light data per light, see add_light.
+    static constexpr std::uint32_t texels_per_light = 4;
+    /// Row width, in texels, of the light data and light index arrays.
+    static constexpr std::uint32_t row_width = 1024;
+    /// Lights kept per cluster, the shading loop is bounded by it as well.
+    static constexpr std::uint32_t max_lights_per_cluster = 128;
+
+    //-----------------------------------------------------------------------------
+    //  Name : light_clusters ()
+    /// <summary>
+    /// Grid of tiles_x by tiles_y screen tiles and slices depth slices.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    light_clusters(std::uint32_t tiles_x = 16, std::uint32_t tiles_y = 8, std::uint32_t slices = 24);
+
+    //-----------------------------------------------------------------------------
+    //  Name : clear ()
+    /// <summary>
+    /// Drops the lights and the clusters, keeping the memory for the next frame.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void clear();
+
+    //-----------------------------------------------------------------------------
+    //  Name : add_light ()
+    /// <summary>
+    /// Adds a point or spot light, directional lights are ignored. Returns the
+    /// index of the light or -1. Each light is packed as four texels holding
+    /// the position and type (0 point, 1 spot), the direction, the color and
+    /// intensity, and the same data the single light shaders get in
+    /// u_light_data.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::int32_t add_light(const light& l, const math::vec3& position, const math::vec3& direction);
+
+    //-----------------------------------------------------------------------------
+    //  Name : build ()
+    /// <summary>
+    /// Assigns the added lights to the clusters of a view, one task_system job
+    /// per depth slice. Called once after the lights of the view were added.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void build(const math::transform& view, const math::transform& proj, float near_clip, float far_clip);
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_slice ()
+    /// <summary>
+    /// Depth slice of a view space depth, clamped to the grid.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    std::uint32_t get_slice(float view_depth) const;
+
+    //-----------------------------------------------------------------------------
+    //  Name : get_cluster ()
+    /// <summary>
+    /// Index of a cluster in the grid, tiles go left to right and bottom to
+    /// top in normalized device coordinates.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    inline std::uint32_t get_cluster(std::uint32_t x, std::uint32_t y, std::uint32_t slice) const { return (slice * tiles_y_ + y) * tiles_x_ + x; }
+
+    /// Offset and count of the lights of a cluster in the light indices.
+    inline std::uint32_t get_cluster_offset(std::uint32_t cluster) const { return std::uint32_t(grid_[cluster * 2]); }
+    inline std::uint32_t get_cluster_size(std::uint32_t cluster) const { return std::uint32_t(grid_[cluster * 2 + 1]); }
+    inline std::uint32_t get_light_index(std::uint32_t i) const { return std::uint32_t(indices_[i]); }
+    /// Bounding sphere of a light, in view space once built.
+    inline const math::vec4& get_light_bounds(std::size_t i) const { return bounds_[i]; }
+
+    inline std::uint32_t get_tiles_x() const { return tiles_x_; }
+    inline std::uint32_t get_tiles_y() const { return tiles_y_; }
+    inline std::uint32_t get_slices() const { return slices_; }
+    inline std::size_t   get_cluster_count() const { return std::size_t(tiles_x_) * tiles_y_ * slices_; }
+    inline std::size_t   get_light_count() const { return light_count_; }
+    inline std::size_t   get_index_count() const { return index_count_; }
+    inline bool          empty() const { return light_count_ == 0; }
+
+    /// slice = floor(log(view_depth) * scale + bias), for the shaders.
+    inline float get_depth_scale() const { return depth_scale_; }
+    inline float get_depth_bias() const { return depth_bias_; }
+
+    /// Light data, rgba texels in rows of row_width, padded to whole rows.
+    inline const std::vector<float>& get_light_data() const { return light_data_; }
+    /// Offset and count of each cluster, rg texels in rows of tiles_x * tiles_y, a row per slice.
+    inline const std::vector<float>& get_grid() const { return grid_; }
+    /// Light indices of all clusters, r texels in rows of row_width, padded to whole rows.
+    inline const std::vector<float>& get_indices() const { return indices_; }
+
+private:
+    /// View space corner ray of the tile grid, the point at depth z is origin + step * z.
+    struct corner_ray
+    {
+        math::vec2 origin;
+        math::vec2 step;
+    };
+
+    void build_slice(std::uint32_t slice);
+
+    std::uint32_t tiles_x_     = 0;
+    std::uint32_t tiles_y_     = 0;
+    std::uint32_t slices_      = 0;
+    std::size_t   light_count_ = 0;
+    std::size_t   index_count_ = 0;
+    float         near_clip_   = 0.0f;
+    float         far_clip_    = 0.0f;
+    float         depth_scale_ = 0.0f;
+    float         depth_bias_  = 0.0f;
+
+    /// View space bounding spheres of the lights.
+    std::vector<math::vec4> bounds_;
+    std::vector<corner_ray> corners_;
+    /// Light indices found by each slice job, merged after the jobs.
+    std::vector<std::vector<std::uint32_t>> slice_indices_;
+    std::vector<std::vector<std::uint32_t>> slice_lights_;
+    std::vector<float>                      light_data_;
+    std::vector<float>                      grid_;
+    std::vector<float>                      indices_;
+};
@@ -7,6 +7,28 @@
 #include <core/graphics/uniform.h>
 #include <core/system/subsystem.h>
 
+#include <iterator>
+
+namespace
+{
+    /// Uniforms of the standard material, resolved once by name.
+    struct standard_uniforms
+    {
+        gfx::uniform_id material      = gfx::get_uniform_id("u_material");
+        gfx::uniform_id tex_color     = gfx::get_uniform_id("s_tex_color");
+        gfx::uniform_id tex_normal    = gfx::get_uniform_id("s_tex_normal");
+        gfx::uniform_id tex_roughness = gfx::get_uniform_id("s_tex_roughness");
+        gfx::uniform_id tex_metalness = gfx::get_uniform_id("s_tex_metalness");
+        gfx::uniform_id tex_ao        = gfx::get_uniform_id("s_tex_ao");
+    };
+
+    const standard_uniforms& get_standard_uniforms()
+    {
+        static const standard_uniforms uniforms;
+        return uniforms;
+    }
+} // namespace
+
 material::material()
 {
     auto& am            = core::get_subsystem<runtime::asset_manager>();
@@ -41,7 +63,15 @@ void material::set_uniform(const std::string& _name, const void* _value, std::ui
     get_program()->set_uniform(_name, _value, _num);
 }
 
-gpu_program* material::get_program() const { return skinned ? program_skinned_.get() : program_.get(); }
+gpu_program* material::get_program() const
+{
+    if (instanced)
+    {
+        return program_instanced_.get();
+    }
+
+    return skinned ? program_skinned_.get() : program_.get();
+}
 
 std::uint64_t material::get_render_states(bool apply_cull, bool depth_write, bool depth_test) const
 {
@@ -74,6 +104,8 @@ standard_material::standard_material()
     vs_deferred_geom.wait();
     auto vs_deferred_geom_skinned = am.load<gfx::shader>("engine:/data/shaders/vs_deferred_geom_skinned.sc");
     vs_deferred_geom_skinned.wait();
+    auto vs_deferred_geom_instanced = am.load<gfx::shader>("engine:/data/shaders/vs_deferred_geom_instanced.sc");
+    vs_deferred_geom_instanced.wait();
     auto fs_deferred_geom = am.load<gfx::shader>("engine:/data/shaders/fs_deferred_geom.sc");
     fs_deferred_geom.wait();
     auto f = ts.push_or_execute_on_owner_thread(
@@ -86,8 +118,14 @@ standard_material::standard_material()
         vs_deferred_geom_skinned,
         fs_deferred_geom);
 
+    auto f2 = ts.push_or_execute_on_owner_thread(
+        [this](asset_handle<gfx::shader> vs, asset_handle<gfx::shader> fs) { program_instanced_ = std::make_unique<gpu_program>(vs, fs); },
+        vs_deferred_geom_instanced,
+        fs_deferred_geom);
+
     futures_.emplace_back(std::move(f));
     futures_.emplace_back(std::move(f1));
+    futures_.emplace_back(std::move(f2));
 }
 
 standard_material::~standard_material()
@@ -103,12 +141,17 @@ void standard_material::submit()
     if (!is_valid())
         return;
 
-    get_program()->set_uniform("u_base_color", &base_color_);
-    get_program()->set_uniform("u_subsurface_color", &subsurface_color_);
-    get_program()->set_uniform("u_emissive_color", &emissive_color_);
-    get_program()->set_uniform("u_surface_data", &surface_data_);
-    get_program()->set_uniform("u_tiling", &tiling_);
-    get_program()->set_uniform("u_dither_threshold", &dither_threshold_);
+    const auto& uniforms = get_standard_uniforms();
+    auto        program  = get_program();
+
+    // One upload for all the parameters, laid out as u_material in fs_deferred_geom.
+    const math::vec4 block[] = {base_color_.value,
+                                subsurface_color_.value,
+                                emissive_color_.value,
+                                surface_data_,
+                                math::vec4(tiling_, 0.0f, 0.0f),
+                                math::vec4(dither_threshold_, 0.0f, 0.0f)};
+    program->set_uniform(uniforms.material, block, std::uint16_t(std::size(block)));
 
     const auto& color_map     = maps_["color"];
     const auto& normal_map    = maps_["normal"];
@@ -122,9 +165,9 @@ void standard_material::submit()
     auto metalness = metalness_map ? metalness_map : default_color_map_;
     auto ao        = ao_map ? ao_map : default_color_map_;
 
-    get_program()->set_texture(0, "s_tex_color", albedo.get());
-    get_program()->set_texture(1, "s_tex_normal", normal.get());
-    get_program()->set_texture(2, "s_tex_roughness", roughness.get());
-    get_program()->set_texture(3, "s_tex_metalness", metalness.get());
-    get_program()->set_texture(4, "s_tex_ao", ao.get());
+    program->set_texture(0, uniforms.tex_color, albedo.get());
+    program->set_texture(1, uniforms.tex_normal, normal.get());
+    program->set_texture(2, uniforms.tex_roughness, roughness.get());
+    program->set_texture(3, uniforms.tex_metalness, metalness.get());
+    program->set_texture(4, uniforms.tex_ao, ao.get());
 }
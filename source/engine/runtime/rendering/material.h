@@ -107,6 +107,15 @@ public:
     //-----------------------------------------------------------------------------
     gpu_program* get_program() const;
 
+    //-----------------------------------------------------------------------------
+    //  Name : get_instanced_program ()
+    /// <summary>
+    /// Program taking the world transforms from instance data, nullptr when the
+    /// material has none and can not be instanced.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    inline gpu_program* get_instanced_program() const { return program_instanced_.get(); }
+
     //-----------------------------------------------------------------------------
     //  Name : submit (virtual )
     /// <summary>
@@ -148,12 +157,16 @@ public:
     std::uint64_t get_render_states(bool apply_cull = true, bool depth_write = true, bool depth_test = true) const;
 
     bool skinned = false;
+    /// Selects the instanced program, never set together with skinned.
+    bool instanced = false;
 
 protected:
     /// Program that is responsible for rendering.
     std::unique_ptr<gpu_program> program_;
     /// Program that is responsible for rendering.
     std::unique_ptr<gpu_program> program_skinned_;
+    /// Program that is responsible for instanced rendering.
+    std::unique_ptr<gpu_program> program_instanced_;
     /// Cull type for this material.
     cull_type cull_type_ = cull_type::counter_clockwise;
     /// Default color texture
@@ -2,6 +2,7 @@
 #include "gpu_program.h"
 #include "material.h"
 #include "mesh.h"
+#include "render_queue.h"
 
 #include "../assets/asset_manager.h"
 
@@ -248,3 +249,71 @@ void model::recalulate_lod_limits()
         upper_limit = lower_limit;
     }
 }
+
+void model::enqueue(render_queue&                       queue,
+                    const math::transform&              world_transform,
+                    const std::vector<math::transform>& bone_transforms,
+                    bool                                apply_cull,
+                    bool                                depth_write,
+                    bool                                depth_test,
+                    std::uint64_t                       extra_states,
+                    unsigned int                        lod,
+                    float                               depth,
+                    std::uint32_t                       user_index,
+                    gpu_program*                        user_program,
+                    gpu_program*                        user_skinned_program) const
+{
+    const auto mesh = get_lod(lod);
+    if (!mesh)
+    {
+        return;
+    }
+
+    auto enqueue_subset = [&](bool skinned, std::uint32_t group_id, const math::transform* matrices, std::size_t matrix_count) {
+        gpu_program*           user      = skinned && user_skinned_program != nullptr ? user_skinned_program : user_program;
+        gpu_program*           program   = user;
+        gpu_program*           instanced = nullptr;
+        asset_handle<material> mat       = get_material_for_group(group_id);
+        std::uint64_t          states    = extra_states;
+
+        if (mat)
+        {
+            mat->skinned = skinned;
+            if (user == nullptr)
+            {
+                program   = mat->get_program();
+                instanced = mat->get_instanced_program();
+            }
+
+            states |= mat->get_render_states(apply_cull, depth_write, depth_test);
+        }
+
+        if (program == nullptr)
+        {
+            return;
+        }
+
+        queue.push(program, user != nullptr, mat.get(), instanced, skinned, mesh.get(), group_id, states, matrices, matrix_count, depth, user_index);
+    };
+
+    const auto& skin_data = mesh->get_skin_bind_data();
+
+    // Has skinning data?
+    if (skin_data.has_bones() && !bone_transforms.empty())
+    {
+        // Process each palette in the skin with a matching attribute.
+        const auto& palettes = mesh->get_bone_palettes();
+        for (const auto& palette : palettes)
+        {
+            auto skinning_matrices = palette.get_skinning_matrices(bone_transforms, skin_data, false);
+            enqueue_subset(true, palette.get_data_group(), skinning_matrices.data(), skinning_matrices.size());
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < mesh->get_subset_count(); ++i)
+        {
+            enqueue_subset(false, std::uint32_t(i), &world_transform, 1);
+        }
+    }
+}
@@ -13,6 +13,7 @@
 class gpu_program;
 class mesh;
 class material;
+class render_queue;
 
 //-----------------------------------------------------------------------------
 //  Name : model (Class)
@@ -185,6 +186,28 @@ public:
                 gpu_program*                        user_program,
                 std::function<void(gpu_program&)>   setup_params) const;
 
+    //-----------------------------------------------------------------------------
+    //  Name : enqueue ()
+    /// <summary>
+    /// Adds the draws render would submit to a queue instead. Depth is the
+    /// view distance divided by the far clip and user_index is passed back to
+    /// the queue's setup callback. Skinned subsets use user_skinned_program
+    /// when given, user_program otherwise.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void enqueue(render_queue&                       queue,
+                 const math::transform&              world_transform,
+                 const std::vector<math::transform>& bone_transforms,
+                 bool                                apply_cull,
+                 bool                                depth_write,
+                 bool                                depth_test,
+                 std::uint64_t                       extra_states,
+                 unsigned int                        lod,
+                 float                               depth,
+                 std::uint32_t                       user_index,
+                 gpu_program*                        user_program         = nullptr,
+                 gpu_program*                        user_skinned_program = nullptr) const;
+
 private:
     void recalulate_lod_limits();
     /// Collection of all materials for this model.
@@ -0,0 +1,317 @@
+#include "render_queue.h"
+#include "gpu_program.h"
+#include "material.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr std::uint32_t program_bits  = 12;
+    constexpr std::uint32_t material_bits = 14;
+    constexpr std::uint32_t mesh_bits     = 14;
+    constexpr std::uint32_t depth_bits    = 24;
+
+    constexpr std::uint32_t depth_shift    = 0;
+    constexpr std::uint32_t mesh_shift     = depth_shift + depth_bits;
+    constexpr std::uint32_t material_shift = mesh_shift + mesh_bits;
+    constexpr std::uint32_t program_shift  = material_shift + material_bits;
+
+    static_assert(program_shift + program_bits == 64, "sort key must use all 64 bits");
+
+    /// Below this the radix passes cost more than a comparison sort.
+    constexpr std::size_t radix_sort_threshold = 64;
+
+    /// Instance data is the world matrix.
+    constexpr std::uint16_t instance_stride = sizeof(math::transform::mat4_t);
+    static_assert(instance_stride == 64, "instance data must be a tightly packed 4x4 matrix");
+
+    bool can_instance(const render_queue::packet& p)
+    {
+        return p.instanced_program != nullptr && p.matrix_count == 1;
+    }
+
+    bool can_merge(const render_queue::packet& a, const render_queue::packet& b)
+    {
+        return can_instance(b) && a.program == b.program && a.mat == b.mat && a.geometry == b.geometry && a.group == b.group && a.state == b.state &&
+               a.user_index == b.user_index;
+    }
+} // namespace
+
+void render_queue::clear()
+{
+    packets_.clear();
+    order_.clear();
+    matrices_.clear();
+    program_ids_.clear();
+    material_ids_.clear();
+    mesh_ids_.clear();
+    subset_ids_.clear();
+    batches_.clear();
+    instances_.clear();
+    sorted_  = false;
+    batched_ = false;
+}
+
+template<typename Key>
+std::uint32_t render_queue::get_id(std::unordered_map<Key, std::uint32_t>& ids, const Key& key, std::uint32_t bits)
+{
+    // Past the last id objects share it, they are still told apart on submit
+    // and only lose their grouping.
+    const auto max_id = std::uint32_t((std::uint64_t(1) << bits) - 1);
+    const auto it     = ids.emplace(key, std::min(std::uint32_t(ids.size()), max_id)).first;
+    return it->second;
+}
+
+void render_queue::push(gpu_program*           program,
+                        bool                   user_program,
+                        material*              mat,
+                        gpu_program*           instanced_program,
+                        bool                   skinned,
+                        mesh*                  geometry,
+                        std::uint32_t          group,
+                        std::uint64_t          state,
+                        const math::transform* matrices,
+                        std::size_t            matrix_count,
+                        float                  depth,
+                        std::uint32_t          user_index)
+{
+    constexpr auto max_depth = float((std::uint32_t(1) << depth_bits) - 1);
+
+    packet p;
+    p.program           = program;
+    p.user_program      = user_program;
+    p.mat               = mat;
+    p.instanced_program = skinned || user_program ? nullptr : instanced_program;
+    p.skinned           = skinned;
+    p.geometry          = geometry;
+    p.group             = group;
+    p.state             = state;
+    p.first_matrix      = std::uint32_t(matrices_.size());
+    p.matrix_count      = std::uint32_t(matrix_count);
+    p.user_index        = user_index;
+    p.depth             = std::uint32_t(math::clamp(depth, 0.0f, 1.0f) * max_depth);
+
+    const auto subset = std::uint64_t(get_id<const void*>(mesh_ids_, geometry, 32)) << 32 | group;
+
+    p.key = std::uint64_t(get_id<const void*>(program_ids_, program, program_bits)) << program_shift;
+    p.key |= std::uint64_t(get_id<const void*>(material_ids_, mat, material_bits)) << material_shift;
+    p.key |= std::uint64_t(get_id(subset_ids_, subset, mesh_bits)) << mesh_shift;
+    p.key |= std::uint64_t(p.depth) << depth_shift;
+
+    for (std::size_t i = 0; i < matrix_count; ++i)
+    {
+        matrices_.emplace_back(matrices[i].get_matrix());
+    }
+
+    packets_.emplace_back(p);
+    sorted_  = false;
+    batched_ = false;
+}
+
+void render_queue::sort()
+{
+    const auto count = packets_.size();
+    order_.resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        order_[i] = {packets_[i].key, std::uint32_t(i)};
+    }
+
+    if (count < radix_sort_threshold)
+    {
+        std::stable_sort(order_.begin(), order_.end(), [](const sort_entry& a, const sort_entry& b) { return a.key < b.key; });
+        sorted_  = true;
+        batched_ = false;
+        return;
+    }
+
+    // Least significant digit first, a byte per pass. Passes where every key
+    // has the same byte would not move anything and are skipped, with few
+    // programs and materials that is most of the upper ones.
+    scratch_.resize(count);
+    for (std::uint32_t shift = 0; shift < 64; shift += 8)
+    {
+        std::uint32_t histogram[256] = {};
+        for (const auto& entry : order_)
+        {
+            ++histogram[(entry.key >> shift) & 0xff];
+        }
+
+        if (histogram[(order_[0].key >> shift) & 0xff] == count)
+        {
+            continue;
+        }
+
+        std::uint32_t offset = 0;
+        for (auto& bucket : histogram)
+        {
+            const auto size = bucket;
+            bucket          = offset;
+            offset += size;
+        }
+
+        for (const auto& entry : order_)
+        {
+            scratch_[histogram[(entry.key >> shift) & 0xff]++] = entry;
+        }
+        order_.swap(scratch_);
+    }
+
+    sorted_  = true;
+    batched_ = false;
+}
+
+void render_queue::build_batches()
+{
+    const auto count = packets_.size();
+    batches_.clear();
+    instances_.clear();
+
+    for (std::size_t i = 0; i < count;)
+    {
+        const auto& p = get_packet(i);
+
+        batch b;
+        b.first   = std::uint32_t(i);
+        b.program = p.program;
+
+        if (can_instance(p))
+        {
+            auto last = i + 1;
+            while (last < count && can_merge(p, get_packet(last)))
+            {
+                ++last;
+            }
+
+            if (last - i > 1)
+            {
+                b.count          = std::uint32_t(last - i);
+                b.first_instance = std::uint32_t(instances_.size());
+                b.program        = p.instanced_program;
+                for (auto j = i; j < last; ++j)
+                {
+                    instances_.emplace_back(matrices_[get_packet(j).first_matrix]);
+                }
+            }
+        }
+
+        batches_.emplace_back(b);
+        i += b.count;
+    }
+
+    batched_ = true;
+}
+
+void render_queue::submit(gfx::view_id id, const std::function<void(gpu_program&, const packet&)>& setup)
+{
+    if (!batched_)
+    {
+        build_batches();
+    }
+
+    // Instance data comes from a transient buffer shared by the whole frame,
+    // batches it can not hold any more are drawn one packet at a time.
+    const bool    instancing = gfx::is_supported(BGFX_CAPS_INSTANCING);
+    std::uint32_t reserved   = 0;
+    draws_.clear();
+    for (const auto& b : batches_)
+    {
+        if (b.count == 1)
+        {
+            draws_.emplace_back(b);
+        }
+        else if (instancing && gfx::get_avail_instance_data_buffer(reserved + b.count, instance_stride) == reserved + b.count)
+        {
+            reserved += b.count;
+            draws_.emplace_back(b);
+        }
+        else
+        {
+            for (std::uint32_t i = 0; i < b.count; ++i)
+            {
+                batch single;
+                single.first   = b.first + i;
+                single.program = get_packet(single.first).program;
+                draws_.emplace_back(single);
+            }
+        }
+    }
+
+    gpu_program*  program       = nullptr;
+    bool          valid_program = false;
+    bool          preserved     = false;
+    std::uint64_t state         = 0;
+
+    for (std::size_t i = 0; i < draws_.size(); ++i)
+    {
+        const auto& d = draws_[i];
+        const auto& p = get_packet(d.first);
+
+        if (d.program != program)
+        {
+            if (program != nullptr)
+            {
+                program->end();
+            }
+            program       = d.program;
+            valid_program = program->begin();
+            preserved     = false;
+        }
+
+        if (!valid_program)
+        {
+            continue;
+        }
+
+        setup(*program, p);
+
+        // The previous draw kept its bindings for this one, they are the same.
+        if (!preserved && p.mat != nullptr && !p.user_program)
+        {
+            p.mat->skinned   = p.skinned;
+            p.mat->instanced = d.count > 1;
+            p.mat->submit();
+            p.mat->instanced = false;
+        }
+
+        if (d.count > 1)
+        {
+            gfx::instance_data_buffer idb;
+            gfx::alloc_instance_data_buffer(&idb, d.count, instance_stride);
+            std::memcpy(idb.data, &instances_[d.first_instance], std::size_t(d.count) * instance_stride);
+            gfx::set_instance_data_buffer(&idb, 0, d.count);
+        }
+        else if (p.matrix_count != 0)
+        {
+            gfx::set_transform(&matrices_[p.first_matrix], static_cast<std::uint16_t>(p.matrix_count));
+        }
+
+        if (!preserved || p.state != state)
+        {
+            gfx::set_state(p.state);
+            state = p.state;
+        }
+
+        p.geometry->bind_render_buffers_for_subset(p.group);
+
+        // Keep the textures and state bound when the next draw uses the same
+        // program and material, the transform and buffers are set again anyway.
+        bool keep = false;
+        if (i + 1 < draws_.size())
+        {
+            const auto& next_draw = draws_[i + 1];
+            const auto& next      = get_packet(next_draw.first);
+            keep = next_draw.program == d.program && next.mat == p.mat && next.skinned == p.skinned && next.user_program == p.user_program;
+        }
+
+        gfx::submit(id, program->native_handle(), std::int32_t(p.depth), keep);
+        preserved = keep;
+    }
+
+    if (program != nullptr)
+    {
+        program->end();
+    }
+}
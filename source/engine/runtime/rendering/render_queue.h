@@ -0,0 +1,174 @@
+#pragma once
+
+#include <core/graphics/graphics.h>
+#include <core/math/math_includes.h>
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class gpu_program;
+class mesh;
+class material;
+
+//-----------------------------------------------------------------------------
+//  Name : render_queue (Class)
+/// <summary>
+/// Collects the draws of a pass as packets with a 64 bit sort key, sorts them
+/// and submits them so that draws sharing a program and a material follow each
+/// other and the state they share is only set once. The key is, from the most
+/// significant bits: program (12), material (14), mesh subset (14), depth
+/// (24). Ids are handed out per queue in order of first use and reset by
+/// clear. Neighbouring draws of the same subset and material are merged into
+/// one instanced draw when the material has an instanced program.
+/// </summary>
+//-----------------------------------------------------------------------------
+class render_queue
+{
+public:
+    struct packet
+    {
+        /// Sort key, see the class description.
+        std::uint64_t key = 0;
+        gpu_program*  program = nullptr;
+        /// Material of the subset, may be nullptr.
+        material* mat = nullptr;
+        /// Instanced program of the material, nullptr when the packet can not be instanced.
+        gpu_program* instanced_program = nullptr;
+        mesh*        geometry          = nullptr;
+        /// Subset or skin palette data group drawn.
+        std::uint32_t group = 0;
+        /// Render states, material ones included.
+        std::uint64_t state = 0;
+        /// Range in the queue's matrices.
+        std::uint32_t first_matrix = 0;
+        std::uint32_t matrix_count = 0;
+        /// Caller data, handed back to the setup callback of submit.
+        std::uint32_t user_index = 0;
+        /// Quantized view depth.
+        std::uint32_t depth   = 0;
+        bool          skinned = false;
+        /// Program was given by the caller, the material uniforms are not submitted.
+        bool user_program = false;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : batch (Struct)
+    /// <summary>
+    /// A single draw call: one packet, or several instanced ones.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    struct batch
+    {
+        /// First packet, as a position in the submit order.
+        std::uint32_t first = 0;
+        /// Packets drawn, more than one when instanced.
+        std::uint32_t count = 1;
+        /// Start of the instance transforms, for instanced batches.
+        std::uint32_t first_instance = 0;
+        /// The packet's program, or the material's instanced one.
+        gpu_program* program = nullptr;
+    };
+
+    //-----------------------------------------------------------------------------
+    //  Name : clear ()
+    /// <summary>
+    /// Drops all packets, keeping the memory for the next frame.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void clear();
+
+    //-----------------------------------------------------------------------------
+    //  Name : push ()
+    /// <summary>
+    /// Adds a draw. Depth is the view distance divided by the far clip, so
+    /// lower keys are drawn first (front to back). instanced_program is the
+    /// material's one, it is ignored for skinned draws and user programs.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void push(gpu_program*           program,
+              bool                   user_program,
+              material*              mat,
+              gpu_program*           instanced_program,
+              bool                   skinned,
+              mesh*                  geometry,
+              std::uint32_t          group,
+              std::uint64_t          state,
+              const math::transform* matrices,
+              std::size_t            matrix_count,
+              float                  depth,
+              std::uint32_t          user_index);
+
+    //-----------------------------------------------------------------------------
+    //  Name : sort ()
+    /// <summary>
+    /// Orders the packets by key with a radix sort.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void sort();
+
+    //-----------------------------------------------------------------------------
+    //  Name : build_batches ()
+    /// <summary>
+    /// Splits the packets, in sorted order when sorted, into draw calls. Runs
+    /// of unskinned packets sharing program, material, subset, state and user
+    /// index are merged when their material has an instanced program. Called
+    /// by submit when needed.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void build_batches();
+
+    //-----------------------------------------------------------------------------
+    //  Name : submit ()
+    /// <summary>
+    /// Submits the packets in sorted order. setup is called before each draw
+    /// for the per draw uniforms. Programs are begun once per run of packets,
+    /// material uniforms and textures once per run of the same material, and
+    /// the render state only when it changes. setup gets the first packet of
+    /// instanced draws, they share the user index. Instanced batches that do
+    /// not fit in the frame's instance memory, or renderers without instancing,
+    /// fall back to a draw per packet.
+    /// </summary>
+    //-----------------------------------------------------------------------------
+    void submit(gfx::view_id id, const std::function<void(gpu_program&, const packet&)>& setup);
+
+    inline std::size_t                size() const { return packets_.size(); }
+    inline bool                       empty() const { return packets_.empty(); }
+    inline const std::vector<packet>& get_packets() const { return packets_; }
+    inline const std::vector<batch>&  get_batches() const { return batches_; }
+    /// Packet at a position in the submit order.
+    inline const packet& get_packet(std::size_t i) const { return sorted_ ? packets_[order_[i].index] : packets_[i]; }
+
+    /// World transforms of the instanced batches.
+    inline const std::vector<math::transform::mat4_t>& get_instances() const { return instances_; }
+
+private:
+    template<typename Key>
+    static std::uint32_t get_id(std::unordered_map<Key, std::uint32_t>& ids, const Key& key, std::uint32_t bits);
+
+    struct sort_entry
+    {
+        std::uint64_t key;
+        std::uint32_t index;
+    };
+
+    std::vector<packet> packets_;
+    /// Packet order after sort, and the second buffer of the radix sort.
+    std::vector<sort_entry> order_;
+    std::vector<sort_entry> scratch_;
+    /// Transform of every packet, skin palettes take several.
+    std::vector<math::transform::mat4_t> matrices_;
+    /// Draw calls, see build_batches. submit expands the ones it can not
+    /// instance into draws_.
+    std::vector<batch>                   batches_;
+    std::vector<batch>                   draws_;
+    std::vector<math::transform::mat4_t> instances_;
+    /// Dense ids used in the keys. Subsets are keyed by mesh id and group.
+    std::unordered_map<const void*, std::uint32_t>   program_ids_;
+    std::unordered_map<const void*, std::uint32_t>   material_ids_;
+    std::unordered_map<const void*, std::uint32_t>   mesh_ids_;
+    std::unordered_map<std::uint64_t, std::uint32_t> subset_ids_;
+    bool                                             sorted_  = false;
+    bool                                             batched_ = false;
+};
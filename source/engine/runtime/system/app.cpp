@@ -10,6 +10,8 @@
 #include "../ecs/systems/deferred_rendering.h"
 #include "../ecs/systems/reflection_probe_system.h"
 #include "../ecs/systems/scene_graph.h"
+#include "../ecs/systems/spatial_index.h"
+#include "../ecs/systems/transform_system.h"
 #include "../input/input.h"
 #include "../rendering/render_window.h"
 #include "../rendering/renderer.h"
@@ -72,6 +74,8 @@ namespace runtime
         core::add_subsystem<bone_system>();
         core::add_subsystem<camera_system>();
         core::add_subsystem<reflection_probe_system>();
+        core::add_subsystem<transform_system>();
+        core::add_subsystem<spatial_index>();
         core::add_subsystem<deferred_rendering>();
         core::add_subsystem<audio_system>();
     }
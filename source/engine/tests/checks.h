@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdio>
+
+//-----------------------------------------------------------------------------
+// Minimal checks for the headless engine tests. A failed check is reported
+// and counted, the test keeps going so one run shows every failure.
+//-----------------------------------------------------------------------------
+namespace checks
+{
+    inline int& failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    inline void check(bool passed, const char* expression, const char* file, int line)
+    {
+        if (passed)
+            return;
+
+        std::fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+        ++failures();
+    }
+
+    void run_render_queue_checks();
+    void run_frame_graph_checks();
+    void run_light_clusters_checks();
+} // namespace checks
+
+#define CHECK(expression) ::checks::check(bool(expression), #expression, __FILE__, __LINE__)
@@ -0,0 +1,226 @@
+#include "checks.h"
+
+#include <runtime/rendering/frame_graph.h>
+
+namespace checks
+{
+    namespace
+    {
+        const frame_graph::texture_desc color_desc {64, 64, gfx::texture_format::RGBA8};
+        const frame_graph::texture_desc hdr_desc {64, 64, gfx::texture_format::RGBA16F};
+        const frame_graph::texture_desc depth_desc {64, 64, gfx::texture_format::D24};
+
+        void check_culling()
+        {
+            frame_graph graph;
+            auto        output = graph.import_texture("OUTPUT", nullptr);
+
+            frame_graph::resource scene  = frame_graph::invalid_resource;
+            frame_graph::resource unused = frame_graph::invalid_resource;
+            frame_graph::resource debug  = frame_graph::invalid_resource;
+
+            const auto scene_pass = graph.add_pass(
+                "scene", [&](frame_graph::builder& builder) { scene = builder.write(builder.create("SCENE", hdr_desc)); }, nullptr);
+            // Only read by the culled pass after it, so culled as well.
+            const auto unused_pass = graph.add_pass(
+                "unused", [&](frame_graph::builder& builder) { unused = builder.write(builder.create("UNUSED", hdr_desc)); }, nullptr);
+            const auto debug_pass = graph.add_pass("debug",
+                                                   [&](frame_graph::builder& builder) {
+                                                       builder.read(unused);
+                                                       debug = builder.write(builder.create("DEBUG", color_desc));
+                                                   },
+                                                   nullptr);
+            const auto readback_pass = graph.add_pass("readback",
+                                                      [&](frame_graph::builder& builder) {
+                                                          builder.read(scene);
+                                                          builder.side_effect();
+                                                      },
+                                                      nullptr);
+            const auto output_pass = graph.add_pass("output",
+                                                    [&](frame_graph::builder& builder) {
+                                                        builder.read(scene);
+                                                        builder.write(output);
+                                                    },
+                                                    nullptr);
+            graph.compile();
+
+            CHECK(!graph.is_pass_culled(scene_pass));
+            CHECK(graph.is_pass_culled(unused_pass));
+            CHECK(graph.is_pass_culled(debug_pass));
+            CHECK(!graph.is_pass_culled(readback_pass));
+            CHECK(!graph.is_pass_culled(output_pass));
+
+            // Textures of culled passes are never used and get no physical texture.
+            CHECK(graph.get_first_use(unused) == frame_graph::invalid_index);
+            CHECK(graph.get_physical_index(unused) == frame_graph::invalid_index);
+            CHECK(graph.get_physical_index(debug) == frame_graph::invalid_index);
+
+            CHECK(graph.get_first_use(scene) == scene_pass);
+            CHECK(graph.get_last_use(scene) == output_pass);
+            CHECK(graph.is_imported(output));
+            CHECK(graph.get_physical_index(output) == frame_graph::invalid_index);
+            CHECK(graph.get_physical_count() == 1);
+
+            // Without the imported output and the side effect nothing is kept.
+            graph.clear();
+            graph.add_pass(
+                "scene", [&](frame_graph::builder& builder) { scene = builder.write(builder.create("SCENE", hdr_desc)); }, nullptr);
+            graph.add_pass("post",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(scene);
+                               builder.write(builder.create("POST", hdr_desc));
+                           },
+                           nullptr);
+            graph.compile();
+
+            CHECK(graph.get_pass_count() == 2);
+            CHECK(graph.is_pass_culled(0));
+            CHECK(graph.is_pass_culled(1));
+            CHECK(graph.get_physical_count() == 0);
+        }
+
+        void check_aliasing()
+        {
+            frame_graph graph;
+            auto        output = graph.import_texture("OUTPUT", nullptr);
+
+            frame_graph::resource a = frame_graph::invalid_resource;
+            frame_graph::resource b = frame_graph::invalid_resource;
+            frame_graph::resource c = frame_graph::invalid_resource;
+            frame_graph::resource d = frame_graph::invalid_resource;
+            frame_graph::resource e = frame_graph::invalid_resource;
+
+            graph.add_pass(
+                "a", [&](frame_graph::builder& builder) { a = builder.write(builder.create("A", hdr_desc)); }, nullptr);
+            graph.add_pass("b",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(a);
+                               b = builder.write(builder.create("B", hdr_desc));
+                           },
+                           nullptr);
+            // A is done, C takes its texture. D has another description.
+            graph.add_pass("c",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(b);
+                               c = builder.write(builder.create("C", hdr_desc));
+                               d = builder.write(builder.create("D", color_desc));
+                           },
+                           nullptr);
+            // B ended in the previous pass, E takes its texture.
+            graph.add_pass("e",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(c);
+                               builder.read(d);
+                               e = builder.write(builder.create("E", hdr_desc));
+                           },
+                           nullptr);
+            graph.add_pass("output",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(e);
+                               builder.write(output);
+                           },
+                           nullptr);
+            graph.compile();
+
+            CHECK(graph.get_first_use(a) == 0 && graph.get_last_use(a) == 1);
+            CHECK(graph.get_first_use(b) == 1 && graph.get_last_use(b) == 2);
+            CHECK(graph.get_first_use(c) == 2 && graph.get_last_use(c) == 3);
+            CHECK(graph.get_first_use(d) == 2 && graph.get_last_use(d) == 3);
+            CHECK(graph.get_first_use(e) == 3 && graph.get_last_use(e) == 4);
+
+            CHECK(graph.get_physical_index(a) != graph.get_physical_index(b));
+            CHECK(graph.get_physical_index(c) == graph.get_physical_index(a));
+            CHECK(graph.get_physical_index(d) != graph.get_physical_index(a));
+            CHECK(graph.get_physical_index(d) != graph.get_physical_index(b));
+            CHECK(graph.get_physical_index(e) == graph.get_physical_index(b));
+            CHECK(graph.get_physical_count() == 3);
+        }
+
+        void check_probe_face()
+        {
+            // The deferred graph of a probe face: its output reuses a g-buffer
+            // target, the ones still read by the atmospherics stay apart.
+            frame_graph graph;
+
+            frame_graph::resource g_buffer[5];
+            frame_graph::resource reflection = frame_graph::invalid_resource;
+            frame_graph::resource light      = frame_graph::invalid_resource;
+            frame_graph::resource output     = frame_graph::invalid_resource;
+
+            graph.add_pass("g_buffer_fill",
+                           [&](frame_graph::builder& builder) {
+                               g_buffer[0] = builder.create("GBUFFER0", color_desc);
+                               g_buffer[1] = builder.create("GBUFFER1", hdr_desc);
+                               g_buffer[2] = builder.create("GBUFFER2", color_desc);
+                               g_buffer[3] = builder.create("GBUFFER3", color_desc);
+                               g_buffer[4] = builder.create("DEPTH", depth_desc);
+                               for (const auto target : g_buffer)
+                               {
+                                   builder.write(target);
+                               }
+                           },
+                           nullptr);
+            graph.add_pass("refl_buffer_fill",
+                           [&](frame_graph::builder& builder) {
+                               for (const auto target : g_buffer)
+                               {
+                                   builder.read(target);
+                               }
+                               reflection = builder.write(builder.create("RBUFFER", hdr_desc));
+                           },
+                           nullptr);
+            graph.add_pass("light_buffer_fill",
+                           [&](frame_graph::builder& builder) {
+                               for (const auto target : g_buffer)
+                               {
+                                   builder.read(target);
+                               }
+                               builder.read(reflection);
+                               light = builder.write(builder.create("LBUFFER", hdr_desc));
+                           },
+                           nullptr);
+            graph.add_pass("atmospherics_fill",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(light);
+                               builder.read(g_buffer[4]);
+                               builder.write(light);
+                               builder.write(g_buffer[4]);
+                           },
+                           nullptr);
+            graph.add_pass("output_buffer_fill",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(light);
+                               output = builder.write(builder.create("OUTPUT", color_desc));
+                           },
+                           nullptr);
+            graph.add_pass("cubemap_fill",
+                           [&](frame_graph::builder& builder) {
+                               builder.read(output);
+                               builder.side_effect();
+                           },
+                           nullptr);
+            graph.compile();
+
+            for (std::uint32_t i = 0; i < graph.get_pass_count(); ++i)
+            {
+                CHECK(!graph.is_pass_culled(i));
+            }
+
+            CHECK(graph.get_last_use(g_buffer[0]) == 2);
+            CHECK(graph.get_last_use(g_buffer[4]) == 3);
+            CHECK(graph.get_first_use(output) == 4 && graph.get_last_use(output) == 5);
+
+            CHECK(graph.get_physical_index(output) == graph.get_physical_index(g_buffer[0]));
+            CHECK(graph.get_physical_index(light) != graph.get_physical_index(g_buffer[1]));
+            CHECK(graph.get_physical_index(light) != graph.get_physical_index(reflection));
+            CHECK(graph.get_physical_count() == 7);
+        }
+    } // namespace
+
+    void run_frame_graph_checks()
+    {
+        check_culling();
+        check_aliasing();
+        check_probe_face();
+    }
+} // namespace checks
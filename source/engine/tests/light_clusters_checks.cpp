@@ -0,0 +1,212 @@
+#include "checks.h"
+
+#include <runtime/rendering/light_clusters.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace checks
+{
+    namespace
+    {
+        // 4x4 tiles and 8 slices over 1 .. 100, seen through a 90 degree
+        // square frustum. With an identity view, view space is world space and
+        // the tile edges at depth z are at -z, -z/2, 0, z/2 and z. Slice k
+        // starts at 10^(k/4).
+        constexpr std::uint32_t tiles     = 4;
+        constexpr std::uint32_t slices    = 8;
+        constexpr float         near_clip = 1.0f;
+        constexpr float         far_clip  = 100.0f;
+        constexpr float         tolerance = 0.001f;
+        const math::vec3        no_direction {0.0f, 0.0f, 1.0f};
+
+        void build(light_clusters& clusters)
+        {
+            math::transform       view;
+            const math::transform proj(math::perspectiveZO(math::radians(90.0f), 1.0f, near_clip, far_clip));
+            clusters.build(view, proj, near_clip, far_clip);
+        }
+
+        light point_light(float range)
+        {
+            light l;
+            l.type             = light_type::point;
+            l.point_data.range = range;
+            return l;
+        }
+
+        light spot_light(float range, float outer_angle)
+        {
+            light l;
+            l.type = light_type::spot;
+            l.spot_data.set_range(range);
+            l.spot_data.set_inner_angle(0.0f);
+            l.spot_data.set_outer_angle(outer_angle);
+            return l;
+        }
+
+        bool cluster_has_light(const light_clusters& clusters, std::uint32_t cluster, std::uint32_t light_index)
+        {
+            const auto first = clusters.get_cluster_offset(cluster);
+            for (std::uint32_t i = 0; i < clusters.get_cluster_size(cluster); ++i)
+            {
+                if (clusters.get_light_index(first + i) == light_index)
+                    return true;
+            }
+            return false;
+        }
+
+        bool close_to(float a, float b) { return std::abs(a - b) <= tolerance; }
+
+        bool close_to(const math::vec4& a, const math::vec4& b)
+        {
+            return close_to(a.x, b.x) && close_to(a.y, b.y) && close_to(a.z, b.z) && close_to(a.w, b.w);
+        }
+
+        void check_slices()
+        {
+            light_clusters clusters(tiles, tiles, slices);
+            build(clusters);
+
+            CHECK(clusters.get_slice(0.0f) == 0);
+            CHECK(clusters.get_slice(near_clip) == 0);
+            CHECK(clusters.get_slice(1.5f) == 0);
+            CHECK(clusters.get_slice(9.9f) == 3);
+            CHECK(clusters.get_slice(10.1f) == 4);
+            CHECK(clusters.get_slice(99.0f) == slices - 1);
+            CHECK(clusters.get_slice(far_clip) == slices - 1);
+            CHECK(clusters.get_slice(far_clip * 10.0f) == slices - 1);
+
+            // The shader form of the same mapping.
+            const float slice = std::floor(std::log(10.1f) * clusters.get_depth_scale() + clusters.get_depth_bias());
+            CHECK(slice == 4.0f);
+        }
+
+        void check_point_light()
+        {
+            // Inside tile (2, 2), across the slice edge at depth 10. The tile
+            // boxes bound the frustum between the slice planes, so the light
+            // keeps clear of their edges.
+            light_clusters clusters(tiles, tiles, slices);
+            CHECK(clusters.add_light(point_light(0.5f), {1.5f, 1.5f, 10.0f}, no_direction) == 0);
+            // Directional lights are not clustered.
+            CHECK(clusters.add_light(light(), {0.0f, 0.0f, 0.0f}, no_direction) == -1);
+            build(clusters);
+
+            CHECK(clusters.get_light_count() == 1);
+            CHECK(close_to(clusters.get_light_bounds(0), math::vec4(1.5f, 1.5f, 10.0f, 0.5f)));
+            for (std::uint32_t slice = 0; slice < slices; ++slice)
+            {
+                for (std::uint32_t y = 0; y < tiles; ++y)
+                {
+                    for (std::uint32_t x = 0; x < tiles; ++x)
+                    {
+                        const bool expected = x == 2 && y == 2 && (slice == 3 || slice == 4);
+                        CHECK(cluster_has_light(clusters, clusters.get_cluster(x, y, slice), 0) == expected);
+                    }
+                }
+            }
+            CHECK(clusters.get_index_count() == 2);
+        }
+
+        void check_spot_bounds()
+        {
+            const math::vec3 position {1.0f, 2.0f, 3.0f};
+            const math::vec3 direction {0.0f, 0.0f, 1.0f};
+
+            light_clusters clusters(tiles, tiles, slices);
+            // 30 degrees off the axis: the sphere through the apex and the rim.
+            clusters.add_light(spot_light(10.0f, 60.0f), position, direction);
+            // 60 degrees off the axis: the sphere around the rim.
+            clusters.add_light(spot_light(10.0f, 120.0f), position, direction);
+            // Past 90 degrees: the sphere around the apex.
+            clusters.add_light(spot_light(10.0f, 200.0f), position, direction);
+            build(clusters);
+
+            const float narrow_radius = 10.0f / (2.0f * std::cos(math::radians(30.0f)));
+            CHECK(close_to(clusters.get_light_bounds(0), math::vec4(position + direction * narrow_radius, narrow_radius)));
+
+            const float wide_radius = 10.0f * std::sin(math::radians(60.0f));
+            CHECK(close_to(clusters.get_light_bounds(1), math::vec4(position + direction * 5.0f, wide_radius)));
+
+            CHECK(close_to(clusters.get_light_bounds(2), math::vec4(position, 10.0f)));
+        }
+
+        void check_offsets_and_padding()
+        {
+            light_clusters clusters(tiles, tiles, slices);
+            clusters.add_light(point_light(1.0f), {0.0f, 0.0f, 2.0f}, no_direction);
+            clusters.add_light(point_light(3.0f), {-4.0f, 1.0f, 12.0f}, no_direction);
+            clusters.add_light(point_light(20.0f), {10.0f, -5.0f, 50.0f}, no_direction);
+            build(clusters);
+
+            // Clusters follow each other in the indices, across slices as well.
+            std::uint32_t expected_offset = 0;
+            for (std::uint32_t cluster = 0; cluster < clusters.get_cluster_count(); ++cluster)
+            {
+                CHECK(clusters.get_cluster_offset(cluster) == expected_offset);
+                for (std::uint32_t i = 0; i < clusters.get_cluster_size(cluster); ++i)
+                {
+                    CHECK(clusters.get_light_index(expected_offset + i) < clusters.get_light_count());
+                }
+                expected_offset += clusters.get_cluster_size(cluster);
+            }
+            CHECK(expected_offset == clusters.get_index_count());
+
+            const auto& indices = clusters.get_indices();
+            CHECK(indices.size() % light_clusters::row_width == 0);
+            CHECK(indices.size() >= clusters.get_index_count());
+            for (std::size_t i = clusters.get_index_count(); i < indices.size(); ++i)
+            {
+                CHECK(indices[i] == 0.0f);
+            }
+
+            const auto& data = clusters.get_light_data();
+            CHECK(data.size() == std::size_t(light_clusters::row_width) * 4);
+            CHECK(data[light_clusters::texels_per_light * 4] == -4.0f);
+            CHECK(data[light_clusters::texels_per_light * 4 * 3] == 0.0f);
+
+            CHECK(clusters.get_grid().size() == clusters.get_cluster_count() * 2);
+
+            // Without lights the arrays still hold a row each.
+            clusters.clear();
+            build(clusters);
+            CHECK(clusters.empty());
+            CHECK(clusters.get_index_count() == 0);
+            CHECK(clusters.get_indices().size() == light_clusters::row_width);
+            CHECK(clusters.get_light_data().size() == std::size_t(light_clusters::row_width) * 4);
+        }
+
+        void check_cluster_cap()
+        {
+            // Enough lights for a second row of light data.
+            light_clusters      clusters(tiles, tiles, slices);
+            const std::uint32_t count = 300;
+            for (std::uint32_t i = 0; i < count; ++i)
+            {
+                clusters.add_light(point_light(0.5f), {1.5f, 1.5f, 10.0f}, no_direction);
+            }
+            build(clusters);
+
+            // The first lights added are the ones kept.
+            const auto cluster = clusters.get_cluster(2, 2, 4);
+            CHECK(clusters.get_cluster_size(cluster) == light_clusters::max_lights_per_cluster);
+            CHECK(cluster_has_light(clusters, cluster, 0));
+            CHECK(!cluster_has_light(clusters, cluster, count - 1));
+            CHECK(clusters.get_index_count() == 2 * light_clusters::max_lights_per_cluster);
+
+            // Padded up to whole rows.
+            CHECK(clusters.get_light_data().size() == 2 * std::size_t(light_clusters::row_width) * 4);
+        }
+    } // namespace
+
+    void run_light_clusters_checks()
+    {
+        check_slices();
+        check_point_light();
+        check_spot_bounds();
+        check_offsets_and_padding();
+        check_cluster_cap();
+    }
+} // namespace checks
@@ -0,0 +1,15 @@
+#include "checks.h"
+
+int main()
+{
+    checks::run_render_queue_checks();
+    checks::run_frame_graph_checks();
+    checks::run_light_clusters_checks();
+
+    if (checks::failures() != 0)
+    {
+        std::fprintf(stderr, "%d check(s) failed\n", checks::failures());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include "checks.h"
+
+#include <runtime/rendering/gpu_program.h>
+#include <runtime/rendering/render_queue.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace checks
+{
+    namespace
+    {
+        // Materials and meshes are only compared by address while batching,
+        // addresses into these buffers stand in for them.
+        char material_ids[4] = {};
+        char mesh_ids[2]     = {};
+
+        material* get_material(std::size_t i) { return reinterpret_cast<material*>(&material_ids[i]); }
+        mesh*     get_mesh(std::size_t i) { return reinterpret_cast<mesh*>(&mesh_ids[i]); }
+
+        struct programs
+        {
+            // Without shaders the programs never touch the renderer.
+            gpu_program standard {asset_handle<gfx::shader>(), asset_handle<gfx::shader>()};
+            gpu_program instanced {asset_handle<gfx::shader>(), asset_handle<gfx::shader>()};
+        };
+
+        struct draw
+        {
+            material*     mat          = get_material(0);
+            gpu_program*  instanced    = nullptr;
+            bool          user_program = false;
+            bool          skinned      = false;
+            std::uint64_t state        = 0;
+            std::uint32_t user_index   = 0;
+            std::size_t   matrix_count = 1;
+            float         depth        = 0.5f;
+            float         x            = 0.0f;
+        };
+
+        void push(render_queue& queue, gpu_program& program, const draw& d)
+        {
+            std::vector<math::transform> matrices(d.matrix_count);
+            for (auto& matrix : matrices)
+            {
+                matrix.set_position({d.x, 0.0f, 0.0f});
+            }
+
+            queue.push(&program,
+                       d.user_program,
+                       d.mat,
+                       d.instanced,
+                       d.skinned,
+                       get_mesh(0),
+                       0,
+                       d.state,
+                       matrices.data(),
+                       matrices.size(),
+                       d.depth,
+                       d.user_index);
+        }
+
+        void check_merge(programs& p)
+        {
+            render_queue queue;
+            for (int i = 0; i < 3; ++i)
+            {
+                draw d;
+                d.instanced = &p.instanced;
+                d.x         = float(i);
+                push(queue, p.standard, d);
+            }
+            queue.build_batches();
+
+            const auto& batches = queue.get_batches();
+            CHECK(batches.size() == 1);
+            if (batches.size() != 1)
+                return;
+
+            CHECK(batches[0].first == 0);
+            CHECK(batches[0].count == 3);
+            CHECK(batches[0].first_instance == 0);
+            CHECK(batches[0].program == &p.instanced);
+
+            // One world matrix per packet, in submit order.
+            const auto& instances = queue.get_instances();
+            CHECK(instances.size() == 3);
+            for (std::size_t i = 0; i < instances.size(); ++i)
+            {
+                CHECK(instances[i][3][0] == float(i));
+            }
+        }
+
+        void check_single(programs& p)
+        {
+            // A lone packet is drawn with its own program, even when it could be instanced.
+            render_queue queue;
+            draw         d;
+            d.instanced = &p.instanced;
+            push(queue, p.standard, d);
+            queue.build_batches();
+
+            const auto& batches = queue.get_batches();
+            CHECK(batches.size() == 1);
+            CHECK(!batches.empty() && batches[0].count == 1 && batches[0].program == &p.standard);
+            CHECK(queue.get_instances().empty());
+        }
+
+        void check_fallback(programs& p)
+        {
+            // Each of these pairs has to be drawn one packet at a time.
+            std::vector<std::vector<draw>> cases;
+
+            draw no_program;
+            cases.push_back({no_program, no_program});
+
+            draw skinned;
+            skinned.instanced = &p.instanced;
+            skinned.skinned   = true;
+            cases.push_back({skinned, skinned});
+
+            draw user;
+            user.instanced    = &p.instanced;
+            user.user_program = true;
+            cases.push_back({user, user});
+
+            draw palette;
+            palette.instanced    = &p.instanced;
+            palette.matrix_count = 2;
+            cases.push_back({palette, palette});
+
+            draw base;
+            base.instanced = &p.instanced;
+
+            auto other_material = base;
+            other_material.mat  = get_material(1);
+            cases.push_back({base, other_material});
+
+            auto other_state  = base;
+            other_state.state = 1;
+            cases.push_back({base, other_state});
+
+            auto other_index       = base;
+            other_index.user_index = 1;
+            cases.push_back({base, other_index});
+
+            for (const auto& draws : cases)
+            {
+                render_queue queue;
+                for (const auto& d : draws)
+                {
+                    push(queue, p.standard, d);
+                }
+                queue.build_batches();
+
+                const auto& batches = queue.get_batches();
+                CHECK(batches.size() == draws.size());
+                for (std::size_t i = 0; i < batches.size(); ++i)
+                {
+                    CHECK(batches[i].first == i);
+                    CHECK(batches[i].count == 1);
+                    CHECK(batches[i].program == &p.standard);
+                }
+                CHECK(queue.get_instances().empty());
+            }
+        }
+
+        void check_sorted_merge(programs& p)
+        {
+            // Interleaved materials only form runs once sorted.
+            render_queue queue;
+            for (int i = 0; i < 4; ++i)
+            {
+                draw d;
+                d.instanced = &p.instanced;
+                d.mat       = get_material(std::size_t(i % 2));
+                d.depth     = 0.1f * float(i);
+                d.x         = float(i);
+                push(queue, p.standard, d);
+            }
+
+            queue.build_batches();
+            CHECK(queue.get_batches().size() == 4);
+
+            queue.sort();
+            queue.build_batches();
+
+            const auto& batches = queue.get_batches();
+            CHECK(batches.size() == 2);
+            for (const auto& b : batches)
+            {
+                CHECK(b.count == 2);
+                CHECK(b.program == &p.instanced);
+                CHECK(queue.get_packet(b.first).mat == queue.get_packet(b.first + 1).mat);
+            }
+
+            // Front to back within each run.
+            const auto& instances = queue.get_instances();
+            CHECK(instances.size() == 4);
+            if (instances.size() == 4)
+            {
+                CHECK(instances[0][3][0] == 0.0f && instances[1][3][0] == 2.0f);
+                CHECK(instances[2][3][0] == 1.0f && instances[3][3][0] == 3.0f);
+            }
+
+            queue.clear();
+            CHECK(queue.empty());
+            CHECK(queue.get_batches().empty());
+            CHECK(queue.get_instances().empty());
+        }
+    } // namespace
+
+    void run_render_queue_checks()
+    {
+        programs p;
+        check_merge(p);
+        check_single(p);
+        check_fallback(p);
+        check_sorted_merge(p);
+    }
+} // namespace checks